@@ -1,20 +1,97 @@
 TEMPLATE = app
 TARGET = SpaceInvadersEmu
 
-QT = core gui widgets
+QT = core gui network concurrent
+CONFIG += c++11
+
+# qmake CONFIG+=headless builds a version without any windows or audio devices
+headless {
+    DEFINES += HEADLESS
+} else {
+    QT += widgets multimedia
+}
+
+# qmake CONFIG+=cpuprofile counts cycles per opcode and prints the busiest ones on exit
+cpuprofile: DEFINES += CPU_PROFILE
+
+# qmake CONFIG+=watchpoints checks every memory access and port against --break and --watch-*
+watchpoints: DEFINES += WATCHPOINTS
 
 SOURCES += \
     main.cpp \
     emulator.cpp \
     cpu.cpp \
+    cpupolicy.cpp \
+    flagliveness.cpp \
+    fusion.cpp \
+    hle.cpp \
     flagregister.cpp \
-    gui.cpp
+    machine.cpp \
+    nativecore.cpp \
+    movie.cpp \
+    watchpoints.cpp \
+    gdbstub.cpp \
+    metrics.cpp \
+    trace.cpp \
+    lockstep.cpp \
+    disassembler.cpp \
+    netplay.cpp \
+    framepublisher.cpp \
+    options.cpp \
+    rewind.cpp \
+    sound.cpp \
+    audiosink.cpp \
+    capture.cpp \
+    cputest.cpp
 
 HEADERS += \
     emulator.h \
     cpu.h \
+    cpupolicy.h \
+    flagliveness.h \
+    fusion.h \
+    hle.h \
     flagregister.h \
-    gui.h
+    machine.h \
+    nativecore.h \
+    opcodes.h \
+    movie.h \
+    watchpoints.h \
+    gdbstub.h \
+    metrics.h \
+    trace.h \
+    lockstep.h \
+    disassembler.h \
+    netplay.h \
+    framepublisher.h \
+    hash.h \
+    options.h \
+    rewind.h \
+    sound.h \
+    audiosink.h \
+    lockfreequeue.h \
+    capture.h \
+    cputest.h \
+    rangecoder.h
+
+!headless {
+    SOURCES += gui.cpp
+    HEADERS += gui.h
+}
+
+unix:!macx: LIBS += -lrt
 
 RESOURCES += \
     resources.qrc
+
+# qmake CONFIG+=native compiles the ROM to C++ with tools/recompiler.cpp and links it in
+native {
+    DEFINES += NATIVE_CORE
+    NATIVE_ROMS = invaders.rom
+    recompile.input = NATIVE_ROMS
+    recompile.output = ${QMAKE_FILE_BASE}_native.cpp
+    recompile.commands = $$QMAKE_CXX -std=c++11 -O2 $$PWD/tools/recompiler.cpp -o recompiler && ./recompiler ${QMAKE_FILE_IN} ${QMAKE_FILE_OUT}
+    recompile.depends = $$PWD/tools/recompiler.cpp $$PWD/opcodes.h
+    recompile.variable_out = SOURCES
+    QMAKE_EXTRA_COMPILERS += recompile
+}
@@ -0,0 +1,56 @@
+# Shared library with the reinforcement learning environment and its C interface
+TEMPLATE = lib
+TARGET = spaceinvadersenv
+
+QT = core gui concurrent
+CONFIG += c++11
+DEFINES += HEADLESS
+
+# The observation kernels lean on the popcount instruction
+contains(QT_ARCH, x86_64): QMAKE_CXXFLAGS += -mpopcnt
+
+SOURCES += \
+    cpu.cpp \
+    cpupolicy.cpp \
+    flagliveness.cpp \
+    fusion.cpp \
+    hle.cpp \
+    flagregister.cpp \
+    machine.cpp \
+    nativecore.cpp \
+    trace.cpp \
+    environment.cpp \
+    observation.cpp \
+    environment_c.cpp
+
+HEADERS += \
+    cpu.h \
+    cpupolicy.h \
+    flagliveness.h \
+    fusion.h \
+    hle.h \
+    flagregister.h \
+    machine.h \
+    nativecore.h \
+    trace.h \
+    opcodes.h \
+    watchpoints.h \
+    hash.h \
+    environment.h \
+    observation.h \
+    environment_c.h
+
+RESOURCES += \
+    resources.qrc
+
+# qmake CONFIG+=native compiles the ROM to C++ with tools/recompiler.cpp and links it in
+native {
+    DEFINES += NATIVE_CORE
+    NATIVE_ROMS = invaders.rom
+    recompile.input = NATIVE_ROMS
+    recompile.output = ${QMAKE_FILE_BASE}_native.cpp
+    recompile.commands = $$QMAKE_CXX -std=c++11 -O2 $$PWD/tools/recompiler.cpp -o recompiler && ./recompiler ${QMAKE_FILE_IN} ${QMAKE_FILE_OUT}
+    recompile.depends = $$PWD/tools/recompiler.cpp $$PWD/opcodes.h
+    recompile.variable_out = SOURCES
+    QMAKE_EXTRA_COMPILERS += recompile
+}
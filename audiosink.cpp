@@ -0,0 +1,192 @@
+#include "audiosink.h"
+#include <QThread>
+#include <QCoreApplication>
+#include <QDebug>
+
+const int WAV_HEADER_SIZE = 44;
+
+// How far ahead of the wall clock the paced sinks let the mixer run
+const qint64 PACING_LEAD_NSECS = 10000000;
+
+NullSink::NullSink() : rate(0), samplesWritten(0)
+{
+}
+
+bool NullSink::open(int sampleRate)
+{
+    rate = sampleRate;
+    samplesWritten = 0;
+    clock.start();
+    return true;
+}
+
+void NullSink::write(const int16_t*, int count)
+{
+    samplesWritten += count;
+
+    qint64 ahead = bufferedNsecs();
+    if (ahead > PACING_LEAD_NSECS)
+        QThread::usleep((ahead - PACING_LEAD_NSECS) / 1000);
+}
+
+qint64 NullSink::bufferedNsecs() const
+{
+    qint64 streamTime = samplesWritten * 1000000000LL / rate;
+    qint64 ahead = streamTime - clock.nsecsElapsed();
+    return ahead > 0 ? ahead : 0;
+}
+
+WavFileSink::WavFileSink(const QString& fileName) : file(fileName), dataSize(0)
+{
+}
+
+bool WavFileSink::open(int sampleRate)
+{
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning("Could not open %s for writing.", qPrintable(file.fileName()));
+        return false;
+    }
+
+    dataSize = 0;
+    writeHeader(sampleRate);
+    return NullSink::open(sampleRate);
+}
+
+void WavFileSink::write(const int16_t* samples, int count)
+{
+    int bytes = count * sizeof(int16_t);
+    file.write(reinterpret_cast<const char*>(samples), bytes);
+    dataSize += bytes;
+
+    NullSink::write(samples, count);
+}
+
+void WavFileSink::close()
+{
+    if (!file.isOpen())
+        return;
+
+    // The sizes aren't known until the stream ends, so the header is patched afterwards
+    uint32_t riffSize = dataSize + WAV_HEADER_SIZE - 8;
+    file.seek(4);
+    file.write(reinterpret_cast<const char*>(&riffSize), 4);
+    file.seek(WAV_HEADER_SIZE - 4);
+    file.write(reinterpret_cast<const char*>(&dataSize), 4);
+    file.close();
+}
+
+void WavFileSink::writeHeader(int sampleRate)
+{
+    // Little endian host assumed, like the rest of the emulator
+    uint32_t zero = 0;
+    uint32_t fmtSize = 16;
+    uint16_t pcmFormat = 1;
+    uint16_t channels = 1;
+    uint32_t rate = sampleRate;
+    uint32_t byteRate = sampleRate * sizeof(int16_t);
+    uint16_t blockAlign = sizeof(int16_t);
+    uint16_t bitsPerSample = 16;
+
+    file.write("RIFF", 4);
+    file.write(reinterpret_cast<const char*>(&zero), 4);
+    file.write("WAVEfmt ", 8);
+    file.write(reinterpret_cast<const char*>(&fmtSize), 4);
+    file.write(reinterpret_cast<const char*>(&pcmFormat), 2);
+    file.write(reinterpret_cast<const char*>(&channels), 2);
+    file.write(reinterpret_cast<const char*>(&rate), 4);
+    file.write(reinterpret_cast<const char*>(&byteRate), 4);
+    file.write(reinterpret_cast<const char*>(&blockAlign), 2);
+    file.write(reinterpret_cast<const char*>(&bitsPerSample), 2);
+    file.write("data", 4);
+    file.write(reinterpret_cast<const char*>(&zero), 4);
+}
+
+#ifndef HEADLESS
+DeviceSink::DeviceSink() : output(0), device(0), rate(0)
+{
+}
+
+DeviceSink::~DeviceSink()
+{
+    close();
+}
+
+bool DeviceSink::open(int sampleRate)
+{
+    QAudioFormat format;
+    format.setSampleRate(sampleRate);
+    format.setChannelCount(1);
+    format.setSampleSize(16);
+    format.setCodec("audio/pcm");
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setSampleType(QAudioFormat::SignedInt);
+
+    if (!QAudioDeviceInfo::defaultOutputDevice().isFormatSupported(format))
+    {
+        qWarning("Default audio device does not support 16-bit mono at %d Hz.", sampleRate);
+        return false;
+    }
+
+    rate = sampleRate;
+
+    // Keep the device buffer small, it dominates the trigger to speaker latency
+    output = new QAudioOutput(format);
+    output->setBufferSize(sampleRate / 50 * sizeof(int16_t));
+    device = output->start();
+    return device != 0;
+}
+
+void DeviceSink::write(const int16_t* samples, int count)
+{
+    const char* data = reinterpret_cast<const char*>(samples);
+    int bytesLeft = count * sizeof(int16_t);
+
+    while (bytesLeft > 0)
+    {
+        int bytesFree = output->bytesFree();
+        if (bytesFree == 0)
+        {
+            // There is no event loop in the mixer thread, so let the backend run here
+            QCoreApplication::processEvents();
+            QThread::usleep(500);
+            continue;
+        }
+
+        int chunk = qMin(bytesFree, bytesLeft);
+        device->write(data, chunk);
+        data += chunk;
+        bytesLeft -= chunk;
+    }
+}
+
+void DeviceSink::close()
+{
+    if (output)
+    {
+        output->stop();
+        delete output;
+        output = 0;
+        device = 0;
+    }
+}
+
+qint64 DeviceSink::bufferedNsecs() const
+{
+    int bufferedBytes = output->bufferSize() - output->bytesFree();
+    return bufferedBytes / sizeof(int16_t) * 1000000000LL / rate;
+}
+#endif
+
+AudioSink* createAudioSink(const QString& type, const QString& fileName)
+{
+    if (type == "wav")
+        return new WavFileSink(fileName);
+#ifndef HEADLESS
+    if (type == "device")
+        return new DeviceSink();
+#endif
+    if (type != "null")
+        qWarning("Unknown audio sink %s, sound is discarded.", qPrintable(type));
+    return new NullSink();
+}
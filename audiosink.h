@@ -0,0 +1,85 @@
+#ifndef AUDIOSINK_H
+#define AUDIOSINK_H
+
+#include <stdint.h>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QString>
+
+#ifndef HEADLESS
+#include <QAudioOutput>
+#endif
+
+// Receives the mixed 16-bit mono stream. write() is called from the mixer
+// thread and is expected to block until the device can take more samples,
+// which is what paces the mixer.
+class AudioSink
+{
+public:
+    virtual ~AudioSink() {}
+
+    virtual bool open(int sampleRate) = 0;
+    virtual void write(const int16_t* samples, int count) = 0;
+    virtual void close() {}
+
+    // Time it takes for the last written sample to become audible
+    virtual qint64 bufferedNsecs() const = 0;
+};
+
+// Discards everything, but consumes it at the speed a real device would
+class NullSink : public AudioSink
+{
+public:
+    NullSink();
+
+    bool open(int sampleRate);
+    void write(const int16_t* samples, int count);
+    qint64 bufferedNsecs() const;
+
+private:
+    int rate;
+    qint64 samplesWritten;
+    QElapsedTimer clock;
+};
+
+// Same pacing as the null sink, but keeps the stream in a WAV file
+class WavFileSink : public NullSink
+{
+public:
+    explicit WavFileSink(const QString& fileName);
+
+    bool open(int sampleRate);
+    void write(const int16_t* samples, int count);
+    void close();
+
+private:
+    QFile file;
+    uint32_t dataSize;
+
+    void writeHeader(int sampleRate);
+};
+
+#ifndef HEADLESS
+// Plays the stream on the default output device through QAudioOutput in push mode
+class DeviceSink : public AudioSink
+{
+public:
+    DeviceSink();
+    ~DeviceSink();
+
+    bool open(int sampleRate);
+    void write(const int16_t* samples, int count);
+    void close();
+    qint64 bufferedNsecs() const;
+
+private:
+    QAudioOutput* output;
+    QIODevice* device;
+    int rate;
+};
+#endif
+
+// type is one of "null", "wav" or "device"
+AudioSink* createAudioSink(const QString& type, const QString& fileName);
+
+#endif // AUDIOSINK_H
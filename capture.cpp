@@ -0,0 +1,363 @@
+#include "capture.h"
+#include "rangecoder.h"
+#include "trace.h"
+#include <QImage>
+#include <QDebug>
+#include <cstring>
+
+// Probabilities for one frame. A byte is first coded as zero or not, in the
+// context of its neighbours to the left and above, then bit by bit.
+struct DeltaModel
+{
+    uint16_t zero[4];
+    uint16_t bits[256];
+
+    DeltaModel()
+    {
+        for (int i = 0; i < 4; ++i)
+            zero[i] = RANGE_PROB_INIT;
+        for (int i = 0; i < 256; ++i)
+            bits[i] = RANGE_PROB_INIT;
+    }
+};
+
+static int deltaContext(const uint8_t* delta, int i)
+{
+    return (i > 0 && delta[i - 1]) | (i >= SCREEN_WIDTH_BYTES && delta[i - SCREEN_WIDTH_BYTES]) << 1;
+}
+
+static void encodeDelta(const uint8_t* delta, QByteArray& out)
+{
+    DeltaModel model;
+    RangeEncoder encoder(out);
+
+    for (int i = 0; i < VIDEO_RAM_SIZE; ++i)
+    {
+        uint8_t value = delta[i];
+        encoder.encodeBit(model.zero[deltaContext(delta, i)], value != 0);
+        if (!value)
+            continue;
+
+        int node = 1;
+        for (int bit = 7; bit >= 0; --bit)
+        {
+            int b = value >> bit & 1;
+            encoder.encodeBit(model.bits[node], b);
+            node = node << 1 | b;
+        }
+    }
+    encoder.flush();
+}
+
+static bool decodeDelta(const uint8_t* data, int size, uint8_t* delta)
+{
+    DeltaModel model;
+    RangeDecoder decoder(data, size);
+
+    for (int i = 0; i < VIDEO_RAM_SIZE; ++i)
+    {
+        if (!decoder.decodeBit(model.zero[deltaContext(delta, i)]))
+        {
+            delta[i] = 0;
+            continue;
+        }
+
+        int node = 1;
+        for (int bit = 7; bit >= 0; --bit)
+            node = node << 1 | decoder.decodeBit(model.bits[node]);
+        delta[i] = node & 0xFF;
+    }
+    return !decoder.isOverrun();
+}
+
+VideoCapture::VideoCapture() : stalls(0), framesEncoded(0)
+{
+    for (int i = 0; i < CAPTURE_QUEUE_SIZE; ++i)
+        freeBuffers.push(i);
+}
+
+VideoCapture::~VideoCapture()
+{
+    finish();
+}
+
+bool VideoCapture::open(const QString& fileName)
+{
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning("Could not open %s for writing.", qPrintable(fileName));
+        return false;
+    }
+
+    CaptureFileHeader header;
+    header.magic = CAPTURE_MAGIC;
+    header.version = CAPTURE_VERSION;
+    header.frameRate = FRAME_RATE;
+    header.widthBytes = SCREEN_WIDTH_BYTES;
+    header.height = SCREEN_HEIGHT_PIXELS;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    start(QThread::LowPriority);
+    return true;
+}
+
+void VideoCapture::submit(uint64_t frame, const uint8_t* videoRam)
+{
+    // Frames are never dropped, if the encoder is a second behind the emulator waits for it
+    int slot;
+    while (!freeBuffers.pop(slot))
+    {
+        ++stalls;
+        QThread::usleep(100);
+    }
+
+    buffers[slot].frame = frame;
+    memcpy(buffers[slot].videoRam, videoRam, VIDEO_RAM_SIZE);
+    fullBuffers.push(slot);
+}
+
+void VideoCapture::finish()
+{
+    if (!file.isOpen())
+        return;
+
+    requestInterruption();
+    wait();
+
+    CaptureFooter footer;
+    footer.indexOffset = file.pos();
+    footer.records = framesEncoded;
+    footer.magic = CAPTURE_INDEX_MAGIC;
+    file.write(reinterpret_cast<const char*>(index.constData()), index.size() * sizeof(CaptureIndexEntry));
+    file.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+
+    qDebug("Captured %d frames into %lld KB, %.0f bytes per frame. The emulator waited for the encoder %d times.",
+           framesEncoded, (long long) file.pos() / 1024, framesEncoded ? footer.indexOffset / (double) framesEncoded : 0.0, stalls);
+    file.close();
+}
+
+void VideoCapture::encode(const FrameBuffer& buffer)
+{
+    bool keyframe = framesEncoded % CAPTURE_KEYFRAME_INTERVAL == 0;
+    if (keyframe)
+    {
+        CaptureIndexEntry entry;
+        entry.record = framesEncoded;
+        entry.offset = file.pos();
+        index.append(entry);
+
+        memcpy(delta, buffer.videoRam, VIDEO_RAM_SIZE);
+    }
+    else
+    {
+        for (int i = 0; i < VIDEO_RAM_SIZE; ++i)
+            delta[i] = buffer.videoRam[i] ^ previous[i];
+    }
+    memcpy(previous, buffer.videoRam, VIDEO_RAM_SIZE);
+
+    coded.clear();
+    encodeDelta(delta, coded);
+
+    CaptureFrameHeader header;
+    header.frame = buffer.frame;
+    header.size = coded.size();
+    header.keyframe = keyframe;
+    memset(header.reserved, 0, sizeof(header.reserved));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(coded);
+
+    ++framesEncoded;
+}
+
+void VideoCapture::run()
+{
+    setTraceThreadName("Capture");
+
+    // Everything queued before finish() was called is still encoded
+    while (true)
+    {
+        int slot;
+        if (fullBuffers.pop(slot))
+        {
+            TraceScope trace("Encode");
+            encode(buffers[slot]);
+            freeBuffers.push(slot);
+        }
+        else if (isInterruptionRequested())
+            break;
+        else
+            QThread::msleep(1);
+    }
+}
+
+CaptureReader::CaptureReader() : indexOffset(0), records(0), nextRecord(0)
+{
+    memset(current, 0, sizeof(current));
+}
+
+CaptureReader::~CaptureReader()
+{
+}
+
+bool CaptureReader::open(const QString& fileName)
+{
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning("Could not open %s.", qPrintable(fileName));
+        return false;
+    }
+
+    CaptureFileHeader header;
+    if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header)
+        || header.magic != CAPTURE_MAGIC || header.version != CAPTURE_VERSION
+        || header.widthBytes != SCREEN_WIDTH_BYTES || header.height != SCREEN_HEIGHT_PIXELS)
+    {
+        qWarning("%s is not a capture file.", qPrintable(fileName));
+        return false;
+    }
+
+    CaptureFooter footer;
+    file.seek(file.size() - sizeof(footer));
+    if (file.read(reinterpret_cast<char*>(&footer), sizeof(footer)) != sizeof(footer)
+        || footer.magic != CAPTURE_INDEX_MAGIC || footer.indexOffset > (uint64_t) file.size())
+    {
+        qWarning("%s has no index, the capture was not finished.", qPrintable(fileName));
+        return false;
+    }
+
+    indexOffset = footer.indexOffset;
+    records = footer.records;
+
+    int entries = (file.size() - sizeof(footer) - indexOffset) / sizeof(CaptureIndexEntry);
+    index.resize(entries);
+    file.seek(indexOffset);
+    file.read(reinterpret_cast<char*>(index.data()), entries * sizeof(CaptureIndexEntry));
+
+    file.seek(sizeof(header));
+    nextRecord = 0;
+    return true;
+}
+
+int CaptureReader::frameCount() const
+{
+    return records;
+}
+
+bool CaptureReader::readFrame(uint64_t& frame, uint8_t* videoRam)
+{
+    if (nextRecord >= records || file.pos() >= indexOffset)
+        return false;
+
+    CaptureFrameHeader header;
+    if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header))
+        return false;
+
+    QByteArray data = file.read(header.size);
+    if (data.size() != (int) header.size
+        || !decodeDelta(reinterpret_cast<const uint8_t*>(data.constData()), data.size(), delta))
+    {
+        qWarning("Capture is corrupt at record %d.", nextRecord);
+        return false;
+    }
+
+    if (header.keyframe)
+        memset(current, 0, sizeof(current));
+    for (int i = 0; i < VIDEO_RAM_SIZE; ++i)
+        current[i] ^= delta[i];
+
+    memcpy(videoRam, current, VIDEO_RAM_SIZE);
+    frame = header.frame;
+    ++nextRecord;
+    return true;
+}
+
+bool CaptureReader::seek(int record)
+{
+    if (record < 0 || record >= records)
+        return false;
+
+    // Start at the last keyframe before the record and decode up to it
+    int entry = index.size() - 1;
+    while (entry > 0 && index[entry].record > (uint64_t) record)
+        --entry;
+    if (entry < 0)
+        return false;
+
+    file.seek(index[entry].offset);
+    nextRecord = index[entry].record;
+
+    uint64_t frame;
+    uint8_t videoRam[VIDEO_RAM_SIZE];
+    while (nextRecord < record)
+    {
+        if (!readFrame(frame, videoRam))
+            return false;
+    }
+    return true;
+}
+
+// Draws video RAM the way it is shown on the cabinet, rotated a quarter turn counterclockwise
+static void renderUpright(const uint8_t* videoRam, uint8_t* pixels)
+{
+    for (int y = 0; y < SCREEN_HEIGHT_PIXELS; ++y)
+    {
+        for (int x = 0; x < SCREEN_WIDTH_PIXELS; ++x)
+        {
+            bool lit = videoRam[y * SCREEN_WIDTH_BYTES + x / 8] >> (x % 8) & 1;
+            pixels[(SCREEN_WIDTH_PIXELS - 1 - x) * SCREEN_HEIGHT_PIXELS + y] = lit ? 0xFF : 0;
+        }
+    }
+}
+
+bool convertCapture(const QString& inputFile, const QString& outputFile)
+{
+    CaptureReader reader;
+    if (!reader.open(inputFile))
+        return false;
+
+    bool png = outputFile.endsWith(".png");
+    QFile y4m(outputFile);
+    if (!png)
+    {
+        if (!y4m.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            qWarning("Could not open %s for writing.", qPrintable(outputFile));
+            return false;
+        }
+        y4m.write(QString("YUV4MPEG2 W%1 H%2 F%3:1 Ip A1:1 Cmono\n")
+                  .arg(SCREEN_HEIGHT_PIXELS).arg(SCREEN_WIDTH_PIXELS).arg(FRAME_RATE).toLatin1());
+    }
+
+    uint64_t frame;
+    uint8_t videoRam[VIDEO_RAM_SIZE];
+    QByteArray pixels(SCREEN_WIDTH_PIXELS * SCREEN_HEIGHT_PIXELS, 0);
+    int written = 0;
+    while (reader.readFrame(frame, videoRam))
+    {
+        renderUpright(videoRam, reinterpret_cast<uint8_t*>(pixels.data()));
+
+        if (png)
+        {
+            // out.png becomes out_000000.png, out_000001.png, ...
+            QString name = outputFile.left(outputFile.size() - 4) + QString("_%1.png").arg(written, 6, 10, QChar('0'));
+            QImage image(reinterpret_cast<const uchar*>(pixels.constData()), SCREEN_HEIGHT_PIXELS, SCREEN_WIDTH_PIXELS,
+                         SCREEN_HEIGHT_PIXELS, QImage::Format_Grayscale8);
+            if (!image.save(name))
+            {
+                qWarning("Could not write %s.", qPrintable(name));
+                return false;
+            }
+        }
+        else
+        {
+            y4m.write("FRAME\n");
+            y4m.write(pixels);
+        }
+        ++written;
+    }
+
+    qDebug("Converted %d of %d frames.", written, reader.frameCount());
+    return written == reader.frameCount();
+}
@@ -0,0 +1,125 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <QFile>
+#include <QThread>
+#include <QVector>
+#include "lockfreequeue.h"
+#include "machine.h"
+
+// A capture file is a header, one record per displayed frame, an index of
+// the keyframes and a footer pointing at the index. Every frame is video RAM
+// XORed with the frame before it, keyframes are XORed with a black screen so
+// decoding can start there. The result is coded with an adaptive range coder
+// whose model starts over on every frame. Little endian host assumed.
+const quint32 CAPTURE_MAGIC = 0x43564953; // "SIVC"
+const quint32 CAPTURE_INDEX_MAGIC = 0x58564953; // "SIVX"
+const quint16 CAPTURE_VERSION = 1;
+const int CAPTURE_KEYFRAME_INTERVAL = 60;
+
+const int CAPTURE_QUEUE_SIZE = 64; // About a second of frames
+
+struct CaptureFileHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t frameRate;
+    uint16_t widthBytes;
+    uint16_t height;
+};
+
+struct CaptureFrameHeader
+{
+    uint64_t frame; // Machine frame, goes backwards when the player rewinds
+    uint32_t size;  // Of the coded data following the header
+    uint8_t keyframe;
+    uint8_t reserved[3];
+};
+
+struct CaptureIndexEntry
+{
+    uint64_t record; // Position of the keyframe among all records
+    uint64_t offset; // Of its frame header in the file
+};
+
+struct CaptureFooter
+{
+    uint64_t indexOffset;
+    uint32_t records;
+    uint32_t magic;
+};
+
+// Encodes frames on its own thread. submit() is the only thing the emulation
+// thread does, it copies video RAM into a free buffer and queues it.
+class VideoCapture : public QThread
+{
+Q_OBJECT
+public:
+    VideoCapture();
+    ~VideoCapture();
+
+    bool open(const QString& fileName);
+    void submit(uint64_t frame, const uint8_t* videoRam);
+
+    // Encodes everything still queued, writes the index and closes the file
+    void finish();
+
+private:
+    struct FrameBuffer
+    {
+        uint64_t frame;
+        uint8_t videoRam[VIDEO_RAM_SIZE];
+    };
+
+    QFile file;
+    FrameBuffer buffers[CAPTURE_QUEUE_SIZE];
+
+    // Buffers go from the free queue to the emulation thread, to the full queue and back
+    LockFreeQueue<int, CAPTURE_QUEUE_SIZE> freeBuffers;
+    LockFreeQueue<int, CAPTURE_QUEUE_SIZE> fullBuffers;
+    int stalls; // Times submit() had to wait for the encoder
+
+    // Only used by the encoder thread
+    uint8_t previous[VIDEO_RAM_SIZE];
+    uint8_t delta[VIDEO_RAM_SIZE];
+    QByteArray coded;
+    QVector<CaptureIndexEntry> index;
+    int framesEncoded;
+
+    void encode(const FrameBuffer& buffer);
+
+protected:
+    void run();
+};
+
+// Reads a capture file back, sequentially or from any frame via the index
+class CaptureReader
+{
+public:
+    CaptureReader();
+    ~CaptureReader();
+
+    bool open(const QString& fileName);
+    int frameCount() const;
+
+    // Decodes the next frame into videoRam
+    bool readFrame(uint64_t& frame, uint8_t* videoRam);
+
+    // The next readFrame() returns the given record
+    bool seek(int record);
+
+private:
+    QFile file;
+    QVector<CaptureIndexEntry> index;
+    qint64 indexOffset;
+    int records;
+    int nextRecord;
+    uint8_t current[VIDEO_RAM_SIZE];
+    uint8_t delta[VIDEO_RAM_SIZE];
+};
+
+// Turns a capture into a Y4M video or, for names ending in .png, one PNG per frame
+bool convertCapture(const QString& inputFile, const QString& outputFile);
+
+#endif // CAPTURE_H
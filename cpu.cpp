@@ -1,9 +1,18 @@
 #include <cpu.h>
+#include "hash.h"
 #include <cstring>
 #include <QtGlobal>
 
-CPU::CPU() : conditionBits(), memory()
+// Until a ROM is loaded the CPU runs into zeros, which are NOPs
+static const uint8_t EMPTY_ROM[ROM_SIZE] = {};
+
+const uint8_t NO_DEAD_FLAGS[MEMORY_SIZE] = {};
+
+CPUBase::CPUBase() : conditionBits(), memoryHash(0), deadFlags(NO_DEAD_FLAGS), ram()
 {
+    readPages[0] = EMPTY_ROM;
+    readPages[1] = ram;
+
     memset(&registers, 0, sizeof(registers));
 
     input0 = PORT0_INIT;
@@ -17,7 +26,8 @@ CPU::CPU() : conditionBits(), memory()
     interruptsEnabled = false;
 }
 
-bool CPU::generateInterrupt(uint8_t opCode)
+template <class Policy>
+bool BasicCPU<Policy>::generateInterrupt(uint8_t opCode)
 {
     bool success = false;
     if (interruptsEnabled)
@@ -29,38 +39,68 @@ bool CPU::generateInterrupt(uint8_t opCode)
     return success;
 }
 
-int CPU::runNextInstruction()
+void CPUBase::setRom(const uint8_t* rom)
+{
+    readPages[0] = rom;
+}
+
+void CPUBase::rehashMemory()
 {
-    return decode(memory[registers.PC]);
+    memoryHash = ::memoryHash(ram, RAM_START, RAM_SIZE);
 }
 
-uint8_t CPU::getHighBits(uint16_t reg)
+template <class Policy>
+int BasicCPU<Policy>::runNextInstruction()
+{
+    uint8_t opcode = readMemory(registers.PC);
+    int cycles = decode(opcode);
+    tracePolicy.instruction(*this, opcode, cycles);
+    return cycles;
+}
+
+uint8_t CPUBase::getHighBits(uint16_t reg)
 {
    return (reg & 0xFF00) >> 8;
 }
 
-uint8_t CPU::getHighBits(uint8_t reg)
+uint8_t CPUBase::getHighBits(uint8_t reg)
 {
     return (reg & 0xF0) >> 4;
 }
 
-uint8_t CPU::getLowBits(uint16_t reg)
+uint8_t CPUBase::getLowBits(uint16_t reg)
 {
    return reg & 0x00FF;
 }
 
-uint8_t CPU::getLowBits(uint8_t reg)
+uint8_t CPUBase::getLowBits(uint8_t reg)
 {
     return reg & 0x0F;
 }
 
-uint16_t CPU::create16BitReg(uint8_t lowBits, uint8_t highBits)
+uint16_t CPUBase::create16BitReg(uint8_t lowBits, uint8_t highBits)
 {
     return (highBits << 8) + lowBits;
 }
 
-int CPU::addBytes(uint8_t byte1, uint8_t byte2, bool carryIn, FlagRegister flagsToCalc)
+uint16_t CPUBase::programStatusWord() const
+{
+    return (registers.A << 8) | conditionBits.getRegister();
+}
+
+void CPUBase::setProgramStatusWord(uint16_t word)
+{
+    conditionBits = FlagRegister(getLowBits(word));
+    registers.A = getHighBits(word);
+}
+
+template <class Policy>
+int BasicCPU<Policy>::addBytes(uint8_t byte1, uint8_t byte2, bool carryIn, FlagRegister flagsToCalc)
 {
+    // PC still points at the instruction
+    uint8_t dead = deadFlags[registers.PC & ADDRESS_MASK];
+    if (dead)
+        flagsToCalc.clearBits(dead);
     uint8_t carry = carryIn ? conditionBits.testBits(CARRY_BIT) : 0;
 
     if (flagsToCalc.testBits(AUX_BIT)) // AUX_BIT = carry from lower to higher nibble
@@ -78,16 +118,37 @@ int CPU::addBytes(uint8_t byte1, uint8_t byte2, bool carryIn, FlagRegister flags
     if (flagsToCalc.testBits(SIGN_BIT)) conditionBits.calculateSignBit(sum);
     if (flagsToCalc.testBits(PARITY_BIT)) conditionBits.calculateEvenParityBit(sum);
 
+    flagsPolicy.add(byte1, byte2, carry, flagsToCalc, conditionBits);
     return sum;
 }
 
-int CPU::NOP()
+// ANA, XRA and ORA always clear the carry and set the other flags by the result
+template <class Policy>
+void BasicCPU<Policy>::logicFlags(uint8_t result)
+{
+    conditionBits.clearBits(CARRY_BIT);
+
+    uint8_t dead = deadFlags[registers.PC & ADDRESS_MASK];
+    if (!dead)
+    {
+        conditionBits.calculateZeroSignParityBits(result);
+        return;
+    }
+
+    if (!(dead & ZERO_BIT)) conditionBits.calculateZeroBit(result);
+    if (!(dead & SIGN_BIT)) conditionBits.calculateSignBit(result);
+    if (!(dead & PARITY_BIT)) conditionBits.calculateEvenParityBit(result);
+}
+
+template <class Policy>
+int BasicCPU<Policy>::NOP()
 {
     registers.PC++;
     return 4;
 }
 
-int CPU::CMC()
+template <class Policy>
+int BasicCPU<Policy>::CMC()
 {
     conditionBits.toggleBits(CARRY_BIT);
 
@@ -95,7 +156,8 @@ int CPU::CMC()
     return 4;
 }
 
-int CPU::STC()
+template <class Policy>
+int BasicCPU<Policy>::STC()
 {
     conditionBits.setBits(CARRY_BIT);
 
@@ -103,7 +165,8 @@ int CPU::STC()
     return 4;
 }
 
-int CPU::INR(uint8_t &reg)
+template <class Policy>
+int BasicCPU<Policy>::INR(uint8_t &reg)
 {
     FlagRegister flagsToCalc(SIGN_BIT | ZERO_BIT | PARITY_BIT | AUX_BIT);
     reg = addBytes(reg, 1, false, flagsToCalc);
@@ -112,16 +175,25 @@ int CPU::INR(uint8_t &reg)
     return 5;
 }
 
-int CPU::INR_A() { return INR(registers.A); }
-int CPU::INR_B() { return INR(registers.B); }
-int CPU::INR_C() { return INR(registers.C); }
-int CPU::INR_D() { return INR(registers.D); }
-int CPU::INR_E() { return INR(registers.E); }
-int CPU::INR_H() { return INR(registers.H); }
-int CPU::INR_L() { return INR(registers.L); }
-int CPU::INR_M() { return INR(memory[create16BitReg(registers.L, registers.H)]); }
+template <class Policy> int BasicCPU<Policy>::INR_A() { return INR(registers.A); }
+template <class Policy> int BasicCPU<Policy>::INR_B() { return INR(registers.B); }
+template <class Policy> int BasicCPU<Policy>::INR_C() { return INR(registers.C); }
+template <class Policy> int BasicCPU<Policy>::INR_D() { return INR(registers.D); }
+template <class Policy> int BasicCPU<Policy>::INR_E() { return INR(registers.E); }
+template <class Policy> int BasicCPU<Policy>::INR_H() { return INR(registers.H); }
+template <class Policy> int BasicCPU<Policy>::INR_L() { return INR(registers.L); }
+template <class Policy>
+int BasicCPU<Policy>::INR_M()
+{
+    uint16_t address = registers.HL;
+    uint8_t value = readMemory(address);
+    int cycles = INR(value);
+    writeMemory(address, value);
+    return cycles;
+}
 
-int CPU::DCR(uint8_t &reg)
+template <class Policy>
+int BasicCPU<Policy>::DCR(uint8_t &reg)
 {
     reg = addBytes(reg, -1, false, SIGN_BIT | ZERO_BIT | PARITY_BIT | AUX_BIT);
 
@@ -129,16 +201,25 @@ int CPU::DCR(uint8_t &reg)
     return 5;
 }
 
-int CPU::DCR_A() { return DCR(registers.A); }
-int CPU::DCR_B() { return DCR(registers.B); }
-int CPU::DCR_C() { return DCR(registers.C); }
-int CPU::DCR_D() { return DCR(registers.D); }
-int CPU::DCR_E() { return DCR(registers.E); }
-int CPU::DCR_H() { return DCR(registers.H); }
-int CPU::DCR_L() { return DCR(registers.L); }
-int CPU::DCR_M() { return DCR(memory[create16BitReg(registers.L, registers.H)]); }
+template <class Policy> int BasicCPU<Policy>::DCR_A() { return DCR(registers.A); }
+template <class Policy> int BasicCPU<Policy>::DCR_B() { return DCR(registers.B); }
+template <class Policy> int BasicCPU<Policy>::DCR_C() { return DCR(registers.C); }
+template <class Policy> int BasicCPU<Policy>::DCR_D() { return DCR(registers.D); }
+template <class Policy> int BasicCPU<Policy>::DCR_E() { return DCR(registers.E); }
+template <class Policy> int BasicCPU<Policy>::DCR_H() { return DCR(registers.H); }
+template <class Policy> int BasicCPU<Policy>::DCR_L() { return DCR(registers.L); }
+template <class Policy>
+int BasicCPU<Policy>::DCR_M()
+{
+    uint16_t address = registers.HL;
+    uint8_t value = readMemory(address);
+    int cycles = DCR(value);
+    writeMemory(address, value);
+    return cycles;
+}
 
-int CPU::CMA()
+template <class Policy>
+int BasicCPU<Policy>::CMA()
 {
     registers.A = registers.A ^ 0xFF;
 
@@ -146,7 +227,8 @@ int CPU::CMA()
     return 4;
 }
 
-int CPU::DAA()
+template <class Policy>
+int BasicCPU<Policy>::DAA()
 {
     int8_t lowerNibble = getLowBits(registers.A);
     if (lowerNibble > 9 || conditionBits.testBits(AUX_BIT))
@@ -170,7 +252,8 @@ int CPU::DAA()
     return 4;
 }
 
-int CPU::MOV_B_B()
+template <class Policy>
+int BasicCPU<Policy>::MOV_B_B()
 {
     registers.B = registers.B;
 
@@ -178,7 +261,8 @@ int CPU::MOV_B_B()
     return 5;
 }
 
-int CPU::MOV_B_C()
+template <class Policy>
+int BasicCPU<Policy>::MOV_B_C()
 {
     registers.B = registers.C;
 
@@ -187,7 +271,8 @@ int CPU::MOV_B_C()
 }
 
 
-int CPU::MOV_B_D()
+template <class Policy>
+int BasicCPU<Policy>::MOV_B_D()
 {
     registers.B = registers.D;
 
@@ -195,7 +280,8 @@ int CPU::MOV_B_D()
     return 5;
 }
 
-int CPU::MOV_B_E()
+template <class Policy>
+int BasicCPU<Policy>::MOV_B_E()
 {
     registers.B = registers.E;
 
@@ -203,7 +289,8 @@ int CPU::MOV_B_E()
     return 5;
 }
 
-int CPU::MOV_B_H()
+template <class Policy>
+int BasicCPU<Policy>::MOV_B_H()
 {
     registers.B = registers.H;
 
@@ -211,7 +298,8 @@ int CPU::MOV_B_H()
     return 5;
 }
 
-int CPU::MOV_B_L()
+template <class Policy>
+int BasicCPU<Policy>::MOV_B_L()
 {
     registers.B = registers.L;
 
@@ -219,16 +307,18 @@ int CPU::MOV_B_L()
     return 5;
 }
 
-int CPU::MOV_B_M()
+template <class Policy>
+int BasicCPU<Policy>::MOV_B_M()
 {
-    int loadAddr = create16BitReg(registers.L, registers.H);
-    registers.B = memory[loadAddr];
+    int loadAddr = registers.HL;
+    registers.B = readMemory(loadAddr);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::MOV_B_A()
+template <class Policy>
+int BasicCPU<Policy>::MOV_B_A()
 {
     registers.B = registers.A;
 
@@ -236,7 +326,8 @@ int CPU::MOV_B_A()
     return 5;
 }
 
-int CPU::MOV_C_B()
+template <class Policy>
+int BasicCPU<Policy>::MOV_C_B()
 {
     registers.C = registers.B;
 
@@ -244,7 +335,8 @@ int CPU::MOV_C_B()
     return 5;
 }
 
-int CPU::MOV_C_C()
+template <class Policy>
+int BasicCPU<Policy>::MOV_C_C()
 {
     registers.C = registers.C;
 
@@ -252,7 +344,8 @@ int CPU::MOV_C_C()
     return 5;
 }
 
-int CPU::MOV_C_D()
+template <class Policy>
+int BasicCPU<Policy>::MOV_C_D()
 {
     registers.C = registers.D;
 
@@ -260,7 +353,8 @@ int CPU::MOV_C_D()
     return 5;
 }
 
-int CPU::MOV_C_E()
+template <class Policy>
+int BasicCPU<Policy>::MOV_C_E()
 {
     registers.C = registers.E;
 
@@ -268,7 +362,8 @@ int CPU::MOV_C_E()
     return 5;
 }
 
-int CPU::MOV_C_H()
+template <class Policy>
+int BasicCPU<Policy>::MOV_C_H()
 {
     registers.C = registers.H;
 
@@ -276,7 +371,8 @@ int CPU::MOV_C_H()
     return 5;
 }
 
-int CPU::MOV_C_L()
+template <class Policy>
+int BasicCPU<Policy>::MOV_C_L()
 {
     registers.C = registers.L;
 
@@ -284,16 +380,18 @@ int CPU::MOV_C_L()
     return 5;
 }
 
-int CPU::MOV_C_M()
+template <class Policy>
+int BasicCPU<Policy>::MOV_C_M()
 {
-    int loadAddr = create16BitReg(registers.L, registers.H);
-    registers.C = memory[loadAddr];
+    int loadAddr = registers.HL;
+    registers.C = readMemory(loadAddr);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::MOV_C_A()
+template <class Policy>
+int BasicCPU<Policy>::MOV_C_A()
 {
     registers.C = registers.A;
 
@@ -301,7 +399,8 @@ int CPU::MOV_C_A()
     return 5;
 }
 
-int CPU::MOV_D_B()
+template <class Policy>
+int BasicCPU<Policy>::MOV_D_B()
 {
     registers.D = registers.B;
 
@@ -309,7 +408,8 @@ int CPU::MOV_D_B()
     return 5;
 }
 
-int CPU::MOV_D_C()
+template <class Policy>
+int BasicCPU<Policy>::MOV_D_C()
 {
     registers.D = registers.C;
 
@@ -317,7 +417,8 @@ int CPU::MOV_D_C()
     return 5;
 }
 
-int CPU::MOV_D_D()
+template <class Policy>
+int BasicCPU<Policy>::MOV_D_D()
 {
     registers.D = registers.D;
 
@@ -325,7 +426,8 @@ int CPU::MOV_D_D()
     return 5;
 }
 
-int CPU::MOV_D_E()
+template <class Policy>
+int BasicCPU<Policy>::MOV_D_E()
 {
     registers.D = registers.E;
 
@@ -333,7 +435,8 @@ int CPU::MOV_D_E()
     return 5;
 }
 
-int CPU::MOV_D_H()
+template <class Policy>
+int BasicCPU<Policy>::MOV_D_H()
 {
     registers.D = registers.H;
 
@@ -341,7 +444,8 @@ int CPU::MOV_D_H()
     return 5;
 }
 
-int CPU::MOV_D_L()
+template <class Policy>
+int BasicCPU<Policy>::MOV_D_L()
 {
     registers.D = registers.L;
 
@@ -349,16 +453,18 @@ int CPU::MOV_D_L()
     return 5;
 }
 
-int CPU::MOV_D_M()
+template <class Policy>
+int BasicCPU<Policy>::MOV_D_M()
 {
-    int loadAddr = create16BitReg(registers.L, registers.H);
-    registers.D = memory[loadAddr];
+    int loadAddr = registers.HL;
+    registers.D = readMemory(loadAddr);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::MOV_D_A()
+template <class Policy>
+int BasicCPU<Policy>::MOV_D_A()
 {
     registers.D = registers.A;
 
@@ -366,7 +472,8 @@ int CPU::MOV_D_A()
     return 5;
 }
 
-int CPU::MOV_E_B()
+template <class Policy>
+int BasicCPU<Policy>::MOV_E_B()
 {
     registers.E = registers.B;
 
@@ -374,7 +481,8 @@ int CPU::MOV_E_B()
     return 5;
 }
 
-int CPU::MOV_E_C()
+template <class Policy>
+int BasicCPU<Policy>::MOV_E_C()
 {
     registers.E = registers.C;
 
@@ -382,7 +490,8 @@ int CPU::MOV_E_C()
     return 5;
 }
 
-int CPU::MOV_E_D()
+template <class Policy>
+int BasicCPU<Policy>::MOV_E_D()
 {
     registers.E = registers.D;
 
@@ -390,7 +499,8 @@ int CPU::MOV_E_D()
     return 5;
 }
 
-int CPU::MOV_E_E()
+template <class Policy>
+int BasicCPU<Policy>::MOV_E_E()
 {
     registers.E = registers.E;
 
@@ -398,7 +508,8 @@ int CPU::MOV_E_E()
     return 5;
 }
 
-int CPU::MOV_E_H()
+template <class Policy>
+int BasicCPU<Policy>::MOV_E_H()
 {
     registers.E = registers.H;
 
@@ -406,7 +517,8 @@ int CPU::MOV_E_H()
     return 5;
 }
 
-int CPU::MOV_E_L()
+template <class Policy>
+int BasicCPU<Policy>::MOV_E_L()
 {
     registers.E = registers.L;
 
@@ -414,16 +526,18 @@ int CPU::MOV_E_L()
     return 5;
 }
 
-int CPU::MOV_E_M()
+template <class Policy>
+int BasicCPU<Policy>::MOV_E_M()
 {
-    int loadAddr = create16BitReg(registers.L, registers.H);
-    registers.E = memory[loadAddr];
+    int loadAddr = registers.HL;
+    registers.E = readMemory(loadAddr);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::MOV_E_A()
+template <class Policy>
+int BasicCPU<Policy>::MOV_E_A()
 {
     registers.E = registers.A;
 
@@ -431,7 +545,8 @@ int CPU::MOV_E_A()
     return 5;
 }
 
-int CPU::MOV_H_B()
+template <class Policy>
+int BasicCPU<Policy>::MOV_H_B()
 {
     registers.H = registers.B;
 
@@ -439,7 +554,8 @@ int CPU::MOV_H_B()
     return 5;
 }
 
-int CPU::MOV_H_C()
+template <class Policy>
+int BasicCPU<Policy>::MOV_H_C()
 {
     registers.H = registers.C;
 
@@ -447,7 +563,8 @@ int CPU::MOV_H_C()
     return 5;
 }
 
-int CPU::MOV_H_D()
+template <class Policy>
+int BasicCPU<Policy>::MOV_H_D()
 {
     registers.H = registers.D;
 
@@ -455,7 +572,8 @@ int CPU::MOV_H_D()
     return 5;
 }
 
-int CPU::MOV_H_E()
+template <class Policy>
+int BasicCPU<Policy>::MOV_H_E()
 {
     registers.H = registers.E;
 
@@ -463,7 +581,8 @@ int CPU::MOV_H_E()
     return 5;
 }
 
-int CPU::MOV_H_H()
+template <class Policy>
+int BasicCPU<Policy>::MOV_H_H()
 {
     registers.H = registers.H;
 
@@ -471,7 +590,8 @@ int CPU::MOV_H_H()
     return 5;
 }
 
-int CPU::MOV_H_L()
+template <class Policy>
+int BasicCPU<Policy>::MOV_H_L()
 {
     registers.H = registers.L;
 
@@ -479,16 +599,18 @@ int CPU::MOV_H_L()
     return 5;
 }
 
-int CPU::MOV_H_M()
+template <class Policy>
+int BasicCPU<Policy>::MOV_H_M()
 {
-    int loadAddr = create16BitReg(registers.L, registers.H);
-    registers.H = memory[loadAddr];
+    int loadAddr = registers.HL;
+    registers.H = readMemory(loadAddr);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::MOV_H_A()
+template <class Policy>
+int BasicCPU<Policy>::MOV_H_A()
 {
     registers.H = registers.A;
 
@@ -496,7 +618,8 @@ int CPU::MOV_H_A()
     return 5;
 }
 
-int CPU::MOV_L_B()
+template <class Policy>
+int BasicCPU<Policy>::MOV_L_B()
 {
     registers.L = registers.B;
 
@@ -504,7 +627,8 @@ int CPU::MOV_L_B()
     return 5;
 }
 
-int CPU::MOV_L_C()
+template <class Policy>
+int BasicCPU<Policy>::MOV_L_C()
 {
     registers.L = registers.C;
 
@@ -512,7 +636,8 @@ int CPU::MOV_L_C()
     return 5;
 }
 
-int CPU::MOV_L_D()
+template <class Policy>
+int BasicCPU<Policy>::MOV_L_D()
 {
     registers.L = registers.D;
 
@@ -520,7 +645,8 @@ int CPU::MOV_L_D()
     return 5;
 }
 
-int CPU::MOV_L_E()
+template <class Policy>
+int BasicCPU<Policy>::MOV_L_E()
 {
     registers.L = registers.E;
 
@@ -528,7 +654,8 @@ int CPU::MOV_L_E()
     return 5;
 }
 
-int CPU::MOV_L_H()
+template <class Policy>
+int BasicCPU<Policy>::MOV_L_H()
 {
     registers.L = registers.H;
 
@@ -536,7 +663,8 @@ int CPU::MOV_L_H()
     return 5;
 }
 
-int CPU::MOV_L_L()
+template <class Policy>
+int BasicCPU<Policy>::MOV_L_L()
 {
     registers.L = registers.L;
 
@@ -544,16 +672,18 @@ int CPU::MOV_L_L()
     return 5;
 }
 
-int CPU::MOV_L_M()
+template <class Policy>
+int BasicCPU<Policy>::MOV_L_M()
 {
-    int loadAddr = create16BitReg(registers.L, registers.H);
-    registers.L = memory[loadAddr];
+    int loadAddr = registers.HL;
+    registers.L = readMemory(loadAddr);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::MOV_L_A()
+template <class Policy>
+int BasicCPU<Policy>::MOV_L_A()
 {
     registers.L = registers.A;
 
@@ -561,70 +691,78 @@ int CPU::MOV_L_A()
     return 5;
 }
 
-int CPU::MOV_M_B()
+template <class Policy>
+int BasicCPU<Policy>::MOV_M_B()
 {
-    int storeAddr = create16BitReg(registers.L, registers.H);
-    memory[storeAddr] = registers.B;
+    int storeAddr = registers.HL;
+    writeMemory(storeAddr, registers.B);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::MOV_M_C()
+template <class Policy>
+int BasicCPU<Policy>::MOV_M_C()
 {
-    int storeAddr = create16BitReg(registers.L, registers.H);
-    memory[storeAddr] = registers.C;
+    int storeAddr = registers.HL;
+    writeMemory(storeAddr, registers.C);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::MOV_M_D()
+template <class Policy>
+int BasicCPU<Policy>::MOV_M_D()
 {
-    int storeAddr = create16BitReg(registers.L, registers.H);
-    memory[storeAddr] = registers.D;
+    int storeAddr = registers.HL;
+    writeMemory(storeAddr, registers.D);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::MOV_M_E()
+template <class Policy>
+int BasicCPU<Policy>::MOV_M_E()
 {
-    int storeAddr = create16BitReg(registers.L, registers.H);
-    memory[storeAddr] = registers.E;
+    int storeAddr = registers.HL;
+    writeMemory(storeAddr, registers.E);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::MOV_M_H()
+template <class Policy>
+int BasicCPU<Policy>::MOV_M_H()
 {
-    int storeAddr = create16BitReg(registers.L, registers.H);
-    memory[storeAddr] = registers.H;
+    int storeAddr = registers.HL;
+    writeMemory(storeAddr, registers.H);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::MOV_M_L()
+template <class Policy>
+int BasicCPU<Policy>::MOV_M_L()
 {
-    int storeAddr = create16BitReg(registers.L, registers.H);
-    memory[storeAddr] = registers.L;
+    int storeAddr = registers.HL;
+    writeMemory(storeAddr, registers.L);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::MOV_M_A()
+template <class Policy>
+int BasicCPU<Policy>::MOV_M_A()
 {
-    int storeAddr = create16BitReg(registers.L, registers.H);
-    memory[storeAddr] = registers.A;
+    int storeAddr = registers.HL;
+    writeMemory(storeAddr, registers.A);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::MOV_A_B()
+template <class Policy>
+int BasicCPU<Policy>::MOV_A_B()
 {
     registers.A = registers.B;
 
@@ -632,7 +770,8 @@ int CPU::MOV_A_B()
     return 5;
 }
 
-int CPU::MOV_A_C()
+template <class Policy>
+int BasicCPU<Policy>::MOV_A_C()
 {
     registers.A = registers.C;
 
@@ -640,7 +779,8 @@ int CPU::MOV_A_C()
     return 5;
 }
 
-int CPU::MOV_A_D()
+template <class Policy>
+int BasicCPU<Policy>::MOV_A_D()
 {
     registers.A = registers.D;
 
@@ -648,7 +788,8 @@ int CPU::MOV_A_D()
     return 5;
 }
 
-int CPU::MOV_A_E()
+template <class Policy>
+int BasicCPU<Policy>::MOV_A_E()
 {
     registers.A = registers.E;
 
@@ -656,7 +797,8 @@ int CPU::MOV_A_E()
     return 5;
 }
 
-int CPU::MOV_A_H()
+template <class Policy>
+int BasicCPU<Policy>::MOV_A_H()
 {
     registers.A = registers.H;
 
@@ -664,7 +806,8 @@ int CPU::MOV_A_H()
     return 5;
 }
 
-int CPU::MOV_A_L()
+template <class Policy>
+int BasicCPU<Policy>::MOV_A_L()
 {
     registers.A = registers.L;
 
@@ -672,16 +815,18 @@ int CPU::MOV_A_L()
     return 5;
 }
 
-int CPU::MOV_A_M()
+template <class Policy>
+int BasicCPU<Policy>::MOV_A_M()
 {
-    int loadAddr = create16BitReg(registers.L, registers.H);
-    registers.A = memory[loadAddr];
+    int loadAddr = registers.HL;
+    registers.A = readMemory(loadAddr);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::MOV_A_A()
+template <class Policy>
+int BasicCPU<Policy>::MOV_A_A()
 {
     registers.A = registers.A;
 
@@ -689,7 +834,8 @@ int CPU::MOV_A_A()
     return 5;
 }
 
-int CPU::ADD(uint8_t operand)
+template <class Policy>
+int BasicCPU<Policy>::ADD(uint8_t operand)
 {
     FlagRegister flagsToCalc(CARRY_BIT | SIGN_BIT | ZERO_BIT | PARITY_BIT | AUX_BIT);
     registers.A = addBytes(registers.A, operand, false, flagsToCalc);
@@ -698,20 +844,22 @@ int CPU::ADD(uint8_t operand)
     return 4;
 }
 
-int CPU::ADD_B() { return ADD(registers.B); }
-int CPU::ADD_C() { return ADD(registers.C); }
-int CPU::ADD_D() { return ADD(registers.D); }
-int CPU::ADD_E() { return ADD(registers.E); }
-int CPU::ADD_H() { return ADD(registers.H); }
-int CPU::ADD_L() { return ADD(registers.L); }
-int CPU::ADD_A() { return ADD(registers.L); }
-int CPU::ADD_M()
+template <class Policy> int BasicCPU<Policy>::ADD_B() { return ADD(registers.B); }
+template <class Policy> int BasicCPU<Policy>::ADD_C() { return ADD(registers.C); }
+template <class Policy> int BasicCPU<Policy>::ADD_D() { return ADD(registers.D); }
+template <class Policy> int BasicCPU<Policy>::ADD_E() { return ADD(registers.E); }
+template <class Policy> int BasicCPU<Policy>::ADD_H() { return ADD(registers.H); }
+template <class Policy> int BasicCPU<Policy>::ADD_L() { return ADD(registers.L); }
+template <class Policy> int BasicCPU<Policy>::ADD_A() { return ADD(registers.L); }
+template <class Policy>
+int BasicCPU<Policy>::ADD_M()
 {
-    ADD(memory[create16BitReg(registers.L, registers.H)]);
+    ADD(readMemory(registers.HL));
     return 7;
 }
 
-int CPU::ADC(uint8_t operand)
+template <class Policy>
+int BasicCPU<Policy>::ADC(uint8_t operand)
 {
     FlagRegister flagsToCalc(CARRY_BIT | SIGN_BIT | ZERO_BIT | PARITY_BIT | AUX_BIT);
     registers.A = addBytes(registers.A, operand, true, flagsToCalc);
@@ -720,20 +868,22 @@ int CPU::ADC(uint8_t operand)
     return 4;
 }
 
-int CPU::ADC_B() { return ADC(registers.B); }
-int CPU::ADC_C() { return ADC(registers.C); }
-int CPU::ADC_D() { return ADC(registers.D); }
-int CPU::ADC_E() { return ADC(registers.E); }
-int CPU::ADC_H() { return ADC(registers.H); }
-int CPU::ADC_L() { return ADC(registers.L); }
-int CPU::ADC_A() { return ADC(registers.A); }
-int CPU::ADC_M()
+template <class Policy> int BasicCPU<Policy>::ADC_B() { return ADC(registers.B); }
+template <class Policy> int BasicCPU<Policy>::ADC_C() { return ADC(registers.C); }
+template <class Policy> int BasicCPU<Policy>::ADC_D() { return ADC(registers.D); }
+template <class Policy> int BasicCPU<Policy>::ADC_E() { return ADC(registers.E); }
+template <class Policy> int BasicCPU<Policy>::ADC_H() { return ADC(registers.H); }
+template <class Policy> int BasicCPU<Policy>::ADC_L() { return ADC(registers.L); }
+template <class Policy> int BasicCPU<Policy>::ADC_A() { return ADC(registers.A); }
+template <class Policy>
+int BasicCPU<Policy>::ADC_M()
 {
-    ADC(memory[create16BitReg(registers.L, registers.H)]);
+    ADC(readMemory(registers.HL));
     return 7;
 }
 
-int CPU::SUB(uint8_t operand)
+template <class Policy>
+int BasicCPU<Policy>::SUB(uint8_t operand)
 {
     FlagRegister flagsToCalc(CARRY_BIT | SIGN_BIT | ZERO_BIT | PARITY_BIT | AUX_BIT);
     int8_t operand2Cmp = (operand ^ 0xFF) + 1;
@@ -744,20 +894,22 @@ int CPU::SUB(uint8_t operand)
     return 4;
 }
 
-int CPU::SUB_B() { return SUB(registers.B); }
-int CPU::SUB_C() { return SUB(registers.C); }
-int CPU::SUB_D() { return SUB(registers.D); }
-int CPU::SUB_E() { return SUB(registers.E); }
-int CPU::SUB_H() { return SUB(registers.H); }
-int CPU::SUB_L() { return SUB(registers.L); }
-int CPU::SUB_A() { return SUB(registers.A); }
-int CPU::SUB_M()
+template <class Policy> int BasicCPU<Policy>::SUB_B() { return SUB(registers.B); }
+template <class Policy> int BasicCPU<Policy>::SUB_C() { return SUB(registers.C); }
+template <class Policy> int BasicCPU<Policy>::SUB_D() { return SUB(registers.D); }
+template <class Policy> int BasicCPU<Policy>::SUB_E() { return SUB(registers.E); }
+template <class Policy> int BasicCPU<Policy>::SUB_H() { return SUB(registers.H); }
+template <class Policy> int BasicCPU<Policy>::SUB_L() { return SUB(registers.L); }
+template <class Policy> int BasicCPU<Policy>::SUB_A() { return SUB(registers.A); }
+template <class Policy>
+int BasicCPU<Policy>::SUB_M()
 {
-    SUB(memory[create16BitReg(registers.L, registers.H)]);
+    SUB(readMemory(registers.HL));
     return 7;
 }
 
-int CPU::SBB(uint8_t operand)
+template <class Policy>
+int BasicCPU<Policy>::SBB(uint8_t operand)
 {
     FlagRegister flagsToCalc(CARRY_BIT | SIGN_BIT | ZERO_BIT | PARITY_BIT | AUX_BIT);
     operand = operand + conditionBits.testBits(CARRY_BIT);
@@ -769,89 +921,94 @@ int CPU::SBB(uint8_t operand)
     return 4;
 }
 
-int CPU::SBB_B() { return SBB(registers.B); }
-int CPU::SBB_C() { return SBB(registers.C); }
-int CPU::SBB_D() { return SBB(registers.D); }
-int CPU::SBB_E() { return SBB(registers.E); }
-int CPU::SBB_H() { return SBB(registers.H); }
-int CPU::SBB_L() { return SBB(registers.L); }
-int CPU::SBB_A() { return SBB(registers.A); }
-int CPU::SBB_M()
+template <class Policy> int BasicCPU<Policy>::SBB_B() { return SBB(registers.B); }
+template <class Policy> int BasicCPU<Policy>::SBB_C() { return SBB(registers.C); }
+template <class Policy> int BasicCPU<Policy>::SBB_D() { return SBB(registers.D); }
+template <class Policy> int BasicCPU<Policy>::SBB_E() { return SBB(registers.E); }
+template <class Policy> int BasicCPU<Policy>::SBB_H() { return SBB(registers.H); }
+template <class Policy> int BasicCPU<Policy>::SBB_L() { return SBB(registers.L); }
+template <class Policy> int BasicCPU<Policy>::SBB_A() { return SBB(registers.A); }
+template <class Policy>
+int BasicCPU<Policy>::SBB_M()
 {
-    SBB(memory[create16BitReg(registers.L, registers.H)]);
+    SBB(readMemory(registers.HL));
     return 7;
 }
 
-int CPU::ANA(uint8_t operand)
+template <class Policy>
+int BasicCPU<Policy>::ANA(uint8_t operand)
 {
     registers.A &= operand;
-    conditionBits.setBits(CARRY_BIT, false);
-    conditionBits.calculateZeroSignParityBits(registers.A);
+    logicFlags(registers.A);
 
     registers.PC++;
     return 4;
 }
 
-int CPU::ANA_B() { return ANA(registers.B); }
-int CPU::ANA_C() { return ANA(registers.C); }
-int CPU::ANA_D() { return ANA(registers.D); }
-int CPU::ANA_E() { return ANA(registers.E); }
-int CPU::ANA_H() { return ANA(registers.H); }
-int CPU::ANA_L() { return ANA(registers.L); }
-int CPU::ANA_A() { return ANA(registers.A); }
-int CPU::ANA_M()
+template <class Policy> int BasicCPU<Policy>::ANA_B() { return ANA(registers.B); }
+template <class Policy> int BasicCPU<Policy>::ANA_C() { return ANA(registers.C); }
+template <class Policy> int BasicCPU<Policy>::ANA_D() { return ANA(registers.D); }
+template <class Policy> int BasicCPU<Policy>::ANA_E() { return ANA(registers.E); }
+template <class Policy> int BasicCPU<Policy>::ANA_H() { return ANA(registers.H); }
+template <class Policy> int BasicCPU<Policy>::ANA_L() { return ANA(registers.L); }
+template <class Policy> int BasicCPU<Policy>::ANA_A() { return ANA(registers.A); }
+template <class Policy>
+int BasicCPU<Policy>::ANA_M()
 {
-    ANA(memory[create16BitReg(registers.L, registers.H)]);
+    ANA(readMemory(registers.HL));
     return 7;
 }
 
-int CPU::XRA(int8_t operand)
+template <class Policy>
+int BasicCPU<Policy>::XRA(int8_t operand)
 {
     registers.A ^= operand;
-    conditionBits.setBits(CARRY_BIT, false);
-    conditionBits.calculateZeroSignParityBits(registers.A);
+    logicFlags(registers.A);
 
     registers.PC++;
     return 4;
 }
 
-int CPU::XRA_B() { return XRA(registers.B); }
-int CPU::XRA_C() { return XRA(registers.C); }
-int CPU::XRA_D() { return XRA(registers.D); }
-int CPU::XRA_E() { return XRA(registers.E); }
-int CPU::XRA_H() { return XRA(registers.H); }
-int CPU::XRA_L() { return XRA(registers.L); }
-int CPU::XRA_A() { return XRA(registers.A); }
-int CPU::XRA_M()
+template <class Policy> int BasicCPU<Policy>::XRA_B() { return XRA(registers.B); }
+template <class Policy> int BasicCPU<Policy>::XRA_C() { return XRA(registers.C); }
+template <class Policy> int BasicCPU<Policy>::XRA_D() { return XRA(registers.D); }
+template <class Policy> int BasicCPU<Policy>::XRA_E() { return XRA(registers.E); }
+template <class Policy> int BasicCPU<Policy>::XRA_H() { return XRA(registers.H); }
+template <class Policy> int BasicCPU<Policy>::XRA_L() { return XRA(registers.L); }
+template <class Policy> int BasicCPU<Policy>::XRA_A() { return XRA(registers.A); }
+template <class Policy>
+int BasicCPU<Policy>::XRA_M()
 {
-    XRA(memory[create16BitReg(registers.L, registers.H)]);
+    XRA(readMemory(registers.HL));
     return 7;
 }
 
-int CPU::ORA(uint8_t operand)
+template <class Policy>
+int BasicCPU<Policy>::ORA(uint8_t operand)
 {
     registers.A |= operand;
-    conditionBits.setBits(CARRY_BIT, false);
-    conditionBits.calculateZeroSignParityBits(registers.A);
+    logicFlags(registers.A);
 
     registers.PC++;
     return 4;
 }
 
-int CPU::ORA_B() { return ORA(registers.B); }
-int CPU::ORA_C() { return ORA(registers.C); }
-int CPU::ORA_D() { return ORA(registers.D); }
-int CPU::ORA_E() { return ORA(registers.E); }
-int CPU::ORA_H() { return ORA(registers.H); }
-int CPU::ORA_L() { return ORA(registers.L); }
-int CPU::ORA_A() { return ORA(registers.A); }
-int CPU::ORA_M()
+template <class Policy> int BasicCPU<Policy>::ORA_B() { return ORA(registers.B); }
+template <class Policy> int BasicCPU<Policy>::ORA_C() { return ORA(registers.C); }
+template <class Policy> int BasicCPU<Policy>::ORA_D() { return ORA(registers.D); }
+template <class Policy> int BasicCPU<Policy>::ORA_E() { return ORA(registers.E); }
+template <class Policy> int BasicCPU<Policy>::ORA_H() { return ORA(registers.H); }
+template <class Policy> int BasicCPU<Policy>::ORA_L() { return ORA(registers.L); }
+template <class Policy> int BasicCPU<Policy>::ORA_A() { return ORA(registers.A); }
+template <class Policy>
+int BasicCPU<Policy>::ORA_M()
 {
-    ORA(memory[create16BitReg(registers.L, registers.H)]);
+    ORA(readMemory(registers.HL));
     return 7;
 }
 
-int CPU::CMP(uint8_t reg)
+template <class Policy>
+int BasicCPU<Policy>::CMP(uint8_t reg)
 {
     FlagRegister flagsToCalc(SIGN_BIT | ZERO_BIT | PARITY_BIT | AUX_BIT | CARRY_BIT);
     addBytes(registers.A, -reg, false, flagsToCalc);
@@ -862,20 +1019,22 @@ int CPU::CMP(uint8_t reg)
     return 4;
 }
 
-int CPU::CMP_B() { return CMP(registers.B); }
-int CPU::CMP_C() { return CMP(registers.C); }
-int CPU::CMP_D() { return CMP(registers.D); }
-int CPU::CMP_E() { return CMP(registers.E); }
-int CPU::CMP_H() { return CMP(registers.H); }
-int CPU::CMP_L() { return CMP(registers.L); }
-int CPU::CMP_A() { return CMP(registers.A); }
-int CPU::CMP_M()
+template <class Policy> int BasicCPU<Policy>::CMP_B() { return CMP(registers.B); }
+template <class Policy> int BasicCPU<Policy>::CMP_C() { return CMP(registers.C); }
+template <class Policy> int BasicCPU<Policy>::CMP_D() { return CMP(registers.D); }
+template <class Policy> int BasicCPU<Policy>::CMP_E() { return CMP(registers.E); }
+template <class Policy> int BasicCPU<Policy>::CMP_H() { return CMP(registers.H); }
+template <class Policy> int BasicCPU<Policy>::CMP_L() { return CMP(registers.L); }
+template <class Policy> int BasicCPU<Policy>::CMP_A() { return CMP(registers.A); }
+template <class Policy>
+int BasicCPU<Policy>::CMP_M()
 {
-    CMP(memory[create16BitReg(registers.L, registers.H)]);
+    CMP(readMemory(registers.HL));
     return 7;
 }
 
-int CPU::RLC()
+template <class Policy>
+int BasicCPU<Policy>::RLC()
 {
     uint8_t carry = (registers.A & HIGH_ORDER_BIT) >> 7;
     conditionBits.setBits(CARRY_BIT, carry);
@@ -886,7 +1045,8 @@ int CPU::RLC()
     return 4;
 }
 
-int CPU::RRC()
+template <class Policy>
+int BasicCPU<Policy>::RRC()
 {
     uint8_t carry = registers.A & LOW_ORDER_BIT;
     conditionBits.setBits(CARRY_BIT, carry);
@@ -897,7 +1057,8 @@ int CPU::RRC()
     return 4;
 }
 
-int CPU::RAL()
+template <class Policy>
+int BasicCPU<Policy>::RAL()
 {
     uint8_t newCarry = (registers.A & HIGH_ORDER_BIT) >> 7;
     uint8_t oldCarry = conditionBits.testBits(CARRY_BIT);
@@ -909,7 +1070,8 @@ int CPU::RAL()
     return 4;
 }
 
-int CPU::RAR()
+template <class Policy>
+int BasicCPU<Policy>::RAR()
 {
     uint8_t newCarry = registers.A & LOW_ORDER_BIT;
     uint8_t oldCarry = conditionBits.testBits(CARRY_BIT);
@@ -921,209 +1083,232 @@ int CPU::RAR()
     return 4;
 }
 
-int CPU::PUSH_B()
+template <class Policy>
+void BasicCPU<Policy>::push(uint16_t value)
 {
-    memory[registers.SP-1] = registers.B;
-    memory[registers.SP-2] = registers.C;
+    writeMemory(registers.SP-1, getHighBits(value));
+    writeMemory(registers.SP-2, getLowBits(value));
     registers.SP -= 2;
+}
+
+template <class Policy>
+uint16_t BasicCPU<Policy>::pop()
+{
+    uint16_t value = create16BitReg(readMemory(registers.SP), readMemory(registers.SP+1));
+    registers.SP += 2;
+    return value;
+}
+
+template <class Policy>
+int BasicCPU<Policy>::PUSH_B()
+{
+    push(registers.BC);
 
     registers.PC++;
     return 11;
 }
 
-int CPU::PUSH_D()
+template <class Policy>
+int BasicCPU<Policy>::PUSH_D()
 {
-    memory[registers.SP-1] = registers.D;
-    memory[registers.SP-2] = registers.E;
-    registers.SP -= 2;
+    push(registers.DE);
 
     registers.PC++;
     return 11;
 }
 
-int CPU::PUSH_H()
+template <class Policy>
+int BasicCPU<Policy>::PUSH_H()
 {
-    memory[registers.SP-1] = registers.H;
-    memory[registers.SP-2] = registers.L;
-    registers.SP -= 2;
+    push(registers.HL);
 
     registers.PC++;
     return 11;
 }
 
-int CPU::PUSH_PSW()
+template <class Policy>
+int BasicCPU<Policy>::PUSH_PSW()
 {
-    memory[registers.SP-1] = registers.A;
-    memory[registers.SP-2] = conditionBits.getRegister();
-    registers.SP -= 2;
+    push(programStatusWord());
 
     registers.PC++;
     return 11;
 }
 
-int CPU::POP_B()
+template <class Policy>
+int BasicCPU<Policy>::POP_B()
 {
-    registers.C = memory[registers.SP];
-    registers.B = memory[registers.SP+1];
-    registers.SP += 2;
+    registers.BC = pop();
 
     registers.PC++;
     return 10;
 }
 
-int CPU::POP_D()
+template <class Policy>
+int BasicCPU<Policy>::POP_D()
 {
-    registers.E = memory[registers.SP];
-    registers.D = memory[registers.SP+1];
-    registers.SP += 2;
+    registers.DE = pop();
 
     registers.PC++;
     return 10;
 }
 
-int CPU::POP_H()
+template <class Policy>
+int BasicCPU<Policy>::POP_H()
 {
-    registers.L = memory[registers.SP];
-    registers.H = memory[registers.SP+1];
-    registers.SP += 2;
+    registers.HL = pop();
 
     registers.PC++;
     return 10;
 }
 
-int CPU::POP_PSW()
+template <class Policy>
+int BasicCPU<Policy>::POP_PSW()
 {
-    conditionBits = FlagRegister(memory[registers.SP]);
-    registers.A = memory[registers.SP+1];
-    registers.SP += 2;
+    setProgramStatusWord(pop());
 
     registers.PC++;
     return 10;
 }
 
-int CPU::JMP()
+template <class Policy>
+int BasicCPU<Policy>::JMP()
 {
-    uint8_t lowBits = memory[registers.PC+1];
-    uint8_t highBits = memory[registers.PC+2];
+    uint8_t lowBits = readMemory(registers.PC+1);
+    uint8_t highBits = readMemory(registers.PC+2);
     registers.PC = create16BitReg(lowBits, highBits);
 
     return 10;
 }
 
-int CPU::LXI_B()
+template <class Policy>
+int BasicCPU<Policy>::LXI_B()
 {
-    registers.C = memory[registers.PC+1];
-    registers.B = memory[registers.PC+2];
+    registers.C = readMemory(registers.PC+1);
+    registers.B = readMemory(registers.PC+2);
 
     registers.PC += 3;
     return 10;
 }
 
-int CPU::LXI_D()
+template <class Policy>
+int BasicCPU<Policy>::LXI_D()
 {
-    registers.E = memory[registers.PC+1];
-    registers.D = memory[registers.PC+2];
+    registers.E = readMemory(registers.PC+1);
+    registers.D = readMemory(registers.PC+2);
 
     registers.PC += 3;
     return 10;
 }
 
-int CPU::LXI_H()
+template <class Policy>
+int BasicCPU<Policy>::LXI_H()
 {
-    registers.L = memory[registers.PC+1];
-    registers.H = memory[registers.PC+2];
+    registers.L = readMemory(registers.PC+1);
+    registers.H = readMemory(registers.PC+2);
 
     registers.PC += 3;
     return 10;
 }
 
-int CPU::LXI_SP()
+template <class Policy>
+int BasicCPU<Policy>::LXI_SP()
 {
-    uint8_t lowBits = memory[registers.PC+1];
-    uint8_t highBits = memory[registers.PC+2];
+    uint8_t lowBits = readMemory(registers.PC+1);
+    uint8_t highBits = readMemory(registers.PC+2);
     registers.SP = create16BitReg(lowBits, highBits);
 
     registers.PC += 3;
     return 10;
 }
 
-int CPU::MVI_B()
+template <class Policy>
+int BasicCPU<Policy>::MVI_B()
 {
-    registers.B = memory[registers.PC+1];
+    registers.B = readMemory(registers.PC+1);
 
     registers.PC += 2;
     return 7;
 }
 
-int CPU::MVI_C()
+template <class Policy>
+int BasicCPU<Policy>::MVI_C()
 {
-    registers.C = memory[registers.PC+1];
+    registers.C = readMemory(registers.PC+1);
 
     registers.PC += 2;
     return 7;
 }
 
-int CPU::MVI_D()
+template <class Policy>
+int BasicCPU<Policy>::MVI_D()
 {
-    registers.D = memory[registers.PC+1];
+    registers.D = readMemory(registers.PC+1);
 
     registers.PC += 2;
     return 7;
 }
 
-int CPU::MVI_E()
+template <class Policy>
+int BasicCPU<Policy>::MVI_E()
 {
-    registers.E = memory[registers.PC+1];
+    registers.E = readMemory(registers.PC+1);
 
     registers.PC += 2;
     return 7;
 }
 
-int CPU::MVI_H()
+template <class Policy>
+int BasicCPU<Policy>::MVI_H()
 {
-    registers.H = memory[registers.PC+1];
+    registers.H = readMemory(registers.PC+1);
 
     registers.PC += 2;
     return 7;
 }
 
-int CPU::MVI_L()
+template <class Policy>
+int BasicCPU<Policy>::MVI_L()
 {
-    registers.L = memory[registers.PC+1];
+    registers.L = readMemory(registers.PC+1);
 
     registers.PC += 2;
     return 7;
 }
 
-int CPU::MVI_M()
+template <class Policy>
+int BasicCPU<Policy>::MVI_M()
 {
-    int destination = create16BitReg(registers.L, registers.H);
-    memory[destination] = memory[registers.PC+1];
+    int destination = registers.HL;
+    writeMemory(destination, readMemory(registers.PC+1));
 
     registers.PC += 2;
     return 10;
 }
 
-int CPU::MVI_A()
+template <class Policy>
+int BasicCPU<Policy>::MVI_A()
 {
-    registers.A = memory[registers.PC+1];
+    registers.A = readMemory(registers.PC+1);
 
     registers.PC += 2;
     return 7;
 }
 
-int CPU::CALL()
+template <class Policy>
+int BasicCPU<Policy>::CALL()
 {
     uint16_t returnPC = registers.PC + 3;
-    memory[registers.SP-1] = getHighBits(returnPC);
-    memory[registers.SP-2] = getLowBits(returnPC);
+    writeMemory(registers.SP-1, getHighBits(returnPC));
+    writeMemory(registers.SP-2, getLowBits(returnPC));
     registers.SP -= 2;
 
-    registers.PC = create16BitReg(memory[registers.PC+1], memory[registers.PC+2]);
+    registers.PC = create16BitReg(readMemory(registers.PC+1), readMemory(registers.PC+2));
     return 17;
 }
 
-double CPU::conditionalCall(bool condition)
+template <class Policy>
+double BasicCPU<Policy>::conditionalCall(bool condition)
 {
     if(condition)
     {
@@ -1137,24 +1322,26 @@ double CPU::conditionalCall(bool condition)
     }
 }
 
-double CPU::CC() { return conditionalCall(conditionBits.testBits(CARRY_BIT)); }
-double CPU::CNC() { return conditionalCall(!conditionBits.testBits(CARRY_BIT)); }
-double CPU::CZ() { return conditionalCall(conditionBits.testBits(ZERO_BIT)); }
-double CPU::CNZ() { return conditionalCall(!conditionBits.testBits(ZERO_BIT)); }
-double CPU::CM() { return conditionalCall(conditionBits.testBits(SIGN_BIT)); }
-double CPU::CP() { return conditionalCall(!conditionBits.testBits(SIGN_BIT)); }
-double CPU::CPE() { return conditionalCall(conditionBits.testBits(PARITY_BIT)); }
-double CPU::CPO() { return conditionalCall(!conditionBits.testBits(PARITY_BIT)); }
+template <class Policy> double BasicCPU<Policy>::CC() { return conditionalCall(conditionBits.testBits(CARRY_BIT)); }
+template <class Policy> double BasicCPU<Policy>::CNC() { return conditionalCall(!conditionBits.testBits(CARRY_BIT)); }
+template <class Policy> double BasicCPU<Policy>::CZ() { return conditionalCall(conditionBits.testBits(ZERO_BIT)); }
+template <class Policy> double BasicCPU<Policy>::CNZ() { return conditionalCall(!conditionBits.testBits(ZERO_BIT)); }
+template <class Policy> double BasicCPU<Policy>::CM() { return conditionalCall(conditionBits.testBits(SIGN_BIT)); }
+template <class Policy> double BasicCPU<Policy>::CP() { return conditionalCall(!conditionBits.testBits(SIGN_BIT)); }
+template <class Policy> double BasicCPU<Policy>::CPE() { return conditionalCall(conditionBits.testBits(PARITY_BIT)); }
+template <class Policy> double BasicCPU<Policy>::CPO() { return conditionalCall(!conditionBits.testBits(PARITY_BIT)); }
 
-int CPU::RET()
+template <class Policy>
+int BasicCPU<Policy>::RET()
 {
-    registers.PC = create16BitReg(memory[registers.SP], memory[registers.SP+1]);
+    registers.PC = create16BitReg(readMemory(registers.SP), readMemory(registers.SP+1));
     registers.SP += 2;
 
     return 10;
 }
 
-double CPU::conditionalReturn(bool condition)
+template <class Policy>
+double BasicCPU<Policy>::conditionalReturn(bool condition)
 {
     if (condition)
     {
@@ -1168,108 +1355,106 @@ double CPU::conditionalReturn(bool condition)
     }
 }
 
-double CPU::RC() { return conditionalReturn(conditionBits.testBits(CARRY_BIT)); }
-double CPU::RNC() { return conditionalReturn(!conditionBits.testBits(CARRY_BIT)); }
-double CPU::RZ() { return conditionalReturn(conditionBits.testBits(ZERO_BIT)); }
-double CPU::RNZ() { return conditionalReturn(!conditionBits.testBits(ZERO_BIT)); }
-double CPU::RM() { return conditionalReturn(conditionBits.testBits(SIGN_BIT)); }
-double CPU::RP() { return conditionalReturn(!conditionBits.testBits(SIGN_BIT)); }
-double CPU::RPE() { return conditionalReturn(conditionBits.testBits(PARITY_BIT)); }
-double CPU::RPO() { return conditionalReturn(!conditionBits.testBits(PARITY_BIT)); }
+template <class Policy> double BasicCPU<Policy>::RC() { return conditionalReturn(conditionBits.testBits(CARRY_BIT)); }
+template <class Policy> double BasicCPU<Policy>::RNC() { return conditionalReturn(!conditionBits.testBits(CARRY_BIT)); }
+template <class Policy> double BasicCPU<Policy>::RZ() { return conditionalReturn(conditionBits.testBits(ZERO_BIT)); }
+template <class Policy> double BasicCPU<Policy>::RNZ() { return conditionalReturn(!conditionBits.testBits(ZERO_BIT)); }
+template <class Policy> double BasicCPU<Policy>::RM() { return conditionalReturn(conditionBits.testBits(SIGN_BIT)); }
+template <class Policy> double BasicCPU<Policy>::RP() { return conditionalReturn(!conditionBits.testBits(SIGN_BIT)); }
+template <class Policy> double BasicCPU<Policy>::RPE() { return conditionalReturn(conditionBits.testBits(PARITY_BIT)); }
+template <class Policy> double BasicCPU<Policy>::RPO() { return conditionalReturn(!conditionBits.testBits(PARITY_BIT)); }
 
-int CPU::LDA()
+template <class Policy>
+int BasicCPU<Policy>::LDA()
 {
-    uint16_t loadAddr = create16BitReg(memory[registers.PC+1], memory[registers.PC+2]);
-    registers.A = memory[loadAddr];
+    uint16_t loadAddr = create16BitReg(readMemory(registers.PC+1), readMemory(registers.PC+2));
+    registers.A = readMemory(loadAddr);
 
     registers.PC += 3;
     return 13;
 }
 
-int CPU::STA()
+template <class Policy>
+int BasicCPU<Policy>::STA()
 {
-    uint16_t storeAddr = create16BitReg(memory[registers.PC+1], memory[registers.PC+2]);
-    memory[storeAddr] = registers.A;
+    uint16_t storeAddr = create16BitReg(readMemory(registers.PC+1), readMemory(registers.PC+2));
+    writeMemory(storeAddr, registers.A);
 
     registers.PC += 3;
     return 13;
 }
 
-int CPU::SHLD()
+template <class Policy>
+int BasicCPU<Policy>::SHLD()
 {
-    uint16_t storeAddr = create16BitReg(memory[registers.PC+1], memory[registers.PC+2]);
-    memory[storeAddr] = registers.L;
-    memory[storeAddr+1] = registers.H;
+    uint16_t storeAddr = create16BitReg(readMemory(registers.PC+1), readMemory(registers.PC+2));
+    writeMemory(storeAddr, registers.L);
+    writeMemory(storeAddr+1, registers.H);
 
     registers.PC += 3;
     return 16;
 }
 
-int CPU::LHLD()
+template <class Policy>
+int BasicCPU<Policy>::LHLD()
 {
-    uint16_t loadAddr = create16BitReg(memory[registers.PC+1], memory[registers.PC+2]);
-    registers.L = memory[loadAddr];
-    registers.H = memory[loadAddr+1];
+    uint16_t loadAddr = create16BitReg(readMemory(registers.PC+1), readMemory(registers.PC+2));
+    registers.L = readMemory(loadAddr);
+    registers.H = readMemory(loadAddr+1);
 
     registers.PC += 3;
     return 16;
 }
 
-int CPU::LDAX_B()
+template <class Policy>
+int BasicCPU<Policy>::LDAX_B()
 {
-    uint16_t loadAddr = create16BitReg(registers.C, registers.B);
-    registers.A = memory[loadAddr];
+    uint16_t loadAddr = registers.BC;
+    registers.A = readMemory(loadAddr);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::LDAX_D()
+template <class Policy>
+int BasicCPU<Policy>::LDAX_D()
 {
-    uint16_t loadAddr = create16BitReg(registers.E, registers.D);
-    registers.A = memory[loadAddr];
+    uint16_t loadAddr = registers.DE;
+    registers.A = readMemory(loadAddr);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::INX_B()
+template <class Policy>
+int BasicCPU<Policy>::INX_B()
 {
-    uint16_t regBC = create16BitReg(registers.C, registers.B);
-    ++regBC;
-
-    registers.B = getHighBits(regBC);
-    registers.C = getLowBits(regBC);
+    ++registers.BC;
 
     registers.PC++;
     return 5;
 }
 
-int CPU::INX_D()
+template <class Policy>
+int BasicCPU<Policy>::INX_D()
 {
-    uint16_t regDE = create16BitReg(registers.E, registers.D);
-    ++regDE;
-
-    registers.D = getHighBits(regDE);
-    registers.E = getLowBits(regDE);
+    ++registers.DE;
 
     registers.PC++;
     return 5;
 }
 
-int CPU::INX_H()
+template <class Policy>
+int BasicCPU<Policy>::INX_H()
 {
-    uint16_t regHL = create16BitReg(registers.L, registers.H);
-    ++regHL;
-
-    registers.H = getHighBits(regHL);
-    registers.L = getLowBits(regHL);
+    ++registers.HL;
 
     registers.PC++;
     return 5;
 }
 
-int CPU::INX_SP()
+template <class Policy>
+int BasicCPU<Policy>::INX_SP()
 {
     registers.SP++;
 
@@ -1277,43 +1462,35 @@ int CPU::INX_SP()
     return 5;
 }
 
-int CPU::DCX_B()
+template <class Policy>
+int BasicCPU<Policy>::DCX_B()
 {
-    uint16_t regBC = create16BitReg(registers.C, registers.B);
-    --regBC;
-
-    registers.B = getHighBits(regBC);
-    registers.C = getLowBits(regBC);
+    --registers.BC;
 
     registers.PC++;
     return 5;
 }
 
-int CPU::DCX_D()
+template <class Policy>
+int BasicCPU<Policy>::DCX_D()
 {
-    uint16_t regDE = create16BitReg(registers.E, registers.D);
-    --regDE;
-
-    registers.D = getHighBits(regDE);
-    registers.E = getLowBits(regDE);
+    --registers.DE;
 
     registers.PC++;
     return 5;
 }
 
-int CPU::DCX_H()
+template <class Policy>
+int BasicCPU<Policy>::DCX_H()
 {
-    uint16_t regHL = create16BitReg(registers.L, registers.H);
-    --regHL;
-
-    registers.H = getHighBits(regHL);
-    registers.L = getLowBits(regHL);
+    --registers.HL;
 
     registers.PC++;
     return 5;
 }
 
-int CPU::DCX_SP()
+template <class Policy>
+int BasicCPU<Policy>::DCX_SP()
 {
     registers.SP--;
 
@@ -1321,7 +1498,8 @@ int CPU::DCX_SP()
     return 5;
 }
 
-int CPU::conditionalJump(bool condition)
+template <class Policy>
+int BasicCPU<Policy>::conditionalJump(bool condition)
 {
     if (condition)
         JMP();
@@ -1331,16 +1509,17 @@ int CPU::conditionalJump(bool condition)
     return 10;
 }
 
-int CPU::JC() { return conditionalJump(conditionBits.testBits(CARRY_BIT)); }
-int CPU::JNC() { return conditionalJump(!conditionBits.testBits(CARRY_BIT)); }
-int CPU::JZ() { return conditionalJump(conditionBits.testBits(ZERO_BIT)); }
-int CPU::JNZ() { return conditionalJump(!conditionBits.testBits(ZERO_BIT)); }
-int CPU::JM() { return conditionalJump(conditionBits.testBits(SIGN_BIT)); }
-int CPU::JP() { return conditionalJump(!conditionBits.testBits(SIGN_BIT)); }
-int CPU::JPE() { return conditionalJump(conditionBits.testBits(PARITY_BIT)); }
-int CPU::JPO() { return conditionalJump(!conditionBits.testBits(PARITY_BIT)); }
+template <class Policy> int BasicCPU<Policy>::JC() { return conditionalJump(conditionBits.testBits(CARRY_BIT)); }
+template <class Policy> int BasicCPU<Policy>::JNC() { return conditionalJump(!conditionBits.testBits(CARRY_BIT)); }
+template <class Policy> int BasicCPU<Policy>::JZ() { return conditionalJump(conditionBits.testBits(ZERO_BIT)); }
+template <class Policy> int BasicCPU<Policy>::JNZ() { return conditionalJump(!conditionBits.testBits(ZERO_BIT)); }
+template <class Policy> int BasicCPU<Policy>::JM() { return conditionalJump(conditionBits.testBits(SIGN_BIT)); }
+template <class Policy> int BasicCPU<Policy>::JP() { return conditionalJump(!conditionBits.testBits(SIGN_BIT)); }
+template <class Policy> int BasicCPU<Policy>::JPE() { return conditionalJump(conditionBits.testBits(PARITY_BIT)); }
+template <class Policy> int BasicCPU<Policy>::JPO() { return conditionalJump(!conditionBits.testBits(PARITY_BIT)); }
 
-int CPU::EI()
+template <class Policy>
+int BasicCPU<Policy>::EI()
 {
     interruptsEnabled = true;
 
@@ -1348,7 +1527,8 @@ int CPU::EI()
     return 4;
 }
 
-int CPU::DI()
+template <class Policy>
+int BasicCPU<Policy>::DI()
 {
     interruptsEnabled = false;
 
@@ -1356,15 +1536,16 @@ int CPU::DI()
     return 4;
 }
 
-int CPU::RST(uint8_t resetNr)
+template <class Policy>
+int BasicCPU<Policy>::RST(uint8_t resetNr)
 {
     Q_ASSERT(resetNr <= 7);
 
     uint8_t lowPCBits = getLowBits(registers.PC);
     uint8_t highPCBits = getHighBits(registers.PC);
 
-    memory[registers.SP-1] = highPCBits;
-    memory[registers.SP-2] = lowPCBits;
+    writeMemory(registers.SP-1, highPCBits);
+    writeMemory(registers.SP-2, lowPCBits);
     registers.SP -= 2;
 
     uint16_t resetAddr = resetNr << 3;
@@ -1373,18 +1554,19 @@ int CPU::RST(uint8_t resetNr)
     return 11;
 }
 
-int CPU::RST_0() { return RST(0); }
-int CPU::RST_1() { return RST(1); }
-int CPU::RST_2() { return RST(2); }
-int CPU::RST_3() { return RST(3); }
-int CPU::RST_4() { return RST(4); }
-int CPU::RST_5() { return RST(5); }
-int CPU::RST_6() { return RST(6); }
-int CPU::RST_7() { return RST(7); }
+template <class Policy> int BasicCPU<Policy>::RST_0() { return RST(0); }
+template <class Policy> int BasicCPU<Policy>::RST_1() { return RST(1); }
+template <class Policy> int BasicCPU<Policy>::RST_2() { return RST(2); }
+template <class Policy> int BasicCPU<Policy>::RST_3() { return RST(3); }
+template <class Policy> int BasicCPU<Policy>::RST_4() { return RST(4); }
+template <class Policy> int BasicCPU<Policy>::RST_5() { return RST(5); }
+template <class Policy> int BasicCPU<Policy>::RST_6() { return RST(6); }
+template <class Policy> int BasicCPU<Policy>::RST_7() { return RST(7); }
 
-int CPU::IN()
+template <class Policy>
+int BasicCPU<Policy>::IN()
 {
-    uint8_t inputNr = memory[registers.PC+1];
+    uint8_t inputNr = readMemory(registers.PC+1);
 
     switch (inputNr)
     {
@@ -1400,14 +1582,16 @@ int CPU::IN()
       default:
         qDebug() << "Inupt nr " << inputNr << " not implemented";
     }
+    memoryPolicy.in(*this, inputNr, registers.A);
 
     registers.PC += 2;
     return 10;
 }
 
-int CPU::OUT()
+template <class Policy>
+int BasicCPU<Policy>::OUT()
 {
-    uint8_t outputNr = memory[registers.PC+1];
+    uint8_t outputNr = readMemory(registers.PC+1);
 
     switch (outputNr)
     {
@@ -1432,12 +1616,14 @@ int CPU::OUT()
       default:
         qDebug() << "Output nr " << outputNr << " not implemented";
     }
+    memoryPolicy.out(*this, outputNr, registers.A);
 
     registers.PC += 2;
     return 10;
 }
 
-void CPU::shiftRegisterOp()
+template <class Policy>
+void BasicCPU<Policy>::shiftRegisterOp()
 {
     uint8_t offset = output2 & 7;  // Offset is kept in the three first bits
 
@@ -1452,113 +1638,99 @@ void CPU::shiftRegisterOp()
     input3 = (shiftRegister & resultBitMask) >> (8 - offset);
 }
 
-int CPU::ADI() { ADD(memory[registers.PC+1]); registers.PC++; return 7;}
-int CPU::SUI() { SUB(memory[registers.PC+1]); registers.PC++; return 7;}
-int CPU::ANI() { ANA(memory[registers.PC+1]); registers.PC++; return 7;}
-int CPU::ORI() { ORA(memory[registers.PC+1]); registers.PC++; return 7;}
-int CPU::ACI() { ADC(memory[registers.PC+1]); registers.PC++; return 7;}
-int CPU::SBI() { SBB(memory[registers.PC+1]); registers.PC++; return 7;}
-int CPU::XRI() { XRA(memory[registers.PC+1]); registers.PC++; return 7;}
-int CPU::CPI() { CMP(memory[registers.PC+1]); registers.PC++; return 7;}
-
-int CPU::DAD(uint8_t highReg, uint8_t lowReg)
-{
-    uint16_t operandReg = create16BitReg(lowReg, highReg);
-    uint16_t regHL = create16BitReg(registers.L, registers.H);
-    int32_t result = operandReg + regHL;
-
-    if (result & 0x10000)
-        conditionBits.setBits(CARRY_BIT);
-
-    registers.H = getHighBits( (uint16_t) result);
-    registers.L = getLowBits( (uint16_t) result);
+template <class Policy> int BasicCPU<Policy>::ADI() { ADD(readMemory(registers.PC+1)); registers.PC++; return 7;}
+template <class Policy> int BasicCPU<Policy>::SUI() { SUB(readMemory(registers.PC+1)); registers.PC++; return 7;}
+template <class Policy> int BasicCPU<Policy>::ANI() { ANA(readMemory(registers.PC+1)); registers.PC++; return 7;}
+template <class Policy> int BasicCPU<Policy>::ORI() { ORA(readMemory(registers.PC+1)); registers.PC++; return 7;}
+template <class Policy> int BasicCPU<Policy>::ACI() { ADC(readMemory(registers.PC+1)); registers.PC++; return 7;}
+template <class Policy> int BasicCPU<Policy>::SBI() { SBB(readMemory(registers.PC+1)); registers.PC++; return 7;}
+template <class Policy> int BasicCPU<Policy>::XRI() { XRA(readMemory(registers.PC+1)); registers.PC++; return 7;}
+template <class Policy> int BasicCPU<Policy>::CPI() { CMP(readMemory(registers.PC+1)); registers.PC++; return 7;}
 
-    registers.PC++;
-    return 10;
-}
-
-int CPU::DAD_SP()
+template <class Policy>
+int BasicCPU<Policy>::DAD(uint16_t operand)
 {
-    uint16_t regHL = create16BitReg(registers.L, registers.H);
-    int32_t result = registers.SP + regHL;
+    uint32_t result = registers.HL + operand;
 
     if (result & 0x10000)
         conditionBits.setBits(CARRY_BIT);
 
-    registers.H = getHighBits( (uint16_t) result);
-    registers.L = getLowBits( (uint16_t) result);
+    registers.HL = result;
 
     registers.PC++;
     return 10;
 }
 
-int CPU::DAD_B() { return DAD(registers.B, registers.C); }
-int CPU::DAD_D() { return DAD(registers.D, registers.E); }
-int CPU::DAD_H() { return DAD(registers.H, registers.L); }
+template <class Policy> int BasicCPU<Policy>::DAD_B() { return DAD(registers.BC); }
+template <class Policy> int BasicCPU<Policy>::DAD_D() { return DAD(registers.DE); }
+template <class Policy> int BasicCPU<Policy>::DAD_H() { return DAD(registers.HL); }
+template <class Policy> int BasicCPU<Policy>::DAD_SP() { return DAD(registers.SP); }
 
-int CPU::STAX_B()
+template <class Policy>
+int BasicCPU<Policy>::STAX_B()
 {
-    uint16_t storeAddr = create16BitReg(registers.C, registers.B);
-    memory[storeAddr] = registers.A;
+    uint16_t storeAddr = registers.BC;
+    writeMemory(storeAddr, registers.A);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::STAX_D()
+template <class Policy>
+int BasicCPU<Policy>::STAX_D()
 {
-    uint16_t storeAddr = create16BitReg(registers.E, registers.D);
-    memory[storeAddr] = registers.A;
+    uint16_t storeAddr = registers.DE;
+    writeMemory(storeAddr, registers.A);
 
     registers.PC++;
     return 7;
 }
 
-int CPU::PCHL()
+template <class Policy>
+int BasicCPU<Policy>::PCHL()
 {
-    registers.PC = create16BitReg(registers.L, registers.H);
+    registers.PC = registers.HL;
     return 5;
 }
 
-int CPU::XCHG()
+template <class Policy>
+int BasicCPU<Policy>::XCHG()
 {
-    uint16_t regDE = create16BitReg(registers.E, registers.D);
-    uint16_t regHL = create16BitReg(registers.L, registers.H);
-
-    registers.D = getHighBits(regHL);
-    registers.E = getLowBits(regHL);
-
-    registers.H = getHighBits(regDE);
-    registers.L = getLowBits(regDE);
+    uint16_t regDE = registers.DE;
+    registers.DE = registers.HL;
+    registers.HL = regDE;
 
     registers.PC++;
     return 5;
 }
 
-int CPU::XTHL()
+template <class Policy>
+int BasicCPU<Policy>::XTHL()
 {
     uint8_t regH = registers.H;
     uint8_t regL = registers.L;
 
-    registers.L = memory[registers.SP];
-    registers.H = memory[registers.SP+1];
+    registers.L = readMemory(registers.SP);
+    registers.H = readMemory(registers.SP+1);
 
-    memory[registers.SP] = regL;
-    memory[registers.SP+1] = regH;
+    writeMemory(registers.SP, regL);
+    writeMemory(registers.SP+1, regH);
 
     registers.PC++;
     return 18;
 }
 
-int CPU::SPHL()
+template <class Policy>
+int BasicCPU<Policy>::SPHL()
 {
-    registers.SP = create16BitReg(registers.L, registers.H);
+    registers.SP = registers.HL;
 
     registers.PC++;
     return 5;
 }
 
-int CPU::decode(uint8_t op)
+template <class Policy>
+int BasicCPU<Policy>::decode(uint8_t op)
 {
     switch(op)
     {
@@ -2082,3 +2254,7 @@ int CPU::decode(uint8_t op)
     }
     return 0;
 }
+
+// Only the CPUs selected in cpu.h get compiled
+template class BasicCPU<CPUPolicy>;
+template class BasicCPU<TestProgramPolicy>;
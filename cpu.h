@@ -6,12 +6,17 @@
 #include <QDebug>
 #include <QKeyEvent>
 #include "flagregister.h"
+#include "cpupolicy.h"
+#include "hash.h"
 
 const uint8_t HIGH_ORDER_BIT = 0x80;
 const uint8_t LOW_ORDER_BIT = 0x01;
 
 const int MEMORY_SIZE = 0x4000;
 
+// Only 14 address lines are decoded, RAM shows up again above 0x4000
+const uint16_t ADDRESS_MASK = MEMORY_SIZE - 1;
+
 const int ROM_START = 0x00;
 const int ROM_SIZE = 0x2000;
 
@@ -21,6 +26,10 @@ const int WORK_RAM_SIZE = 0x400;
 const int VIDEO_RAM_START = 0x2400;
 const int VIDEO_RAM_SIZE = 0x1C00;
 
+// Work and video RAM together, everything that changes while the game runs
+const int RAM_START = WORK_RAM_START;
+const int RAM_SIZE = WORK_RAM_SIZE + VIDEO_RAM_SIZE;
+
 const int COIN = 1;
 const int P2_START = 1 << 1;
 const int P1_START = 1 << 2;
@@ -28,6 +37,11 @@ const int P1_SHOOT = 1 << 4;
 const int P1_LEFT = 1 << 5;
 const int P1_RIGHT = 1 << 6;
 
+// Player two's controls are on port 2, at the same bits as player one's on port 1
+const int P2_SHOOT = 1 << 4;
+const int P2_LEFT = 1 << 5;
+const int P2_RIGHT = 1 << 6;
+
 const int PORT0_INIT = 0b01110000;
 const int PORT1_INIT = 0b00010000;
 const int PORT2_INIT = 0;
@@ -36,44 +50,77 @@ const int PORT3_INIT = 0;
 const int RST_1_OPCODE = 0xCF;
 const int RST_2_OPCODE = 0xD7;
 
-class CPU : public QObject
+// Used until a flag liveness table is set, nothing is skipped
+extern const uint8_t NO_DEAD_FLAGS[MEMORY_SIZE];
+
+// A register pair that can be used as one 16 bit register or as its two halves
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+#define REGISTER_PAIR(pair, high, low) union { uint16_t pair; struct { uint8_t high; uint8_t low; }; }
+#else
+#define REGISTER_PAIR(pair, high, low) union { uint16_t pair; struct { uint8_t low; uint8_t high; }; }
+#endif
+
+// Registers, ports and RAM, everything except the instructions. The signals have to live
+// in a class that isn't a template for moc. Aligned so the hot fields at the start fill exactly
+// the first cache line, wherever the object is.
+class alignas(64) CPUBase : public QObject
 {
 Q_OBJECT
 signals:
     void writeOnPort3(int);
     void writeOnPort5(int);
 public:
-    FlagRegister conditionBits;
+    CPUBase();
 
-    CPU();
+    // Everything an instruction touches besides memory comes first, so it shares a cache line
+    // with the object header instead of sitting behind the 8 KB of RAM
     struct dataRegisters {
-        uint8_t A; // Accumulator
-        uint8_t B;
-        uint8_t C;
-        uint8_t D;
-        uint8_t E;
-        uint8_t H;
-        uint8_t L;
         uint16_t PC;
         uint16_t SP;
+        REGISTER_PAIR(BC, B, C);
+        REGISTER_PAIR(DE, D, E);
+        REGISTER_PAIR(HL, H, L);
+        uint8_t A; // Accumulator
     } registers;
 
-   bool interruptsEnabled;
+    FlagRegister conditionBits;
+    bool interruptsEnabled;
 
-   uint8_t input0;
-   uint8_t input1;
-   uint8_t input2;
-   uint8_t input3;
+   // ROM and RAM by the top address bit, so reads don't need a branch. The ROM is shared by all
+   // instances and never written, see Machine::loadRom().
+   const uint8_t* readPages[2];
 
-   uint8_t output2;
-   uint8_t output3;
-   uint8_t output4;
-   uint8_t output5;
-   uint8_t output6;
+   // XOR of memoryCellHash() over all of RAM, kept up to date by writeByte()
+   uint64_t memoryHash;
 
-   uint16_t shiftRegister;
+   // Flags the instruction at each address doesn't need to compute because the program
+   // overwrites them before reading, see flagliveness.h
+   const uint8_t* deadFlags;
 
-   uint8_t memory[MEMORY_SIZE];
+    // Only IN and OUT use these, they start the second cache line
+    uint16_t shiftRegister;
+
+    uint8_t input0;
+    uint8_t input1;
+    uint8_t input2;
+    uint8_t input3;
+
+    uint8_t output2;
+    uint8_t output3;
+    uint8_t output4;
+    uint8_t output5;
+    uint8_t output6;
+
+   uint8_t ram[RAM_SIZE];
+
+   void setRom(const uint8_t* rom);
+
+   // Every write to memory has to go through here. Writes to ROM are ignored like on the board.
+   void writeByte(uint16_t address, uint8_t value);
+   uint8_t readByte(uint16_t address) const;
+
+   // Has to be called after RAM was changed behind writeByte()'s back
+   void rehashMemory();
 
    uint8_t getHighBits(uint16_t);
    uint8_t getHighBits(uint8_t);
@@ -81,9 +128,32 @@ public:
    uint8_t getLowBits(uint8_t);
 
    uint16_t create16BitReg(uint8_t, uint8_t);
+   uint8_t getBit(uint8_t, uint8_t);
+
+   // The accumulator and the flags as the 16 bit word PUSH PSW and POP PSW move
+   uint16_t programStatusWord() const;
+   void setProgramStatusWord(uint16_t);
+};
+
+// The instructions, with the memory access, tracing and flag checking hooks picked at compile time.
+// See cpupolicy.h, in the release build the hooks compile away.
+template <class Policy>
+class BasicCPU : public CPUBase
+{
+public:
+   typename Policy::Memory memoryPolicy;
+   typename Policy::Trace tracePolicy;
+   typename Policy::Flags flagsPolicy;
+
+   // Instructions access memory only through these, opcode fetches included
+   uint8_t readMemory(uint16_t address) { return memoryPolicy.read(*this, address); }
+   void writeMemory(uint16_t address, uint8_t value) { memoryPolicy.write(*this, address, value); }
 
    int addBytes(uint8_t, uint8_t, bool, FlagRegister);
-   uint8_t getBit(uint8_t, uint8_t);
+   void logicFlags(uint8_t);
+
+   void push(uint16_t);
+   uint16_t pop();
 
    void shiftRegisterOp();
 
@@ -371,7 +441,7 @@ public:
    int IN();
    int OUT();
 
-   int DAD(uint8_t, uint8_t);
+   int DAD(uint16_t);
    int DAD_B();
    int DAD_D();
    int DAD_H();
@@ -392,4 +462,49 @@ public:
    int SPHL();
 };
 
+#if defined(CPU_PROFILE) && defined(WATCHPOINTS)
+#error "The profile and the watchpoints each need their own CPU policy"
+#endif
+
+#if defined(CPU_PROFILE)
+typedef ProfilePolicy CPUPolicy;
+#elif defined(WATCHPOINTS)
+typedef WatchPolicy CPUPolicy;
+#elif !defined(QT_NO_DEBUG)
+typedef DebugPolicy CPUPolicy;
+#else
+typedef ReleasePolicy CPUPolicy;
+#endif
+
+// The one the emulator runs, explicitly instantiated in cpu.cpp
+typedef BasicCPU<CPUPolicy> CPU;
+
+// The same instructions on a flat memory map, for CPU test programs, see cputest.h
+struct TestProgramPolicy
+{
+    typedef FlatMemory Memory;
+    typedef CPUPolicy::Trace Trace;
+    typedef CPUPolicy::Flags Flags;
+};
+
+typedef BasicCPU<TestProgramPolicy> TestCPU;
+
+// Inline, they are the hottest code in the emulator and the native core calls them from another file
+inline void CPUBase::writeByte(uint16_t address, uint8_t value)
+{
+    address &= ADDRESS_MASK;
+    if (address < RAM_START)
+        return;
+
+    uint8_t& cell = ram[address - RAM_START];
+    memoryHash ^= memoryCellHash(address, cell) ^ memoryCellHash(address, value);
+    cell = value;
+}
+
+inline uint8_t CPUBase::readByte(uint16_t address) const
+{
+    address &= ADDRESS_MASK;
+    return readPages[address >> 13][address & (ROM_SIZE - 1)];
+}
+
 #endif // CPU_H
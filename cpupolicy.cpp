@@ -0,0 +1,56 @@
+#include "cpupolicy.h"
+#include <algorithm>
+#include <QtGlobal>
+
+const int PROFILE_TOP_OPCODES = 16;
+
+void OpcodeProfile::print() const
+{
+    int opcodes[256];
+    uint64_t totalCycles = 0;
+    for (int i = 0; i < 256; ++i)
+    {
+        opcodes[i] = i;
+        totalCycles += cycles[i];
+    }
+
+    std::sort(opcodes, opcodes + 256, [this](int a, int b) { return cycles[a] > cycles[b]; });
+
+    qDebug("Opcode profile, %llu cycles:", (unsigned long long) totalCycles);
+    for (int i = 0; i < PROFILE_TOP_OPCODES && cycles[opcodes[i]] > 0; ++i)
+    {
+        int opcode = opcodes[i];
+        qDebug("  %02x %12llu executed %5.1f%% of cycles", opcode, (unsigned long long) executed[opcode],
+               100.0 * cycles[opcode] / totalCycles);
+    }
+}
+
+void CheckedFlags::add(uint8_t byte1, uint8_t byte2, uint8_t carry, FlagRegister flagsToCalc, FlagRegister result)
+{
+    unsigned sum = byte1 + byte2 + carry;
+    uint8_t value = sum;
+
+    uint8_t parity = value ^ (value >> 4);
+    parity ^= parity >> 2;
+    parity ^= parity >> 1;
+
+    uint8_t expected = 0;
+    if (value & 0x80)
+        expected |= SIGN_BIT;
+    if (value == 0)
+        expected |= ZERO_BIT;
+    if ((parity & 1) == 0)
+        expected |= PARITY_BIT;
+    if ((byte1 & 0x0F) + (byte2 & 0x0F) + carry > 0x0F)
+        expected |= AUX_BIT;
+    if (sum > 0xFF)
+        expected |= CARRY_BIT;
+
+    uint8_t checked = flagsToCalc.getRegister() & ~EMPTY_FLAG_REGISTER;
+    if ((result.getRegister() & checked) != (expected & checked))
+    {
+        ++mismatches;
+        qWarning("Flags %02x after %02x + %02x + %d, expected %02x", result.getRegister() & checked,
+                 byte1, byte2, carry, expected & checked);
+    }
+}
@@ -0,0 +1,146 @@
+#ifndef CPUPOLICY_H
+#define CPUPOLICY_H
+
+#include <stdint.h>
+#include "flagregister.h"
+#include "watchpoints.h"
+
+// Policies for BasicCPU. They are members of the CPU so they can keep state, and every hook is
+// inline so the empty ones cost nothing.
+
+// Memory: every read and write an instruction does, opcode fetches included, and the values
+// IN and OUT move
+struct DirectMemory
+{
+    template <class Cpu>
+    uint8_t read(Cpu& cpu, uint16_t address) { return cpu.readByte(address); }
+
+    template <class Cpu>
+    void write(Cpu& cpu, uint16_t address, uint8_t value) { cpu.writeByte(address, value); }
+
+    template <class Cpu>
+    void in(Cpu&, uint8_t, uint8_t) {}
+
+    template <class Cpu>
+    void out(Cpu&, uint8_t, uint8_t) {}
+};
+
+// Checks every access against the watchpoints, see watchpoints.h
+struct WatchedMemory
+{
+    Watchpoints watchpoints;
+
+    template <class Cpu>
+    uint8_t read(Cpu& cpu, uint16_t address)
+    {
+        uint8_t value = cpu.readByte(address);
+        watchpoints.read(address, value, cpu.registers.PC);
+        return value;
+    }
+
+    template <class Cpu>
+    void write(Cpu& cpu, uint16_t address, uint8_t value)
+    {
+        watchpoints.write(address, value, cpu.registers.PC);
+        cpu.writeByte(address, value);
+    }
+
+    template <class Cpu>
+    void in(Cpu& cpu, uint8_t port, uint8_t value) { watchpoints.portIn(port, value, cpu.registers.PC); }
+
+    template <class Cpu>
+    void out(Cpu& cpu, uint8_t port, uint8_t value) { watchpoints.portOut(port, value, cpu.registers.PC); }
+};
+
+// All 64 KB of the address space as RAM, for 8080 programs written for other machines. The
+// CPU's own ROM, RAM and memory hash aren't used.
+struct FlatMemory
+{
+    uint8_t memory[0x10000];
+
+    FlatMemory() : memory() {}
+
+    template <class Cpu>
+    uint8_t read(Cpu&, uint16_t address) { return memory[address]; }
+
+    template <class Cpu>
+    void write(Cpu&, uint16_t address, uint8_t value) { memory[address] = value; }
+
+    template <class Cpu>
+    void in(Cpu&, uint8_t, uint8_t) {}
+
+    template <class Cpu>
+    void out(Cpu&, uint8_t, uint8_t) {}
+};
+
+// Trace: called after each instruction with its opcode and the cycles it took
+struct NoTrace
+{
+    template <class Cpu>
+    void instruction(Cpu&, uint8_t, int) {}
+};
+
+// Counts executions and cycles per opcode
+struct OpcodeProfile
+{
+    uint64_t executed[256];
+    uint64_t cycles[256];
+
+    OpcodeProfile() : executed(), cycles() {}
+
+    template <class Cpu>
+    void instruction(Cpu&, uint8_t opcode, int instructionCycles)
+    {
+        ++executed[opcode];
+        cycles[opcode] += instructionCycles;
+    }
+
+    // Prints the opcodes that took the most cycles
+    void print() const;
+};
+
+// Flags: sees the operands and the flags of every addition the ALU does
+struct UncheckedFlags
+{
+    void add(uint8_t, uint8_t, uint8_t, FlagRegister, FlagRegister) {}
+};
+
+// Recomputes the flags independently of FlagRegister and warns when they differ
+struct CheckedFlags
+{
+    uint64_t mismatches;
+
+    CheckedFlags() : mismatches(0) {}
+
+    void add(uint8_t byte1, uint8_t byte2, uint8_t carry, FlagRegister flagsToCalc, FlagRegister result);
+};
+
+struct ReleasePolicy
+{
+    typedef DirectMemory Memory;
+    typedef NoTrace Trace;
+    typedef UncheckedFlags Flags;
+};
+
+struct DebugPolicy
+{
+    typedef DirectMemory Memory;
+    typedef NoTrace Trace;
+    typedef CheckedFlags Flags;
+};
+
+struct WatchPolicy
+{
+    typedef WatchedMemory Memory;
+    typedef NoTrace Trace;
+    typedef UncheckedFlags Flags;
+};
+
+struct ProfilePolicy
+{
+    typedef DirectMemory Memory;
+    typedef OpcodeProfile Trace;
+    typedef UncheckedFlags Flags;
+};
+
+#endif // CPUPOLICY_H
@@ -0,0 +1,122 @@
+#include "cputest.h"
+#include "cpu.h"
+#include <QFile>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QDebug>
+
+const uint16_t CPM_WARM_BOOT = 0x0000;
+const uint16_t CPM_BDOS_ENTRY = 0x0005;
+const uint16_t CPM_PROGRAM_START = 0x0100;
+
+// Where the jump at the BDOS entry leads, the programs put their stack below it
+const uint16_t CPM_BDOS_ADDRESS = 0xFE00;
+
+const int BDOS_SYSTEM_RESET = 0;
+const int BDOS_PRINT_CHARACTER = 2;
+const int BDOS_PRINT_STRING = 9;
+
+const uint8_t JMP_OPCODE = 0xC3;
+const uint8_t RET_OPCODE = 0xC9;
+
+// 8080EXM, the longest of them, takes about 24 billion cycles
+const uint64_t CPU_TEST_CYCLE_LIMIT = 100000000000ULL;
+
+static void print(char character, QTextStream& console, QByteArray& output)
+{
+    output += character;
+    console << character;
+}
+
+// Handles the call the program is about to make, the jump to the BDOS and its RET then run
+// normally. Returns false if the program asked to end.
+static bool callBdos(TestCPU& cpu, QTextStream& console, QByteArray& output)
+{
+    const uint8_t* memory = cpu.memoryPolicy.memory;
+    switch (cpu.registers.C)
+    {
+    case BDOS_SYSTEM_RESET:
+        return false;
+    case BDOS_PRINT_CHARACTER:
+        print(cpu.registers.E, console, output);
+        break;
+    case BDOS_PRINT_STRING:
+        for (uint16_t address = cpu.registers.DE; memory[address] != '$'; ++address)
+            print(memory[address], console, output);
+        break;
+    default:
+        qWarning("BDOS function %d is not supported.", cpu.registers.C);
+    }
+    console.flush();
+    return true;
+}
+
+static bool runCpuTest(const QString& fileName, QTextStream& console)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning("Could not open %s.", qPrintable(fileName));
+        return false;
+    }
+    QByteArray program = file.readAll();
+    if (program.size() > CPM_BDOS_ADDRESS - CPM_PROGRAM_START)
+    {
+        qWarning("%s doesn't fit below the BDOS.", qPrintable(fileName));
+        return false;
+    }
+
+    TestCPU cpu;
+    uint8_t* memory = cpu.memoryPolicy.memory;
+    memcpy(memory + CPM_PROGRAM_START, program.constData(), program.size());
+    memory[CPM_BDOS_ENTRY] = JMP_OPCODE;
+    memory[CPM_BDOS_ENTRY + 1] = CPM_BDOS_ADDRESS & 0xFF;
+    memory[CPM_BDOS_ENTRY + 2] = CPM_BDOS_ADDRESS >> 8;
+    memory[CPM_BDOS_ADDRESS] = RET_OPCODE;
+
+    cpu.registers.PC = CPM_PROGRAM_START;
+    cpu.registers.SP = CPM_BDOS_ADDRESS;
+
+    QByteArray output;
+    uint64_t cycles = 0;
+    bool finished = false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    while (!finished && cycles < CPU_TEST_CYCLE_LIMIT)
+    {
+        uint16_t pc = cpu.registers.PC;
+        if (pc == CPM_WARM_BOOT || (pc == CPM_BDOS_ENTRY && !callBdos(cpu, console, output)))
+            finished = true;
+        else
+            cycles += cpu.runNextInstruction();
+    }
+
+    double seconds = timer.nsecsElapsed() / 1e9;
+    console << endl;
+
+    // The programs print the result instead of returning it
+    QString text = QString(output).toUpper();
+    bool passed = finished && !text.contains("ERROR") && !text.contains("FAIL");
+    const char* result = passed ? "passed" : finished ? "failed" : "did not finish";
+
+    qDebug("%s %s after %llu cycles in %.2f s, %.1f MHz.", qPrintable(fileName), result,
+           (unsigned long long) cycles, seconds, cycles / seconds / 1e6);
+
+#ifdef CPU_PROFILE
+    cpu.tracePolicy.print();
+#endif
+
+    return passed;
+}
+
+bool runCpuTests(const QStringList& files)
+{
+    QTextStream console(stdout);
+
+    bool passed = true;
+    for (const QString& file : files)
+        passed = runCpuTest(file, console) && passed;
+    return passed;
+}
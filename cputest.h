@@ -0,0 +1,12 @@
+#ifndef CPUTEST_H
+#define CPUTEST_H
+
+#include <QStringList>
+
+// Runs CP/M test programs for the 8080, like cpudiag, 8080PRE or 8080EXM, one after the other
+// and prints what they print. A program is loaded at 0x100 into a flat 64 KB of RAM with just
+// enough of CP/M to print text, and ends when it jumps to 0. It fails if it prints an error
+// or doesn't finish. Returns true if all of them passed.
+bool runCpuTests(const QStringList& files);
+
+#endif // CPUTEST_H
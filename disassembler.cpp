@@ -0,0 +1,104 @@
+#include "disassembler.h"
+#include "opcodes.h"
+
+static const char* const REGISTERS[] = { "B", "C", "D", "E", "H", "L", "M", "A" };
+static const char* const PAIRS[] = { "B", "D", "H", "SP" };
+static const char* const STACK_PAIRS[] = { "B", "D", "H", "PSW" };
+static const char* const CONDITIONS[] = { "NZ", "Z", "NC", "C", "PO", "PE", "P", "M" };
+static const char* const ALU[] = { "ADD", "ADC", "SUB", "SBB", "ANA", "XRA", "ORA", "CMP" };
+static const char* const ALU_IMMEDIATE[] = { "ADI", "ACI", "SUI", "SBI", "ANI", "XRI", "ORI", "CPI" };
+static const char* const ACCUMULATOR[] = { "RLC", "RRC", "RAL", "RAR", "DAA", "CMA", "STC", "CMC" };
+
+static QString hex(int value, int digits)
+{
+    return QString("%1").arg(value, digits, 16, QChar('0')).toUpper();
+}
+
+QString disassemble(const uint8_t* bytes)
+{
+    uint8_t opcode = bytes[0];
+    QString byte = hex(bytes[1], 2);
+    QString word = hex(bytes[1] | (bytes[2] << 8), 4);
+
+    int x = opcode >> 6;
+    int y = (opcode >> 3) & 7;
+    int z = opcode & 7;
+    int p = y >> 1;
+
+    if (instructionKind(opcode) == INSTRUCTION_UNSUPPORTED && opcode != 0x76)
+        return "DB " + hex(opcode, 2);
+
+    if (x == 1)
+        return opcode == 0x76 ? QString("HLT") : QString("MOV %1,%2").arg(REGISTERS[y], REGISTERS[z]);
+    if (x == 2)
+        return QString("%1 %2").arg(ALU[y], REGISTERS[z]);
+
+    if (x == 0)
+    {
+        switch (z)
+        {
+        case 0:
+            return "NOP";
+        case 1:
+            return y & 1 ? QString("DAD %1").arg(PAIRS[p]) : QString("LXI %1,%2").arg(PAIRS[p], word);
+        case 2:
+        {
+            const char* const MEMORY[] = { "STAX B", "LDAX B", "STAX D", "LDAX D", "SHLD", "LHLD", "STA", "LDA" };
+            return y < 4 ? QString(MEMORY[y]) : QString("%1 %2").arg(MEMORY[y], word);
+        }
+        case 3:
+            return QString(y & 1 ? "DCX %1" : "INX %1").arg(PAIRS[p]);
+        case 4:
+            return QString("INR %1").arg(REGISTERS[y]);
+        case 5:
+            return QString("DCR %1").arg(REGISTERS[y]);
+        case 6:
+            return QString("MVI %1,%2").arg(REGISTERS[y], byte);
+        default:
+            return ACCUMULATOR[y];
+        }
+    }
+
+    switch (z)
+    {
+    case 0:
+        return QString("R%1").arg(CONDITIONS[y]);
+    case 1:
+    {
+        const char* const OTHERS[] = { "RET", "RET", "PCHL", "SPHL" };
+        return y & 1 ? QString(OTHERS[p]) : QString("POP %1").arg(STACK_PAIRS[p]);
+    }
+    case 2:
+        return QString("J%1 %2").arg(CONDITIONS[y], word);
+    case 3:
+    {
+        const char* const OTHERS[] = { "XTHL", "XCHG", "DI", "EI" };
+        if (y == 0)
+            return QString("JMP %1").arg(word);
+        if (y == 2 || y == 3)
+            return QString(y == 2 ? "OUT %1" : "IN %1").arg(byte);
+        return OTHERS[y - 4];
+    }
+    case 4:
+        return QString("C%1 %2").arg(CONDITIONS[y], word);
+    case 5:
+        return y & 1 ? QString("CALL %1").arg(word) : QString("PUSH %1").arg(STACK_PAIRS[p]);
+    case 6:
+        return QString("%1 %2").arg(ALU_IMMEDIATE[y], byte);
+    default:
+        return QString("RST %1").arg(y);
+    }
+}
+
+QString disassemble(const CPUBase& cpu, uint16_t address)
+{
+    uint8_t bytes[3];
+    for (int i = 0; i < 3; ++i)
+        bytes[i] = cpu.readByte(address + i);
+
+    QString code;
+    for (int i = 0; i < instructionLength(bytes[0]); ++i)
+        code += hex(bytes[i], 2) + " ";
+
+    return QString("%1  %2 %3").arg(hex(address, 4)).arg(code, -9).arg(disassemble(bytes));
+}
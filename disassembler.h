@@ -0,0 +1,14 @@
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+
+#include <stdint.h>
+#include <QString>
+#include "cpu.h"
+
+// Intel mnemonics, like "MVI A,20" or "JNZ 1A32". Operands are in hex without a suffix.
+QString disassemble(const uint8_t* bytes);
+
+// The instruction at address with its address and bytes in front, as in "1A32  1A        LDAX D"
+QString disassemble(const CPUBase& cpu, uint16_t address);
+
+#endif // DISASSEMBLER_H
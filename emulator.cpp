@@ -2,11 +2,16 @@
 #include <QFile>
 #include <QTextStream>
 #include <QColor>
+#include <QElapsedTimer>
 #include <QDebug>
 
 QTextStream out(stdout);
 
-Emulator::Emulator()
+// Further behind than this the throttle gives up on the frames it missed
+const qint64 MAX_FRAME_LAG_NSECS = 1000000000LL;
+
+Emulator::Emulator(const Options& options)
+    : options(options), rewindBuffer(0), speculating(false), capture(0), netplay(0), netplayLink(0), gdb(0), metricsExporter(0), pendingInput1(PORT1_INIT), rewinding(false)
 {
     originalScreen = QImage(SCREEN_WIDTH_PIXELS, SCREEN_HEIGHT_PIXELS, QImage::Format_RGB32);
 
@@ -14,17 +19,44 @@ Emulator::Emulator()
     transformation.rotate(-90);
     transformation.scale(SCREEN_SCALE_FACTOR, SCREEN_SCALE_FACTOR);
 
-    connect(&cpu, SIGNAL(writeOnPort3(int)), this, SLOT(playSoundPort3(int)));
-    connect(&cpu, SIGNAL(writeOnPort5(int)), this, SLOT(playSoundPort5(int)));
+    // The sound ports are handled directly on the emulation thread, a queued
+    // connection would delay every sound until the GUI thread gets around to it
+    connect(&machine.cpu, SIGNAL(writeOnPort3(int)), this, SLOT(playSoundPort3(int)), Qt::DirectConnection);
+    connect(&machine.cpu, SIGNAL(writeOnPort5(int)), this, SLOT(playSoundPort5(int)), Qt::DirectConnection);
+
+    sound = new SoundSystem(createAudioSink(options.audioSink, options.audioFile), options.audioLatency);
+    sound->start(QThread::TimeCriticalPriority);
+
+    // Rewinding changes the past, which neither a movie nor the peer can follow
+    bool netplayEnabled = !options.netplayPeerAddress.isEmpty();
+    if (options.rewindSeconds > 0 && (!options.recordFile.isEmpty() || netplayEnabled))
+        qWarning("Rewinding is disabled while recording a movie or playing over the network.");
+    else if (options.rewindSeconds > 0)
+        rewindBuffer = new RewindBuffer(options.rewindSeconds * FRAME_RATE, options.rewindSeconds * REWIND_BYTES_PER_SECOND);
+}
+
+Emulator::~Emulator()
+{
+    requestInterruption();
+    wait();
+
+    sound->requestInterruption();
+    sound->wait();
+    sound->printLatencyReport();
+    delete sound;
+    delete rewindBuffer;
 }
 
 void Emulator::VRAMtoScreen()
 {
+    TraceScope trace("Render");
+    qint64 start = metrics.now();
+
     for (int i = 0; i < SCREEN_HEIGHT_PIXELS; ++i)
     {
         for (int j = 0; j < SCREEN_WIDTH_BYTES; ++j)
         {
-            uint8_t currentByte = cpu.memory[VIDEO_RAM_START + i * SCREEN_WIDTH_BYTES + j];
+            uint8_t currentByte = machine.videoRam()[i * SCREEN_WIDTH_BYTES + j];
 
             for (int k = 0; k < 8; ++k)
             {
@@ -43,7 +75,13 @@ void Emulator::VRAMtoScreen()
         }
     }
 
+    qint64 drawn = metrics.now();
+    metrics.record(STAGE_VRAM_TO_SCREEN, drawn - start);
+
     transformedScreen = originalScreen.transformed(transformation);
+    metrics.record(STAGE_TRANSFORM, metrics.now() - drawn);
+
+    metrics.screenEmitted();
     emit screenUpdated(&transformedScreen);
 }
 
@@ -63,6 +101,12 @@ QColor Emulator::chooseColor(int y)
 
 void Emulator::inputHandler(const int key, bool pressed)
 {
+    if (key == Qt::Key_Backspace)
+    {
+        rewinding.store(pressed);
+        return;
+    }
+
     uint8_t bitmask = 0;
     if (key == Qt::Key_Left)
         bitmask = P1_LEFT;
@@ -75,60 +119,222 @@ void Emulator::inputHandler(const int key, bool pressed)
     else if (key == Qt::Key_C)
         bitmask = COIN;
 
+    // Only this thread writes the pending inputs, the emulation thread just reads them
     if (pressed)
-        cpu.input1 |= bitmask;
+        pendingInput1.store(pendingInput1.load() | bitmask);
     else
-        cpu.input1 &= bitmask ^ 0xFF;
+        pendingInput1.store(pendingInput1.load() & (bitmask ^ 0xFF));
 }
 
 void Emulator::playSoundPort3(int port3)
 {
-    return; // Not implemented yet
+    // Speculative frames are thrown away, so they must not be heard either
+    if (!speculating && !(netplay && netplay->isResimulating()))
+        sound->port3Written(port3);
 }
 
 void Emulator::playSoundPort5(int port5)
 {
-    return; // Not implemented yet
+    if (!speculating && !(netplay && netplay->isResimulating()))
+        sound->port5Written(port5);
+}
+
+// Hands the machine's screen to everything that shows or keeps it. Headless builds only
+// have the shared memory and the capture file.
+void Emulator::showFrame()
+{
+    publisher.publish(machine);
+    if (capture)
+        capture->submit(machine.frame, machine.videoRam());
+#ifndef HEADLESS
+    VRAMtoScreen();
+#endif
+}
+
+// The ROM only reads the inputs once per frame and draws the result on a later
+// one, so what is on screen lags behind the player. Running a few frames ahead
+// with the current inputs, showing that and then going back hides the lag.
+// Returns the time spent emulating the speculative frames.
+qint64 Emulator::runAhead()
+{
+    TraceScope trace("Run ahead");
+    qint64 start = metrics.now();
+    machine.saveSnapshot(runAheadSnapshot);
+    uint64_t interruptsDelivered = machine.interruptsDelivered;
+    uint64_t interruptsRetried = machine.interruptsRetried;
+    speculating = true;
+
+    for (int i = 0; i < options.runAheadFrames; ++i)
+        machine.runFrame();
+    qint64 emulated = metrics.now() - start;
+    showFrame();
+
+    speculating = false;
+    machine.loadSnapshot(runAheadSnapshot);
+    machine.interruptsDelivered = interruptsDelivered;
+    machine.interruptsRetried = interruptsRetried;
+    return emulated;
 }
 
 void Emulator::run()
 {
-    QFile romFile(ROM_FILE_PATH);
+    setTraceThreadName("Emulation");
+    machine.loadRom();
+    out << "Opened " + QString(ROM_FILE_PATH) << endl;
 
-    if (!romFile.open(QIODevice::ReadOnly))
-        qFatal("Could not open rom file.");
-    else
-       out << "Opened " + QString(ROM_FILE_PATH) << endl;
+    if (options.interpret)
+        machine.setNativeCore(false);
+    if (options.noFusion)
+        machine.setFusion(false);
+    if (options.noHle)
+        machine.setHle(false);
 
-    QByteArray fileData = romFile.readAll();
-    Q_ASSERT(fileData.size() == ROM_SIZE);
+    // Speculative and resimulated frames would stop at the watchpoints too
+    if (!options.watchList.isEmpty() && !options.netplayPeerAddress.isEmpty())
+        qWarning("Watchpoints can't be used during netplay.");
+    else if (!options.watchList.isEmpty() && setWatchpoints(machine, options.watchList))
+    {
+        if (options.runAheadFrames > 0)
+            qWarning("Run-ahead is disabled while watching.");
+        options.runAheadFrames = 0;
+    }
 
-    for (int i = ROM_START; i < ROM_SIZE; ++i)
-        cpu.memory[i] = fileData.at(i);
+    // The socket has to be created on the thread that uses it
+    if (!options.netplayPeerAddress.isEmpty())
+    {
+        netplayLink = new NetplayLink(options.netplayDelay, options.netplayLoss);
+        if (netplayLink->open(options.netplayLocalPort, QHostAddress(options.netplayPeerAddress), options.netplayPeerPort))
+            netplay = new RollbackSession(machine, options.netplayPlayer);
+    }
 
-    int cyclesTillEvent = INTERRUPT_FREQ;
-    bool vblank = true;
-    while (true)
+    // The peer can't wait while the game is halted in the debugger
+    if (options.gdbPort && netplay)
+        qWarning("GDB can't attach during netplay.");
+    // What GDB writes to memory and registers isn't an input, the movie wouldn't replay
+    else if (options.gdbPort && !options.recordFile.isEmpty())
+        qWarning("GDB can't attach while a movie is recorded.");
+    else if (options.gdbPort)
     {
-        int cycles = cpu.runNextInstruction();
-        cyclesTillEvent -= cycles;
+        gdb = new GdbStub(options.gdbPort);
+        gdb->start();
+    }
 
-        if (cyclesTillEvent <= 0)
+    // Inputs of a netplay game are only final once the peer has confirmed them
+    if (!options.recordFile.isEmpty() && netplay)
+        qWarning("Movies can't be recorded during netplay.");
+    else if (!options.recordFile.isEmpty())
+        movie.open(options.recordFile);
+    if (!options.sharedMemoryName.isEmpty())
+        publisher.open(options.sharedMemoryName);
+
+    if (!options.captureFile.isEmpty())
+    {
+        capture = new VideoCapture();
+        if (!capture->open(options.captureFile))
         {
-            bool interruptSuccess;
-            if (vblank)
-                interruptSuccess = cpu.generateInterrupt(RST_1_OPCODE);
-            else
-            {
-                interruptSuccess = cpu.generateInterrupt(RST_2_OPCODE);
-                VRAMtoScreen();
-            }
+            delete capture;
+            capture = 0;
+        }
+    }
+
+    if (options.metricsPort || !options.metricsFile.isEmpty())
+    {
+        metricsExporter = new MetricsExporter(metrics, options.metricsPort, options.metricsFile);
+        metricsExporter->start();
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+
+    // Frames shown on screen, machine.frame goes backwards while rewinding
+    uint64_t framesShown = 0;
 
-            if (interruptSuccess)
+    while (!isInterruptionRequested() && (options.frames == 0 || machine.frame < (uint64_t) options.frames))
+    {
+        traceBegin("Frame");
+        qint64 frameStart = metrics.now();
+        uint64_t cyclesBefore = machine.cycles;
+
+        if (rewindBuffer && rewinding.load())
+        {
+            // Once the history runs out the oldest frame just stays on screen
+            rewindBuffer->rewind(machine);
+        }
+        else if (netplay)
+        {
+            // While the peer is too far behind the frame doesn't advance and the screen stays the same
+            netplayLink->receiveInputs(*netplay);
+            netplay->setLocalInput(pendingInput1.load());
+            netplay->advance();
+            netplayLink->sendInputs(*netplay);
+        }
+        else
+        {
+            if (rewindBuffer)
+                rewindBuffer->push(machine);
+
+            movie.recordKeyframe(machine);
+
+            // Inputs only change on frame boundaries so that a recorded movie replays exactly
+            uint8_t input1 = pendingInput1.load();
+            if (input1 != machine.cpu.input1)
+                traceInstant("Input latched", input1);
+            machine.cpu.input1 = input1;
+            movie.recordInputs(machine.frame, machine.cpu.input1, machine.cpu.input2);
+
+            if (gdb && gdb->wantsControl())
+                gdb->runFrame(machine);
+            else if (!runFrameWatched(machine))
+                break;
+            movie.recordFrame(machine.videoHash());
+        }
+
+        qint64 emulationNsecs = metrics.now() - frameStart;
+
+        // Rewinding and a netplay peer that is too far behind don't move the game forward
+        if (machine.cycles > cyclesBefore)
+            metrics.frameEmulated(machine.cycles - cyclesBefore, machine.interruptsDelivered, machine.interruptsRetried);
+
+        ++framesShown;
+
+        if (options.runAheadFrames > 0 && !(rewindBuffer && rewinding.load()))
+            emulationNsecs += runAhead();
+        else
+            showFrame();
+        metrics.record(STAGE_EMULATION, emulationNsecs);
+        traceEnd("Frame");
+
+        if (!options.unthrottled)
+        {
+            qint64 frameDeadline = framesShown * 1000000000LL / FRAME_RATE;
+            qint64 timeLeft = frameDeadline - clock.nsecsElapsed();
+            if (timeLeft > 0)
+                usleep(timeLeft / 1000);
+
+            // After a pause in the debugger go on at the normal speed instead of catching up
+            if (timeLeft < -MAX_FRAME_LAG_NSECS)
             {
-                vblank = !vblank;
-                cyclesTillEvent = INTERRUPT_FREQ;
+                clock.restart();
+                framesShown = 0;
             }
         }
     }
+
+    movie.close();
+    publisher.close();
+
+#ifdef CPU_PROFILE
+    machine.cpu.tracePolicy.print();
+#endif
+
+    delete capture;
+    capture = 0;
+    delete gdb;
+    gdb = 0;
+    delete metricsExporter;
+    metricsExporter = 0;
+    delete netplay;
+    delete netplayLink;
+    netplay = 0;
+    netplayLink = 0;
 }
@@ -2,32 +2,21 @@
 #define EMULATOR_H
 
 #include <stdint.h>
-#include <QBitmap>
-#include <QWidget>
+#include <QImage>
+#include <QTransform>
 #include <QDebug>
 #include <QThread>
-#include "cpu.h"
-
-#define ROM_FILE_PATH ":/roms/invaders"
-
-// Sound files
-#define INVADER_1_SFX ":sfx/fastinvader1"
-#define INVADER_2_SFX ":sfx/fastinvader2"
-#define INVADER_3_SFX ":sfx/fastinvader3"
-#define INVADER_4_SFX ":sfx/fastinvader4"
-#define INVADER_DIES_SFX ":sfx/invaderkilled"
-
-#define PLAYER_SHOOTING_SFX ":sfx/shoot"
-#define PLAYER_DIES_SFX ":sfx/explosion"
-
-#define UFO_SFX ":sfx/ufo_highpitch"
-#define UFO_DIES_SFX ":sfx/ufo_lowpitch"
-
-const int SCREEN_WIDTH_BYTES = 32;
-const int SCREEN_HEIGHT_BYTES = 28;
-
-const int SCREEN_WIDTH_PIXELS = 256;
-const int SCREEN_HEIGHT_PIXELS = 224;
+#include <atomic>
+#include "capture.h"
+#include "framepublisher.h"
+#include "gdbstub.h"
+#include "machine.h"
+#include "metrics.h"
+#include "movie.h"
+#include "netplay.h"
+#include "options.h"
+#include "rewind.h"
+#include "sound.h"
 
 const int SCREEN_SCALE_FACTOR = 3;
 
@@ -36,21 +25,49 @@ const int UPPER_MIDDLE_SCREEN = 192;
 const int MIDDLE_SCREEN = 72;
 const int LOWER_MIDDLE_SCREEN = 16;
 
-const int INTERRUPT_FREQ = 1000000;
-
 class Emulator : public QThread
 {
 Q_OBJECT
 public:
-    explicit Emulator();
+    explicit Emulator(const Options&);
+    ~Emulator();
+
+    // The GUI thread records how long it takes to show the screen
+    FrameMetrics& frameMetrics() { return metrics; }
 
 private:
-    CPU cpu;
+    Machine machine;
+    Options options;
+    SoundSystem* sound;
+    MovieRecorder movie;
+    FramePublisher publisher;
+    RewindBuffer* rewindBuffer; // Null when rewinding is disabled
+
+    // The real machine is parked here while the speculative frames run
+    MachineSnapshot runAheadSnapshot;
+    bool speculating;
+
+    VideoCapture* capture; // Only exists while capturing
+
+    // Both only exist while a netplay game runs
+    RollbackSession* netplay;
+    NetplayLink* netplayLink;
+
+    GdbStub* gdb; // Only exists with --gdb
+
+    FrameMetrics metrics;
+    MetricsExporter* metricsExporter; // Only exists with --metrics-port or --metrics-file
+
+    // Written by the GUI thread, latched into the machine at the start of every frame
+    std::atomic<uint8_t> pendingInput1;
+    std::atomic<bool> rewinding;
 
     QImage originalScreen;
     QImage transformedScreen;
     QTransform transformation;
 
+    void showFrame();
+    qint64 runAhead();
     void VRAMtoScreen();
     QColor chooseColor(int);
 
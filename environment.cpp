@@ -0,0 +1,250 @@
+#include "environment.h"
+#include <QtConcurrent>
+#include <cstring>
+
+const uint8_t ACTION_INPUTS[NUM_ACTIONS] = {
+    0,
+    P1_SHOOT,
+    P1_LEFT,
+    P1_RIGHT,
+    P1_LEFT | P1_SHOOT,
+    P1_RIGHT | P1_SHOOT
+};
+
+// The bits of port 1 the agent doesn't control
+const uint8_t IDLE_INPUT1 = PORT1_INIT & ~(P1_SHOOT | P1_LEFT | P1_RIGHT);
+
+Environment::Environment(ObservationType type)
+    : machine(new Machine()), observationType(type), renderedScreen(0), downsampledWidth(0), downsampledHeight(0),
+      frameStack(0), lastScore(0), gameStarted(false), gameStartSaved(false)
+{
+    // Everything works before the first reset(), the game just hasn't started yet
+    machine->loadRom();
+    machine->saveSnapshot(powerOn);
+
+    if (observationType == OBSERVATION_RENDERED)
+        renderedScreen = new uint8_t[OBSERVATION_WIDTH * OBSERVATION_HEIGHT];
+    else if (observationType == OBSERVATION_DOWNSAMPLED)
+        setDownsampling(84, 84, 1);
+}
+
+Environment::~Environment()
+{
+    delete machine;
+    delete[] renderedScreen;
+    delete frameStack;
+}
+
+void Environment::setDownsampling(int width, int height, int stackDepth)
+{
+    downsampledWidth = qBound(1, width, OBSERVATION_WIDTH);
+    downsampledHeight = qBound(1, height, OBSERVATION_HEIGHT);
+
+    delete frameStack;
+    frameStack = new FrameStack(downsampledWidth * downsampledHeight, qMax(stackDepth, 1));
+}
+
+// Getting to the start of a game is the same every time, so it is only played once and
+// later episodes start from a snapshot. The machine and its video RAM stay where they are.
+const uint8_t* Environment::reset()
+{
+    if (gameStartSaved)
+        machine->loadSnapshot(gameStart);
+    else
+        startGame();
+
+    lastScore = score();
+
+    if (observationType == OBSERVATION_DOWNSAMPLED)
+    {
+        // Start the episode with the stack full of the first frame
+        downsample();
+        frameStack->fill();
+    }
+
+    return observation();
+}
+
+void Environment::startGame()
+{
+    machine->loadSnapshot(powerOn);
+
+    // Insert a coin and press start, then wait for the game to begin
+    runFrames(60, IDLE_INPUT1);
+    runFrames(5, IDLE_INPUT1 | COIN);
+    runFrames(60, IDLE_INPUT1);
+    runFrames(5, IDLE_INPUT1 | P1_START);
+
+    int framesLeft = RESET_TIMEOUT_FRAMES;
+    while (readRam(RAM_GAME_MODE) == 0 && framesLeft-- > 0)
+        runFrames(1, IDLE_INPUT1);
+
+    gameStarted = readRam(RAM_GAME_MODE) != 0;
+    if (!gameStarted)
+    {
+        qWarning("Game did not start within %d frames.", RESET_TIMEOUT_FRAMES);
+        return;
+    }
+
+    machine->saveSnapshot(gameStart);
+    gameStartSaved = true;
+}
+
+StepResult Environment::step(int action, int frameskip)
+{
+    if (action < 0 || action >= NUM_ACTIONS)
+        action = ACTION_NOOP;
+
+    StepResult result;
+    result.reward = 0;
+    result.done = false;
+
+    for (int i = 0; i < frameskip && !result.done; ++i)
+    {
+        runFrames(1, IDLE_INPUT1 | ACTION_INPUTS[action]);
+
+        int currentScore = score();
+        result.reward += currentScore - lastScore;
+        lastScore = currentScore;
+        result.done = isDone();
+    }
+
+    if (observationType == OBSERVATION_DOWNSAMPLED)
+        downsample();
+
+    result.observation = observation();
+    return result;
+}
+
+const uint8_t* Environment::observation()
+{
+    if (observationType == OBSERVATION_VRAM)
+        return machine->videoRam();
+    if (observationType == OBSERVATION_DOWNSAMPLED)
+        return frameStack->frames();
+
+    render();
+    return renderedScreen;
+}
+
+int Environment::observationSize() const
+{
+    if (observationType == OBSERVATION_VRAM)
+        return VIDEO_RAM_SIZE;
+    if (observationType == OBSERVATION_DOWNSAMPLED)
+        return frameStack->size();
+    return OBSERVATION_WIDTH * OBSERVATION_HEIGHT;
+}
+
+int Environment::score() const
+{
+    uint8_t low = readRam(RAM_P1_SCORE_LOW);
+    uint8_t high = readRam(RAM_P1_SCORE_HIGH);
+    return (high >> 4) * 1000 + (high & 0x0F) * 100 + (low >> 4) * 10 + (low & 0x0F);
+}
+
+int Environment::lives() const
+{
+    return readRam(RAM_P1_SHIPS);
+}
+
+bool Environment::isDone() const
+{
+    return gameStarted && readRam(RAM_GAME_MODE) == 0;
+}
+
+void Environment::runFrames(int count, uint8_t input1)
+{
+    machine->cpu.input1 = input1;
+    for (int i = 0; i < count; ++i)
+        machine->runFrame();
+}
+
+uint8_t Environment::readRam(int address) const
+{
+    return machine->cpu.readByte(address);
+}
+
+void Environment::render()
+{
+    // Video RAM is stored column by column with the bottom of the screen first
+    const uint8_t* vram = machine->videoRam();
+    for (int x = 0; x < OBSERVATION_WIDTH; ++x)
+    {
+        for (int byte = 0; byte < SCREEN_WIDTH_BYTES; ++byte)
+        {
+            uint8_t pixels = vram[x * SCREEN_WIDTH_BYTES + byte];
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                int y = OBSERVATION_HEIGHT - 1 - (byte * 8 + bit);
+                renderedScreen[y * OBSERVATION_WIDTH + x] = (pixels >> bit & 1) ? 255 : 0;
+            }
+        }
+    }
+}
+
+void Environment::downsample()
+{
+    if (downsampledWidth == OBSERVATION_WIDTH / 2 && downsampledHeight == OBSERVATION_HEIGHT / 2)
+        downsampleScreenHalf(machine->videoRam(), frameStack->nextFrame());
+    else
+        downsampleScreen(machine->videoRam(), frameStack->nextFrame(), downsampledWidth, downsampledHeight);
+    frameStack->push();
+}
+
+VectorEnvironment::VectorEnvironment(int count, ObservationType type, bool parallel) : parallel(parallel)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        environments.append(new Environment(type));
+        indices.append(i);
+    }
+}
+
+VectorEnvironment::~VectorEnvironment()
+{
+    qDeleteAll(environments);
+}
+
+void VectorEnvironment::reset()
+{
+    if (parallel)
+        QtConcurrent::blockingMap(environments, [](Environment* environment) { environment->reset(); });
+    else
+        for (Environment* environment : environments)
+            environment->reset();
+}
+
+void VectorEnvironment::setDownsampling(int width, int height, int stackDepth)
+{
+    for (Environment* environment : environments)
+        environment->setDownsampling(width, height, stackDepth);
+}
+
+void VectorEnvironment::step(const int* actions, int frameskip, float* rewards, uint8_t* dones)
+{
+    auto stepOne = [&](int index) {
+        Environment* environment = environments[index];
+        StepResult result = environment->step(actions[index], frameskip);
+        rewards[index] = result.reward;
+        dones[index] = result.done;
+        if (result.done)
+            environment->reset();
+    };
+
+    if (parallel)
+        QtConcurrent::blockingMap(indices, stepOne);
+    else
+        for (int index : indices)
+            stepOne(index);
+}
+
+int VectorEnvironment::size() const
+{
+    return environments.size();
+}
+
+Environment* VectorEnvironment::at(int index)
+{
+    return environments[index];
+}
@@ -0,0 +1,117 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include <stdint.h>
+#include <QVector>
+#include "machine.h"
+#include "observation.h"
+
+// Work RAM locations, see the code walkthrough linked in the README
+const int RAM_GAME_MODE = 0x20EF;     // 1 while a game is being played
+const int RAM_P1_SCORE_LOW = 0x20F8;  // BCD
+const int RAM_P1_SCORE_HIGH = 0x20F9; // BCD
+const int RAM_P1_SHIPS = 0x21FF;
+
+// The rendered observation is the screen the way the player sees it, rotated upright
+const int OBSERVATION_WIDTH = 224;
+const int OBSERVATION_HEIGHT = 256;
+
+const int RESET_TIMEOUT_FRAMES = 1000;
+
+enum Action
+{
+    ACTION_NOOP,
+    ACTION_FIRE,
+    ACTION_LEFT,
+    ACTION_RIGHT,
+    ACTION_LEFT_FIRE,
+    ACTION_RIGHT_FIRE,
+    NUM_ACTIONS
+};
+
+enum ObservationType
+{
+    OBSERVATION_VRAM,    // The 1bpp video RAM itself, VIDEO_RAM_SIZE bytes
+    OBSERVATION_RENDERED, // OBSERVATION_WIDTH x OBSERVATION_HEIGHT bytes, 0 or 255
+    OBSERVATION_DOWNSAMPLED // A stack of small greyscale frames, see setDownsampling()
+};
+
+struct StepResult
+{
+    const uint8_t* observation;
+    float reward;
+    bool done;
+};
+
+// A reinforcement learning environment around a headless machine. Rewards are
+// the increase of player 1's score and an episode ends when the game is over.
+class Environment
+{
+public:
+    explicit Environment(ObservationType type = OBSERVATION_VRAM);
+    ~Environment();
+
+    const uint8_t* reset();
+    StepResult step(int action, int frameskip);
+
+    // Points into the machine or a buffer owned by the environment and stays
+    // valid until the next call to reset() or step(). The video RAM of
+    // OBSERVATION_VRAM stays at the same address for the life of the environment.
+    const uint8_t* observation();
+    int observationSize() const;
+
+    // Used by OBSERVATION_DOWNSAMPLED, 84x84 without stacking by default
+    void setDownsampling(int width, int height, int stackDepth);
+
+    int score() const;
+    int lives() const;
+    bool isDone() const;
+
+    Machine* machine;
+
+private:
+    ObservationType observationType;
+    uint8_t* renderedScreen;
+
+    int downsampledWidth;
+    int downsampledHeight;
+    FrameStack* frameStack;
+
+    int lastScore;
+    bool gameStarted;
+
+    MachineSnapshot powerOn;
+    MachineSnapshot gameStart; // Saved by the first reset() that got the game going
+    bool gameStartSaved;
+
+    void startGame();
+    void runFrames(int count, uint8_t input1);
+    uint8_t readRam(int address) const;
+    void render();
+    void downsample();
+};
+
+// Many environments stepped together, optionally spread over a thread pool
+class VectorEnvironment
+{
+public:
+    VectorEnvironment(int count, ObservationType type = OBSERVATION_VRAM, bool parallel = true);
+    ~VectorEnvironment();
+
+    void reset();
+    void setDownsampling(int width, int height, int stackDepth);
+
+    // Environments that finish are reset right away, their done flag is still
+    // reported but the observation is the first one of the new episode
+    void step(const int* actions, int frameskip, float* rewards, uint8_t* dones);
+
+    int size() const;
+    Environment* at(int index);
+
+private:
+    QVector<Environment*> environments;
+    QVector<int> indices;
+    bool parallel;
+};
+
+#endif // ENVIRONMENT_H
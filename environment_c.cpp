@@ -0,0 +1,105 @@
+#include "environment_c.h"
+#include "environment.h"
+
+// The opaque C handles are the C++ objects themselves
+struct si_env : public Environment
+{
+    explicit si_env(ObservationType type) : Environment(type) {}
+};
+
+struct si_vec_env : public VectorEnvironment
+{
+    si_vec_env(int count, ObservationType type, bool parallel) : VectorEnvironment(count, type, parallel) {}
+};
+
+static ObservationType toObservationType(int observation_type)
+{
+    if (observation_type == OBSERVATION_RENDERED || observation_type == OBSERVATION_DOWNSAMPLED)
+        return (ObservationType) observation_type;
+    return OBSERVATION_VRAM;
+}
+
+si_env* si_env_create(int observation_type)
+{
+    return new si_env(toObservationType(observation_type));
+}
+
+void si_env_destroy(si_env* env)
+{
+    delete env;
+}
+
+void si_env_set_downsampling(si_env* env, int width, int height, int stack_depth)
+{
+    env->setDownsampling(width, height, stack_depth);
+}
+
+int si_env_num_actions(void)
+{
+    return NUM_ACTIONS;
+}
+
+int si_env_observation_size(si_env* env)
+{
+    return env->observationSize();
+}
+
+const uint8_t* si_env_reset(si_env* env)
+{
+    return env->reset();
+}
+
+const uint8_t* si_env_step(si_env* env, int action, int frameskip, float* reward, int* done)
+{
+    StepResult result = env->step(action, frameskip);
+    if (reward)
+        *reward = result.reward;
+    if (done)
+        *done = result.done;
+    return result.observation;
+}
+
+int si_env_score(si_env* env)
+{
+    return env->score();
+}
+
+int si_env_lives(si_env* env)
+{
+    return env->lives();
+}
+
+uint64_t si_env_state_hash(si_env* env)
+{
+    return env->machine->stateHash();
+}
+
+si_vec_env* si_vec_env_create(int count, int observation_type, int parallel)
+{
+    return new si_vec_env(count, toObservationType(observation_type), parallel != 0);
+}
+
+void si_vec_env_destroy(si_vec_env* env)
+{
+    delete env;
+}
+
+void si_vec_env_set_downsampling(si_vec_env* env, int width, int height, int stack_depth)
+{
+    env->setDownsampling(width, height, stack_depth);
+}
+
+void si_vec_env_reset(si_vec_env* env)
+{
+    env->reset();
+}
+
+void si_vec_env_step(si_vec_env* env, const int* actions, int frameskip, float* rewards, uint8_t* dones)
+{
+    env->step(actions, frameskip, rewards, dones);
+}
+
+const uint8_t* si_vec_env_observation(si_vec_env* env, int index)
+{
+    return env->at(index)->observation();
+}
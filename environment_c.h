@@ -0,0 +1,57 @@
+#ifndef ENVIRONMENT_C_H
+#define ENVIRONMENT_C_H
+
+/* Plain C interface to the reinforcement learning environment, for use from
+ * Python (ctypes/cffi) and other languages. Observation pointers returned by
+ * these functions point straight into the emulator and stay valid until the
+ * next reset or step of the same environment, raw video RAM observations for
+ * its whole life. A new environment shows the attract mode until its first
+ * reset, which starts a game. */
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define SI_EXPORT __declspec(dllexport)
+#else
+#define SI_EXPORT __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct si_env si_env;
+typedef struct si_vec_env si_vec_env;
+
+/* observation_type: 0 = raw 1bpp video RAM, 1 = rendered 224x256 greyscale,
+ * 2 = downsampled greyscale frames, see si_env_set_downsampling */
+SI_EXPORT si_env* si_env_create(int observation_type);
+SI_EXPORT void si_env_destroy(si_env* env);
+
+SI_EXPORT void si_env_set_downsampling(si_env* env, int width, int height, int stack_depth);
+
+SI_EXPORT int si_env_num_actions(void);
+SI_EXPORT int si_env_observation_size(si_env* env);
+
+SI_EXPORT const uint8_t* si_env_reset(si_env* env);
+SI_EXPORT const uint8_t* si_env_step(si_env* env, int action, int frameskip, float* reward, int* done);
+
+SI_EXPORT int si_env_score(si_env* env);
+SI_EXPORT int si_env_lives(si_env* env);
+
+/* Fingerprint of the complete machine state, cheap enough to deduplicate states every step */
+SI_EXPORT uint64_t si_env_state_hash(si_env* env);
+
+SI_EXPORT si_vec_env* si_vec_env_create(int count, int observation_type, int parallel);
+SI_EXPORT void si_vec_env_destroy(si_vec_env* env);
+
+SI_EXPORT void si_vec_env_set_downsampling(si_vec_env* env, int width, int height, int stack_depth);
+SI_EXPORT void si_vec_env_reset(si_vec_env* env);
+SI_EXPORT void si_vec_env_step(si_vec_env* env, const int* actions, int frameskip, float* rewards, uint8_t* dones);
+SI_EXPORT const uint8_t* si_vec_env_observation(si_vec_env* env, int index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENVIRONMENT_C_H
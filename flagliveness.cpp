@@ -0,0 +1,111 @@
+#include "flagliveness.h"
+#include <vector>
+
+// Flags an instruction always overwrites, whatever its operands
+static uint8_t flagsWritten(uint8_t opcode)
+{
+    if ((opcode & 0xC7) == 0x04 || (opcode & 0xC7) == 0x05) // INR, DCR
+        return SIGN_BIT | ZERO_BIT | PARITY_BIT | AUX_BIT;
+    if (opcode >= 0xA0 && opcode < 0xB8) // ANA, XRA, ORA
+        return SIGN_BIT | ZERO_BIT | PARITY_BIT | CARRY_BIT;
+    if (opcode >= 0x80 && opcode < 0xC0) // ADD, ADC, SUB, SBB, CMP
+        return ALL_FLAGS;
+
+    switch (opcode)
+    {
+    case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xFE: // ADI, ACI, SUI, SBI, CPI
+    case 0xF1: // POP PSW
+        return ALL_FLAGS;
+    case 0xE6: case 0xEE: case 0xF6: // ANI, XRI, ORI
+        return SIGN_BIT | ZERO_BIT | PARITY_BIT | CARRY_BIT;
+    case 0x07: case 0x0F: case 0x17: case 0x1F: case 0x37: case 0x3F: // Rotates, STC, CMC
+        return CARRY_BIT;
+    }
+
+    // DAA and DAD only change some flags depending on the values
+    return 0;
+}
+
+static uint8_t flagsRead(uint8_t opcode)
+{
+    if ((opcode >= 0x88 && opcode < 0x90) || (opcode >= 0x98 && opcode < 0xA0)) // ADC, SBB
+        return CARRY_BIT;
+
+    // Conditional jumps, calls and returns, the condition is in bits 3 to 5
+    if ((opcode & 0xC7) == 0xC0 || (opcode & 0xC7) == 0xC2 || (opcode & 0xC7) == 0xC4)
+    {
+        const uint8_t conditionFlags[] = { ZERO_BIT, CARRY_BIT, PARITY_BIT, SIGN_BIT };
+        return conditionFlags[(opcode >> 4) & 3];
+    }
+
+    switch (opcode)
+    {
+    case 0xCE: case 0xDE: // ACI, SBI
+    case 0x17: case 0x1F: case 0x3F: // RAL, RAR, CMC
+        return CARRY_BIT;
+    case 0x27: // DAA
+        return AUX_BIT | CARRY_BIT;
+    case 0xF5: // PUSH PSW
+        return ALL_FLAGS;
+    }
+    return 0;
+}
+
+// Backwards over the window: live[address] holds the flags that may be read within the next
+// depth instructions starting at address, everything counts as live beyond that. Jumps and
+// calls are followed, returns and RST end the search with everything live. An address that isn't really an
+// instruction start is analyzed too, if it ever runs it decodes the same way.
+int analyzeFlagLiveness(const uint8_t* rom, uint8_t deadFlags[MEMORY_SIZE])
+{
+    std::vector<uint8_t> live(ROM_SIZE, ALL_FLAGS);
+    std::vector<uint8_t> nextLive(ROM_SIZE);
+
+    // Flags live after the instruction at address
+    auto liveAfter = [&](uint16_t address) -> uint8_t
+    {
+        uint8_t opcode = rom[address];
+        int length = instructionLength(opcode);
+        int next = address + length;
+        if (next > ROM_SIZE)
+            return ALL_FLAGS;
+        int target = length == 3 ? rom[address + 1] | (rom[address + 2] << 8) : ROM_SIZE;
+
+        auto liveAt = [&](int successor) -> uint8_t { return successor < ROM_SIZE ? live[successor] : ALL_FLAGS; };
+        switch (instructionKind(opcode))
+        {
+        case INSTRUCTION_PLAIN:
+            return liveAt(next);
+        case INSTRUCTION_JUMP:
+        case INSTRUCTION_CALL:
+            return liveAt(target);
+        case INSTRUCTION_JUMP_IF:
+        case INSTRUCTION_CALL_IF:
+            return liveAt(target) | liveAt(next);
+        default:
+            return ALL_FLAGS;
+        }
+    };
+
+    for (int depth = 1; depth <= FLAG_LIVENESS_WINDOW; ++depth)
+    {
+        for (int address = 0; address < ROM_SIZE; ++address)
+        {
+            uint8_t opcode = rom[address];
+            if (instructionKind(opcode) == INSTRUCTION_UNSUPPORTED)
+                nextLive[address] = ALL_FLAGS;
+            else
+                nextLive[address] = flagsRead(opcode) | (liveAfter(address) & ~flagsWritten(opcode));
+        }
+        live.swap(nextLive);
+    }
+
+    memset(deadFlags, 0, MEMORY_SIZE);
+    int instructions = 0;
+    for (int address = 0; address < ROM_SIZE; ++address)
+    {
+        deadFlags[address] = flagsWritten(rom[address]) & ~liveAfter(address);
+        if (deadFlags[address])
+            ++instructions;
+    }
+    return instructions;
+}
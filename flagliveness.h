@@ -0,0 +1,20 @@
+#ifndef FLAGLIVENESS_H
+#define FLAGLIVENESS_H
+
+#include <stdint.h>
+#include "cpu.h"
+#include "opcodes.h"
+
+const uint8_t ALL_FLAGS = SIGN_BIT | ZERO_BIT | AUX_BIT | PARITY_BIT | CARRY_BIT;
+
+// How far ahead the analysis looks. A flag that isn't overwritten within this many instructions
+// on every path counts as live.
+const int FLAG_LIVENESS_WINDOW = 16;
+const int FLAG_LIVENESS_WINDOW_CYCLES = FLAG_LIVENESS_WINDOW * MAX_INSTRUCTION_CYCLES;
+
+// Fills deadFlags with the flags every path overwrites before reading them again, for each
+// instruction in ROM that writes all the flags it touches. Everything else gets none, see
+// CPUBase::deadFlags. Returns the number of instructions with dead flags.
+int analyzeFlagLiveness(const uint8_t* rom, uint8_t deadFlags[MEMORY_SIZE]);
+
+#endif // FLAGLIVENESS_H
@@ -70,7 +70,7 @@ void FlagRegister::calculateZeroSignParityBits(uint8_t reg)
     calculateEvenParityBit(reg);
 }
 
-uint8_t FlagRegister::getRegister()
+uint8_t FlagRegister::getRegister() const
 {
     return conditionBits;
 }
@@ -0,0 +1,154 @@
+#include "framepublisher.h"
+#include <QDebug>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+FramePublisher::FramePublisher() : frames(0)
+{
+}
+
+FramePublisher::~FramePublisher()
+{
+    close();
+}
+
+bool FramePublisher::open(const QString& name)
+{
+    this->name = name.startsWith("/") ? name : "/" + name;
+
+    int fd = shm_open(qPrintable(this->name), O_CREAT | O_RDWR, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(SharedFrames)) != 0)
+    {
+        qWarning("Could not create shared memory %s.", qPrintable(this->name));
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+
+    void* memory = mmap(0, sizeof(SharedFrames), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+    {
+        qWarning("Could not map shared memory %s.", qPrintable(this->name));
+        return false;
+    }
+
+    frames = static_cast<SharedFrames*>(memory);
+    memset(static_cast<void*>(frames), 0, sizeof(SharedFrames));
+    frames->slotCount = SHARED_FRAME_SLOTS;
+    frames->slotSize = sizeof(SharedFrameSlot);
+    frames->version = SHARED_FRAMES_VERSION;
+
+    // Readers check the magic last, by then the rest of the header is in place
+    std::atomic_thread_fence(std::memory_order_release);
+    frames->magic = SHARED_FRAMES_MAGIC;
+    return true;
+}
+
+void FramePublisher::close()
+{
+    if (!frames)
+        return;
+
+    munmap(frames, sizeof(SharedFrames));
+    shm_unlink(qPrintable(name));
+    frames = 0;
+}
+
+bool FramePublisher::isOpen() const
+{
+    return frames != 0;
+}
+
+void FramePublisher::publish(const Machine& machine)
+{
+    if (!frames)
+        return;
+
+    uint64_t published = frames->framesPublished.load(std::memory_order_relaxed);
+    SharedFrameSlot& slot = frames->ring[published % SHARED_FRAME_SLOTS];
+
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.frame = machine.frame;
+    slot.cycles = machine.cycles;
+    slot.input1 = machine.cpu.input1;
+    slot.input2 = machine.cpu.input2;
+    memcpy(slot.videoRam, machine.videoRam(), VIDEO_RAM_SIZE);
+
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    frames->framesPublished.store(published + 1, std::memory_order_release);
+}
+
+FrameSubscriber::FrameSubscriber() : frames(0)
+{
+}
+
+FrameSubscriber::~FrameSubscriber()
+{
+    close();
+}
+
+bool FrameSubscriber::open(const QString& name)
+{
+    QString objectName = name.startsWith("/") ? name : "/" + name;
+
+    int fd = shm_open(qPrintable(objectName), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    void* memory = mmap(0, sizeof(SharedFrames), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+        return false;
+
+    frames = static_cast<const SharedFrames*>(memory);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (frames->magic != SHARED_FRAMES_MAGIC || frames->version != SHARED_FRAMES_VERSION
+        || frames->slotSize != sizeof(SharedFrameSlot))
+    {
+        qWarning("Shared memory %s has an unexpected layout.", qPrintable(objectName));
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void FrameSubscriber::close()
+{
+    if (frames)
+        munmap(const_cast<SharedFrames*>(frames), sizeof(SharedFrames));
+    frames = 0;
+}
+
+const SharedFrameSlot* FrameSubscriber::latest(uint32_t& sequence) const
+{
+    while (true)
+    {
+        uint64_t published = framesPublished();
+        if (published == 0)
+            return 0;
+
+        const SharedFrameSlot* slot = &frames->ring[(published - 1) % frames->slotCount];
+        sequence = slot->sequence.load(std::memory_order_acquire);
+        if ((sequence & 1) == 0)
+            return slot;
+        // The writer has already lapped us and is filling this slot, look again
+    }
+}
+
+bool FrameSubscriber::isValid(const SharedFrameSlot* slot, uint32_t sequence) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot->sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+uint64_t FrameSubscriber::framesPublished() const
+{
+    return frames ? frames->framesPublished.load(std::memory_order_acquire) : 0;
+}
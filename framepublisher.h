@@ -0,0 +1,78 @@
+#ifndef FRAMEPUBLISHER_H
+#define FRAMEPUBLISHER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <QString>
+#include "machine.h"
+
+// Layout of the POSIX shared memory object. Frames go round a small ring of
+// slots. Every slot is guarded by a sequence number that is odd while the
+// emulator writes to it, so readers can use the data in place and check
+// afterwards that it didn't change underneath them.
+const uint32_t SHARED_FRAMES_MAGIC = 0x42464953; // "SIFB"
+const uint32_t SHARED_FRAMES_VERSION = 1;
+const int SHARED_FRAME_SLOTS = 8;
+
+struct SharedFrameSlot
+{
+    std::atomic<uint32_t> sequence;
+    uint8_t input1;
+    uint8_t input2;
+    uint8_t reserved[2];
+    uint64_t frame;
+    uint64_t cycles;
+    uint8_t videoRam[VIDEO_RAM_SIZE];
+};
+
+struct SharedFrames
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotSize;
+    std::atomic<uint64_t> framesPublished; // The newest frame is in slot (framesPublished - 1) % slotCount
+    SharedFrameSlot ring[SHARED_FRAME_SLOTS];
+};
+
+// Writer side, owned by the emulator
+class FramePublisher
+{
+public:
+    FramePublisher();
+    ~FramePublisher();
+
+    bool open(const QString& name);
+    void close();
+    bool isOpen() const;
+
+    void publish(const Machine& machine);
+
+private:
+    QString name;
+    SharedFrames* frames;
+};
+
+// Reader side for tools in other processes
+class FrameSubscriber
+{
+public:
+    FrameSubscriber();
+    ~FrameSubscriber();
+
+    bool open(const QString& name);
+    void close();
+
+    // Returns the newest complete slot, or 0 if nothing has been published yet.
+    // The slot may be overwritten at any time, so once done with the data
+    // check that isValid() still holds for the sequence number returned here.
+    const SharedFrameSlot* latest(uint32_t& sequence) const;
+    bool isValid(const SharedFrameSlot* slot, uint32_t sequence) const;
+
+    uint64_t framesPublished() const;
+
+private:
+    const SharedFrames* frames;
+};
+
+#endif // FRAMEPUBLISHER_H
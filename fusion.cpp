@@ -0,0 +1,90 @@
+#include "fusion.h"
+#include "opcodes.h"
+
+template <int (CPU::*Instruction)()>
+static int runInstruction(CPU& cpu)
+{
+    uint8_t opcode = cpu.readByte(cpu.registers.PC);
+    int cycles = (cpu.*Instruction)();
+    cpu.tracePolicy.instruction(cpu, opcode, cycles);
+    return cycles;
+}
+
+// The instructions one after the other without fetching and decoding them, the cycles add up
+template <int (CPU::*... Instructions)()>
+static int runFused(CPU& cpu)
+{
+    // Braced initializers are evaluated in order
+    int cycles[] = { runInstruction<Instructions>(cpu)... };
+
+    int total = 0;
+    for (unsigned i = 0; i < sizeof...(Instructions); ++i)
+        total += cycles[i];
+    return total;
+}
+
+// Matched by opcode anywhere in the ROM, the immediate operands are read as usual. The methods
+// have to be the ones decode() picks for the opcodes.
+static const FusedSequence SEQUENCES[] = {
+    // Waiting for the interrupt handler to change a variable, and tests of flags in RAM
+    { 3, { 0x3A, 0xA7, 0xC2 }, &runFused<&CPU::LDA, &CPU::ANA_A, &CPU::JNZ> },
+    { 3, { 0x3A, 0xA7, 0xCA }, &runFused<&CPU::LDA, &CPU::ANA_A, &CPU::JZ> },
+    { 3, { 0x3A, 0x3D, 0xC2 }, &runFused<&CPU::LDA, &CPU::DCR_A, &CPU::JNZ> },
+    { 3, { 0x3A, 0xE6, 0xCA }, &runFused<&CPU::LDA, &CPU::ANI, &CPU::JZ> },
+    { 3, { 0x7E, 0xA7, 0xC2 }, &runFused<&CPU::MOV_A_M, &CPU::ANA_A, &CPU::JNZ> },
+    { 3, { 0x7E, 0xA7, 0xCA }, &runFused<&CPU::MOV_A_M, &CPU::ANA_A, &CPU::JZ> },
+
+    // Loop counters
+    { 3, { 0x23, 0x05, 0xC2 }, &runFused<&CPU::INX_H, &CPU::DCR_B, &CPU::JNZ> },
+    { 4, { 0x0C, 0x23, 0x05, 0xC2 }, &runFused<&CPU::INR_C, &CPU::INX_H, &CPU::DCR_B, &CPU::JNZ> },
+
+    // Copying and clearing memory
+    { 6, { 0x1A, 0x77, 0x23, 0x13, 0x05, 0xC2 },
+      &runFused<&CPU::LDAX_D, &CPU::MOV_M_A, &CPU::INX_H, &CPU::INX_D, &CPU::DCR_B, &CPU::JNZ> },
+    { 6, { 0x36, 0x23, 0x7D, 0xE6, 0xFE, 0xDA },
+      &runFused<&CPU::MVI_M, &CPU::INX_H, &CPU::MOV_A_L, &CPU::ANI, &CPU::CPI, &CPU::JC> },
+    { 5, { 0x36, 0x23, 0x7C, 0xFE, 0xC2 },
+      &runFused<&CPU::MVI_M, &CPU::INX_H, &CPU::MOV_A_H, &CPU::CPI, &CPU::JNZ> },
+
+    // Drawing and clearing sprites one row at a time, a row is 0x20 bytes
+    { 9, { 0xC5, 0x1A, 0x77, 0x13, 0x01, 0x09, 0xC1, 0x05, 0xC2 },
+      &runFused<&CPU::PUSH_B, &CPU::LDAX_D, &CPU::MOV_M_A, &CPU::INX_D, &CPU::LXI_B, &CPU::DAD_B,
+                &CPU::POP_B, &CPU::DCR_B, &CPU::JNZ> },
+    { 7, { 0xC5, 0x77, 0x01, 0x09, 0xC1, 0x05, 0xC2 },
+      &runFused<&CPU::PUSH_B, &CPU::MOV_M_A, &CPU::LXI_B, &CPU::DAD_B, &CPU::POP_B, &CPU::DCR_B, &CPU::JNZ> },
+
+    // Drawing a sprite shifted through the shift register
+    { 18, { 0xC5, 0xE5, 0x1A, 0xD3, 0xDB, 0x77, 0x23, 0x13, 0xAF, 0xD3, 0xDB, 0x77, 0xE1, 0x01, 0x09, 0xC1, 0x05, 0xC2 },
+      &runFused<&CPU::PUSH_B, &CPU::PUSH_H, &CPU::LDAX_D, &CPU::OUT, &CPU::IN, &CPU::MOV_M_A, &CPU::INX_H,
+                &CPU::INX_D, &CPU::XRA_A, &CPU::OUT, &CPU::IN, &CPU::MOV_M_A, &CPU::POP_H, &CPU::LXI_B,
+                &CPU::DAD_B, &CPU::POP_B, &CPU::DCR_B, &CPU::JNZ> }
+};
+
+static bool matches(const uint8_t* rom, int address, const FusedSequence& sequence)
+{
+    for (int i = 0; i < sequence.length; ++i)
+    {
+        if (address >= ROM_SIZE || rom[address] != sequence.opcodes[i])
+            return false;
+        address += instructionLength(rom[address]);
+    }
+    return address <= ROM_SIZE;
+}
+
+int findFusedSequences(const uint8_t* rom, const FusedSequence* sequences[ROM_SIZE])
+{
+    int found = 0;
+    for (int address = 0; address < ROM_SIZE; ++address)
+    {
+        sequences[address] = 0;
+        for (const FusedSequence& sequence : SEQUENCES)
+        {
+            if (matches(rom, address, sequence) && (!sequences[address] || sequence.length > sequences[address]->length))
+                sequences[address] = &sequence;
+        }
+
+        if (sequences[address])
+            ++found;
+    }
+    return found;
+}
@@ -0,0 +1,22 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+const int MAX_FUSED_INSTRUCTIONS = 18;
+
+// A sequence of instructions the ROM spends most of its time in, run as one superinstruction.
+// Only the last one may jump, so the sequence always runs to its end.
+struct FusedSequence
+{
+    int length; // Instructions
+    uint8_t opcodes[MAX_FUSED_INSTRUCTIONS];
+    int (*run)(CPU& cpu);
+};
+
+// Fills sequences with the longest fused sequence starting at each ROM address, or null.
+// Returns the number of addresses that have one.
+int findFusedSequences(const uint8_t* rom, const FusedSequence* sequences[ROM_SIZE]);
+
+#endif // FUSION_H
@@ -0,0 +1,425 @@
+#include "gdbstub.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QList>
+#include <QDebug>
+
+// How long the network thread waits for GDB before it looks for replies to send
+const int GDB_POLL_MSECS = 5;
+
+const char GDB_INTERRUPT = 0x03;
+const int GDB_SIGINT = 2;
+const int GDB_SIGTRAP = 5;
+
+// AF, BC, DE, HL, SP and PC, the Z80's other registers come after them
+const int GDB_REGISTER_COUNT = 6;
+
+// Bytes in a reply to m, the hex digits of them have to fit into PacketSize
+const uint GDB_MAX_MEMORY_READ = 0x800;
+
+GdbStub::GdbStub(quint16 port)
+    : port(port), attached(false), halted(false), nativeCore(false), flagLiveness(false), fusion(false), hle(false)
+{
+}
+
+GdbStub::~GdbStub()
+{
+    requestInterruption();
+    wait();
+}
+
+void GdbStub::runFrame(Machine& machine)
+{
+    uint64_t frame = machine.frame;
+    while (machine.frame == frame)
+    {
+        QByteArray packet;
+        if (incoming.pop(packet))
+        {
+            handle(machine, packet);
+        }
+        else if (halted)
+        {
+            if (QThread::currentThread()->isInterruptionRequested())
+                return;
+            QThread::msleep(1);
+        }
+        else
+        {
+            step(machine);
+        }
+    }
+}
+
+// Returns false if it stopped at a breakpoint or watchpoint
+bool GdbStub::step(Machine& machine)
+{
+    machine.step();
+    uint16_t pc = machine.cpu.registers.PC;
+
+    // The machine only checks the watchpoints of CONFIG+=watchpoints builds in its own runFrame()
+    Watchpoints* watchpoints = machine.watchpoints();
+    if (watchpoints)
+        watchpoints->execute(pc);
+    if (watchpoints && watchpoints->hasHit())
+    {
+        printWatchHit(machine);
+        watchpoints->clearHit();
+        stop(GDB_SIGTRAP);
+        return false;
+    }
+
+    if (breakpoints.contains(pc))
+    {
+        stop(GDB_SIGTRAP);
+        return false;
+    }
+    return true;
+}
+
+static uint16_t readRegister(const CPU& cpu, int index)
+{
+    switch (index)
+    {
+    case 0:
+        return cpu.registers.A << 8 | cpu.conditionBits.getRegister();
+    case 1:
+        return cpu.registers.BC;
+    case 2:
+        return cpu.registers.DE;
+    case 3:
+        return cpu.registers.HL;
+    case 4:
+        return cpu.registers.SP;
+    default:
+        return cpu.registers.PC;
+    }
+}
+
+static void writeRegister(CPU& cpu, int index, uint16_t value)
+{
+    switch (index)
+    {
+    case 0:
+        cpu.registers.A = value >> 8;
+        cpu.conditionBits = FlagRegister(value & 0xFF);
+        break;
+    case 1:
+        cpu.registers.BC = value;
+        break;
+    case 2:
+        cpu.registers.DE = value;
+        break;
+    case 3:
+        cpu.registers.HL = value;
+        break;
+    case 4:
+        cpu.registers.SP = value;
+        break;
+    default:
+        cpu.registers.PC = value;
+    }
+}
+
+// Registers go over the wire in the target's byte order
+static QByteArray registerHex(uint16_t value)
+{
+    QByteArray bytes;
+    bytes += char(value & 0xFF);
+    bytes += char(value >> 8);
+    return bytes.toHex();
+}
+
+static bool parseRegisterHex(const QByteArray& hex, uint16_t& value)
+{
+    QByteArray bytes = QByteArray::fromHex(hex);
+    if (hex.size() != 4 || bytes.size() != 2)
+        return false;
+    value = uint8_t(bytes[0]) | uint8_t(bytes[1]) << 8;
+    return true;
+}
+
+// "address,length" of m, M, Z and z, the kind of a breakpoint takes the length's place
+static bool parseRange(const QByteArray& text, uint& address, uint& length)
+{
+    QList<QByteArray> fields = text.split(',');
+    bool addressOk = false;
+    bool lengthOk = false;
+    if (fields.size() == 2)
+    {
+        address = fields[0].toUInt(&addressOk, 16);
+        length = fields[1].toUInt(&lengthOk, 16);
+    }
+    return addressOk && lengthOk && address <= 0xFFFF;
+}
+
+void GdbStub::handle(Machine& machine, const QByteArray& packet)
+{
+    if (packet.isEmpty())
+    {
+        if (attached)
+            detach(machine);
+        return;
+    }
+    if (!attached)
+        attach(machine);
+
+    CPU& cpu = machine.cpu;
+    char command = packet[0];
+    QByteArray arguments = packet.mid(1);
+    uint address = 0;
+    uint length = 0;
+
+    switch (command)
+    {
+    case GDB_INTERRUPT:
+        if (!halted)
+            stop(GDB_SIGINT);
+        break;
+    case '?':
+        reply("S05");
+        break;
+    case 'g':
+    {
+        QByteArray registers;
+        for (int i = 0; i < GDB_REGISTER_COUNT; ++i)
+            registers += registerHex(readRegister(cpu, i));
+        reply(registers);
+        break;
+    }
+    case 'G':
+    {
+        uint16_t values[GDB_REGISTER_COUNT];
+        bool valid = arguments.size() >= GDB_REGISTER_COUNT * 4;
+        for (int i = 0; valid && i < GDB_REGISTER_COUNT; ++i)
+            valid = parseRegisterHex(arguments.mid(i * 4, 4), values[i]);
+        for (int i = 0; valid && i < GDB_REGISTER_COUNT; ++i)
+            writeRegister(cpu, i, values[i]);
+        reply(valid ? "OK" : "E01");
+        break;
+    }
+    case 'p':
+    {
+        bool valid = false;
+        int index = arguments.toInt(&valid, 16);
+        reply(valid && index < GDB_REGISTER_COUNT ? registerHex(readRegister(cpu, index)) : QByteArray("E01"));
+        break;
+    }
+    case 'P':
+    {
+        QList<QByteArray> fields = arguments.split('=');
+        bool valid = false;
+        int index = fields[0].toInt(&valid, 16);
+        uint16_t value = 0;
+        valid = valid && index < GDB_REGISTER_COUNT && fields.size() == 2 && parseRegisterHex(fields[1], value);
+        if (valid)
+            writeRegister(cpu, index, value);
+        reply(valid ? "OK" : "E01");
+        break;
+    }
+    case 'm':
+    {
+        if (!parseRange(arguments, address, length))
+        {
+            reply("E01");
+            break;
+        }
+        QByteArray bytes;
+        for (uint i = 0; i < qMin(length, GDB_MAX_MEMORY_READ); ++i)
+            bytes += char(cpu.readByte(address + i));
+        reply(bytes.toHex());
+        break;
+    }
+    case 'M':
+    {
+        // Writes to the ROM are ignored, like on the board
+        int colon = arguments.indexOf(':');
+        QByteArray bytes = QByteArray::fromHex(arguments.mid(colon + 1));
+        if (colon < 0 || !parseRange(arguments.left(colon), address, length) || uint(bytes.size()) != length)
+        {
+            reply("E01");
+            break;
+        }
+        for (uint i = 0; i < length; ++i)
+            cpu.writeByte(address + i, bytes[i]);
+        reply("OK");
+        break;
+    }
+    case 'c':
+    case 's':
+        if (!arguments.isEmpty())
+            cpu.registers.PC = arguments.toUInt(0, 16);
+        if (command == 'c')
+            halted = false;
+        else if (step(machine))
+            stop(GDB_SIGTRAP);
+        break;
+    case 'Z':
+    case 'z':
+        // Software and hardware breakpoints are the same thing here, watchpoints aren't supported
+        if (arguments.size() < 2 || (arguments[0] != '0' && arguments[0] != '1'))
+            reply("");
+        else if (!parseRange(arguments.mid(2), address, length))
+            reply("E01");
+        else
+        {
+            if (command == 'Z')
+                breakpoints.insert(address);
+            else
+                breakpoints.remove(address);
+            reply("OK");
+        }
+        break;
+    case 'D':
+        reply("OK");
+        detach(machine);
+        break;
+    case 'k':
+        // The game keeps running, only the debugger goes away
+        detach(machine);
+        break;
+    case 'H':
+        reply("OK");
+        break;
+    case 'q':
+        if (arguments.startsWith("Supported"))
+            reply("PacketSize=1000");
+        else if (arguments == "Attached")
+            reply("1");
+        else
+            reply("");
+        break;
+    default:
+        reply("");
+    }
+}
+
+// GDB expects the game to be halted when it connects. Every instruction has to be its own step
+// to stop at a breakpoint, and the flags have to be right whenever GDB reads them.
+void GdbStub::attach(Machine& machine)
+{
+    nativeCore = machine.nativeCore();
+    flagLiveness = machine.flagLiveness();
+    fusion = machine.fusion();
+    hle = machine.hle();
+
+    machine.setNativeCore(false);
+    machine.setFlagLiveness(false);
+    machine.setFusion(false);
+    machine.setHle(false);
+
+    attached = true;
+    halted = true;
+    qDebug("GDB attached in frame %llu.", (unsigned long long) machine.frame);
+}
+
+void GdbStub::detach(Machine& machine)
+{
+    machine.setNativeCore(nativeCore);
+    machine.setFlagLiveness(flagLiveness);
+    machine.setFusion(fusion);
+    machine.setHle(hle);
+
+    attached = false;
+    halted = false;
+    breakpoints.clear();
+    qDebug("GDB detached, the game goes on.");
+}
+
+void GdbStub::stop(int signal)
+{
+    halted = true;
+    reply("S" + QByteArray::number(signal, 16).rightJustified(2, '0'));
+}
+
+void GdbStub::reply(const QByteArray& payload)
+{
+    // GDB waits for each reply before it sends more, so the queue can only fill up if it is gone
+    outgoing.push(payload);
+}
+
+static uint8_t checksum(const QByteArray& payload)
+{
+    uint8_t sum = 0;
+    for (char character : payload)
+        sum += uint8_t(character);
+    return sum;
+}
+
+void GdbStub::run()
+{
+    QTcpServer server;
+    if (!server.listen(QHostAddress::LocalHost, port))
+    {
+        qWarning("Could not listen for GDB on port %d: %s", port, qPrintable(server.errorString()));
+        return;
+    }
+    qDebug("Waiting for GDB on localhost:%d.", port);
+
+    while (!isInterruptionRequested())
+    {
+        if (!server.waitForNewConnection(GDB_POLL_MSECS * 20))
+            continue;
+        QTcpSocket* socket = server.nextPendingConnection();
+
+        // Every packet waits for the one before, Nagle's algorithm would hold most of them back
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+        // Replies to the previous connection nobody picked up
+        QByteArray payload;
+        while (outgoing.pop(payload))
+            ;
+
+        QByteArray buffer;
+        while (!isInterruptionRequested() && socket->state() == QAbstractSocket::ConnectedState)
+        {
+            while (outgoing.pop(payload))
+                socket->write("$" + payload + "#" + QByteArray::number(checksum(payload), 16).rightJustified(2, '0'));
+            socket->flush();
+
+            if (!socket->waitForReadyRead(GDB_POLL_MSECS))
+                continue;
+            buffer += socket->readAll();
+
+            while (!buffer.isEmpty())
+            {
+                QByteArray packet;
+                if (buffer[0] == GDB_INTERRUPT)
+                {
+                    packet = buffer.left(1);
+                    buffer.remove(0, 1);
+                }
+                else if (buffer[0] == '$')
+                {
+                    int end = buffer.indexOf('#');
+                    if (end < 0 || buffer.size() < end + 3)
+                        break; // The rest is still on the way
+
+                    packet = buffer.mid(1, end - 1);
+                    bool valid = false;
+                    bool matches = buffer.mid(end + 1, 2).toUInt(&valid, 16) == checksum(packet);
+                    buffer.remove(0, end + 3);
+
+                    // A broken packet is sent again after the NAK
+                    socket->write(valid && matches ? "+" : "-");
+                    if (!valid || !matches)
+                        continue;
+                }
+                else
+                {
+                    // Acknowledgements of the replies, they are never sent again
+                    buffer.remove(0, 1);
+                    continue;
+                }
+
+                while (!incoming.push(packet) && !isInterruptionRequested())
+                    QThread::msleep(1);
+            }
+        }
+
+        // Lets the emulation thread detach, so a game halted by GDB doesn't stay that way
+        while (!incoming.push(QByteArray()) && !isInterruptionRequested())
+            QThread::msleep(1);
+        delete socket;
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include <stdint.h>
+#include <QByteArray>
+#include <QSet>
+#include <QThread>
+#include "lockfreequeue.h"
+#include "machine.h"
+
+// Packets waiting in either direction, GDB waits for the reply to each of its own
+const int GDB_QUEUE_SIZE = 64;
+
+// Lets GDB debug the running game over its remote serial protocol on a localhost TCP port.
+// This thread only moves packets between the socket and two queues, the emulation thread
+// answers them between frames, or between instructions while GDB is in control, so the
+// machine is never touched from two threads. Registers are sent in the order of GDB's z80
+// architecture: AF, BC, DE, HL, SP and PC.
+class GdbStub : public QThread
+{
+public:
+    explicit GdbStub(quint16 port);
+    ~GdbStub();
+
+    // Cheap enough to ask before every frame: true once a packet came in, while GDB has the
+    // game halted and while it has breakpoints
+    bool wantsControl() const;
+
+    // Runs the rest of the frame on the emulation thread like Machine::runFrame(), but answers
+    // GDB's packets, stops at its breakpoints and waits while it has the game halted. Returns
+    // once the frame is complete or the calling thread is asked to stop.
+    void runFrame(Machine& machine);
+
+private:
+    quint16 port;
+
+    // Raw payloads, Ctrl-C arrives as a single 0x03 and a closed connection as an empty one
+    LockFreeQueue<QByteArray, GDB_QUEUE_SIZE> incoming;
+    LockFreeQueue<QByteArray, GDB_QUEUE_SIZE> outgoing;
+
+    // Only used on the emulation thread
+    bool attached;
+    bool halted;
+    QSet<uint16_t> breakpoints;
+
+    // What the machine ran with before GDB attached, it gets that back on detach
+    bool nativeCore;
+    bool flagLiveness;
+    bool fusion;
+    bool hle;
+
+    void run();
+
+    bool step(Machine& machine);
+    void handle(Machine& machine, const QByteArray& packet);
+    void attach(Machine& machine);
+    void detach(Machine& machine);
+    void stop(int signal);
+    void reply(const QByteArray& payload);
+};
+
+inline bool GdbStub::wantsControl() const
+{
+    return halted || !breakpoints.isEmpty() || !incoming.empty();
+}
+
+#endif // GDBSTUB_H
@@ -1,7 +1,9 @@
 #include "gui.h"
 
-GUI::GUI()
+GUI::GUI(const Options& options) : emu(options), traceFile(options.traceFile)
 {
+    setTraceThreadName("GUI");
+
     layout = new QHBoxLayout(this);
     layout->setMargin(0);
 
@@ -16,21 +18,36 @@ GUI::GUI()
 
 void GUI::showScreen(QImage const* image)
 {
-    screen->setPixmap(QPixmap::fromImage(*image));
+    TraceScope trace("Present");
+    FrameMetrics& metrics = emu.frameMetrics();
+    metrics.screenShown();
+
+    qint64 start = metrics.now();
+    QPixmap pixmap = QPixmap::fromImage(*image);
+    metrics.record(STAGE_FROM_IMAGE, metrics.now() - start);
+    screen->setPixmap(pixmap);
 }
 
 void GUI::closeEvent(QCloseEvent*)
 {
-    emu.terminate();
+    emu.requestInterruption();
     emu.wait();
 }
 
 void GUI::keyPressEvent(QKeyEvent* event)
 {
+    if (event->key() == Qt::Key_F9 && !traceFile.isEmpty())
+    {
+        writeTrace(traceFile);
+        return;
+    }
+
+    traceInstant("Key pressed", event->key());
     emit inputReceived(event->key(), true);
 }
 
 void GUI::keyReleaseEvent(QKeyEvent* event)
 {
+    traceInstant("Key released", event->key());
     emit inputReceived(event->key(), false);
 }
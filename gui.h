@@ -14,7 +14,7 @@ class GUI : public QWidget
 {
 Q_OBJECT
 public:
-    GUI();
+    GUI(const Options&);
 
 protected:
     void keyPressEvent(QKeyEvent *);
@@ -27,6 +27,7 @@ private:
     QLabel* screen;
 
     Emulator emu;
+    QString traceFile;
 
 public slots:
     void showScreen(QImage const*);
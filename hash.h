@@ -0,0 +1,43 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+
+const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+// 64-bit FNV-1a, plenty for detecting divergence between two runs
+inline uint64_t hashBytes(const uint8_t* data, int size, uint64_t hash = FNV_OFFSET_BASIS)
+{
+    for (int i = 0; i < size; ++i)
+    {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Zobrist style hash of one memory cell, the hash of a memory block is the XOR
+// over its cells. A write only has to XOR out the old cell and XOR in the new
+// one. Zero cells hash to zero, so cleared memory hashes to zero as well.
+inline uint64_t memoryCellHash(uint16_t address, uint8_t value)
+{
+    if (!value)
+        return 0;
+
+    // splitmix64 finalizer, every input bit affects every output bit
+    uint64_t x = ((uint64_t) address << 8 | value) + 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+inline uint64_t memoryHash(const uint8_t* data, uint16_t startAddress, int size)
+{
+    uint64_t hash = 0;
+    for (int i = 0; i < size; ++i)
+        hash ^= memoryCellHash(startAddress + i, data[i]);
+    return hash;
+}
+
+#endif // HASH_H
@@ -0,0 +1,278 @@
+#include "hle.h"
+#include "machine.h"
+#include "hash.h"
+#include <QDebug>
+
+// Whole iterations that end before the interrupt is due, the interpreter checks for it after
+// every instruction
+static int iterationsBeforeEvent(int iterationCycles, int cyclesTillEvent)
+{
+    return cyclesTillEvent > 0 ? (cyclesTillEvent - 1) / iterationCycles : 0;
+}
+
+// DCR, the way addBytes() computes it for value + 0xFF
+static void setDecrementFlags(CPU& cpu, uint8_t value)
+{
+    cpu.conditionBits.setBits(AUX_BIT, (value & 0x0F) != 0);
+    cpu.conditionBits.calculateZeroSignParityBits(value - 1);
+}
+
+// CPI, an addition of the two's complement with the carry inverted afterwards
+static void setCompareFlags(CPU& cpu, uint8_t operand)
+{
+    uint8_t negated = -operand;
+    unsigned sum = cpu.registers.A + negated;
+    cpu.conditionBits.setBits(AUX_BIT, (cpu.registers.A & 0x0F) + (negated & 0x0F) >= 0x10);
+    cpu.conditionBits.setBits(CARRY_BIT, sum < 0x100);
+    cpu.conditionBits.calculateZeroSignParityBits(sum);
+}
+
+// DAD, it only ever sets the carry
+static void addToHL(CPU& cpu, uint16_t value)
+{
+    uint32_t result = cpu.registers.HL + value;
+    if (result & 0x10000)
+        cpu.conditionBits.setBits(CARRY_BIT);
+    cpu.registers.HL = result;
+}
+
+// LDAX D, MOV M,A, INX H, INX D, DCR B, JNZ: copies B bytes from DE to HL
+static int copyBytes(CPU& cpu, const HleHook& hook, int cyclesTillEvent)
+{
+    const int ITERATION_CYCLES = 7 + 7 + 5 + 5 + 5 + 10;
+    CPU::dataRegisters& r = cpu.registers;
+
+    int maxIterations = iterationsBeforeEvent(ITERATION_CYCLES, cyclesTillEvent);
+    int iterations = 0;
+    uint8_t counter = 0;
+    bool done = false;
+    while (!done && iterations < maxIterations)
+    {
+        r.A = cpu.readMemory(r.DE);
+        cpu.writeMemory(r.HL, r.A);
+        ++r.HL;
+        ++r.DE;
+        counter = r.B--;
+        done = r.B == 0;
+        ++iterations;
+    }
+
+    if (iterations == 0)
+        return 0;
+    setDecrementFlags(cpu, counter);
+    r.PC = done ? hook.exit : hook.address;
+    return iterations * ITERATION_CYCLES;
+}
+
+// MVI M, INX H, MOV A,H, CPI, JNZ: fills memory from HL up to the page given to CPI
+static int fillUntilPage(CPU& cpu, const HleHook& hook, int cyclesTillEvent)
+{
+    const int ITERATION_CYCLES = 10 + 5 + 5 + 7 + 10;
+    const uint8_t value = hook.code[1];
+    const uint8_t endPage = hook.code[5];
+    CPU::dataRegisters& r = cpu.registers;
+
+    int maxIterations = iterationsBeforeEvent(ITERATION_CYCLES, cyclesTillEvent);
+    int iterations = 0;
+    bool done = false;
+    while (!done && iterations < maxIterations)
+    {
+        cpu.writeMemory(r.HL, value);
+        ++r.HL;
+        done = r.H == endPage;
+        ++iterations;
+    }
+
+    if (iterations == 0)
+        return 0;
+    r.A = r.H;
+    setCompareFlags(cpu, endPage);
+    r.PC = done ? hook.exit : hook.address;
+    return iterations * ITERATION_CYCLES;
+}
+
+// PUSH B, LDAX D, MOV M,A, INX D, LXI B, DAD B, POP B, DCR B, JNZ: copies B bytes from DE to
+// HL, going down one screen row per byte
+static int copyRows(CPU& cpu, const HleHook& hook, int cyclesTillEvent)
+{
+    const int ITERATION_CYCLES = 11 + 7 + 7 + 5 + 10 + 10 + 10 + 5 + 10;
+    const uint16_t stride = hook.code[5] | (hook.code[6] << 8);
+    CPU::dataRegisters& r = cpu.registers;
+
+    int maxIterations = iterationsBeforeEvent(ITERATION_CYCLES, cyclesTillEvent);
+    int iterations = 0;
+    uint8_t counter = 0;
+    bool done = false;
+    while (!done && iterations < maxIterations)
+    {
+        // The counter goes through the stack, it comes back from there even if the row overwrote it
+        cpu.push(r.BC);
+        r.A = cpu.readMemory(r.DE);
+        cpu.writeMemory(r.HL, r.A);
+        ++r.DE;
+        addToHL(cpu, stride);
+        r.BC = cpu.pop();
+        counter = r.B--;
+        done = r.B == 0;
+        ++iterations;
+    }
+
+    if (iterations == 0)
+        return 0;
+    setDecrementFlags(cpu, counter);
+    r.PC = done ? hook.exit : hook.address;
+    return iterations * ITERATION_CYCLES;
+}
+
+// PUSH B, MOV M,A, LXI B, DAD B, POP B, DCR B, JNZ: fills B screen rows at HL with A
+static int fillRows(CPU& cpu, const HleHook& hook, int cyclesTillEvent)
+{
+    const int ITERATION_CYCLES = 11 + 7 + 10 + 10 + 10 + 5 + 10;
+    const uint16_t stride = hook.code[3] | (hook.code[4] << 8);
+    CPU::dataRegisters& r = cpu.registers;
+
+    int maxIterations = iterationsBeforeEvent(ITERATION_CYCLES, cyclesTillEvent);
+    int iterations = 0;
+    uint8_t counter = 0;
+    bool done = false;
+    while (!done && iterations < maxIterations)
+    {
+        cpu.push(r.BC);
+        cpu.writeMemory(r.HL, r.A);
+        addToHL(cpu, stride);
+        r.BC = cpu.pop();
+        counter = r.B--;
+        done = r.B == 0;
+        ++iterations;
+    }
+
+    if (iterations == 0)
+        return 0;
+    setDecrementFlags(cpu, counter);
+    r.PC = done ? hook.exit : hook.address;
+    return iterations * ITERATION_CYCLES;
+}
+
+// The routines of invaders.rom. The flags are all computed, every loop ends in a RET so none
+// of them is dead, see flagliveness.h.
+static const HleHook HOOKS[] = {
+    { "Block copy", 0x1A32, 0x1A3A, 9, { 0x1A, 0x77, 0x23, 0x13, 0x05, 0xC2, 0x32, 0x1A, 0xC9 }, &copyBytes },
+    { "Screen clear", 0x1A5F, 0x1A68, 10, { 0x36, 0x00, 0x23, 0x7C, 0xFE, 0x40, 0xC2, 0x5F, 0x1A, 0xC9 }, &fillUntilPage },
+    { "Sprite draw", 0x1439, 0x1446, 14,
+      { 0xC5, 0x1A, 0x77, 0x13, 0x01, 0x20, 0x00, 0x09, 0xC1, 0x05, 0xC2, 0x39, 0x14, 0xC9 }, &copyRows },
+    { "Sprite clear", 0x14CC, 0x14D7, 12,
+      { 0xC5, 0x77, 0x01, 0x20, 0x00, 0x09, 0xC1, 0x05, 0xC2, 0xCC, 0x14, 0xC9 }, &fillRows }
+};
+
+int installHleHooks(const uint8_t* rom, const HleHook* hooks[ROM_SIZE])
+{
+    memset(hooks, 0, ROM_SIZE * sizeof(hooks[0]));
+
+    int installed = 0;
+    for (const HleHook& hook : HOOKS)
+    {
+        if (hook.address + hook.codeLength <= ROM_SIZE && memcmp(rom + hook.address, hook.code, hook.codeLength) == 0)
+        {
+            hooks[hook.address] = &hook;
+            ++installed;
+        }
+    }
+    return installed;
+}
+
+// Enough for the longest loop, filling all of the address space
+const uint64_t HLE_TRIAL_CYCLES = 4000000;
+
+static uint64_t nextRandom(uint64_t& seed)
+{
+    ++seed;
+    return hashBytes(reinterpret_cast<const uint8_t*>(&seed), sizeof(seed));
+}
+
+// Random registers and RAM with PC at the hook and the interrupt due at a random point. The
+// interrupts are disabled, after the hook gives up the rest of the loop is interpreted.
+static void randomizeMachine(Machine& machine, const HleHook& hook, uint64_t& seed)
+{
+    for (int i = 0; i < RAM_SIZE; ++i)
+        machine.ram()[i] = nextRandom(seed);
+
+    MachineState state;
+    machine.saveState(state);
+    state.registers.A = nextRandom(seed);
+    state.registers.BC = nextRandom(seed);
+    state.registers.DE = nextRandom(seed);
+    state.registers.HL = nextRandom(seed);
+    state.registers.PC = hook.address;
+    state.flags = nextRandom(seed);
+    state.interruptsEnabled = false;
+    state.cyclesTillEvent = 1 + nextRandom(seed) % CYCLES_PER_INTERRUPT;
+
+    // Mostly somewhere in work RAM like the real stack, sometimes anywhere
+    uint64_t stack = nextRandom(seed);
+    state.registers.SP = stack % 4 ? WORK_RAM_START + stack % WORK_RAM_SIZE : stack;
+
+    machine.loadState(state);
+}
+
+static bool sameState(const Machine& a, const Machine& b)
+{
+    return a.cycles == b.cycles && a.stateHash() == b.stateHash()
+        && memcmp(&a.cpu.registers, &b.cpu.registers, sizeof(a.cpu.registers)) == 0;
+}
+
+bool verifyHleHooks(int trials)
+{
+    uint64_t seed = 0;
+    int hooks = 0;
+    for (const HleHook& hook : HOOKS)
+    {
+        Machine machine;
+        Machine reference;
+        machine.loadRom();
+        reference.loadRom();
+
+        // Plain interpretation on both, except for the hook
+        Machine* machines[] = { &machine, &reference };
+        for (Machine* m : machines)
+        {
+            m->setNativeCore(false);
+            m->setFusion(false);
+            m->setFlagLiveness(false);
+        }
+        reference.setHle(false);
+
+        if (memcmp(machine.cpu.readPages[0] + hook.address, hook.code, hook.codeLength) != 0)
+        {
+            qWarning("%s: not installed, the ROM doesn't match.", hook.name);
+            continue;
+        }
+
+        for (int trial = 0; trial < trials; ++trial)
+        {
+            uint64_t trialSeed = seed;
+            randomizeMachine(machine, hook, seed);
+            randomizeMachine(reference, hook, trialSeed);
+            machine.cycles = reference.cycles = 0;
+
+            // The reference catches up after every step of the hook machine. A stack in ROM can
+            // make the sprite loops endless.
+            while (machine.cpu.registers.PC != hook.exit && machine.cycles < HLE_TRIAL_CYCLES)
+            {
+                machine.step();
+                while (reference.cycles < machine.cycles)
+                    reference.step();
+
+                if (!sameState(machine, reference))
+                {
+                    qWarning("%s: trial %d differs from the interpreter after %llu cycles.", hook.name, trial,
+                             (unsigned long long) machine.cycles);
+                    return false;
+                }
+            }
+        }
+        ++hooks;
+    }
+
+    qDebug("%d hooks matched the interpreter in %d trials each.", hooks, trials);
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef HLE_H
+#define HLE_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+const int MAX_HLE_CODE = 16;
+
+// A loop of the ROM that copies or clears memory, replaced by native code. The hook sits at
+// the head of the loop, where the routine enters it and where it continues after an interrupt.
+//
+// run() does as many whole iterations as end before the next interrupt is due, with exactly the
+// memory writes, registers, flags and cycles of the interpreter, and leaves PC at the head of
+// the loop or at its exit. It returns the cycles, or 0 if not even one iteration fits.
+struct HleHook
+{
+    const char* name;
+    uint16_t address;
+    uint16_t exit; // The routine's RET
+    int codeLength;
+    uint8_t code[MAX_HLE_CODE]; // From the head to the RET, the hook is only installed if the ROM matches
+    int (*run)(CPU& cpu, const HleHook& hook, int cyclesTillEvent);
+};
+
+// Fills hooks with the hook at each ROM address, or null. Returns the number installed.
+int installHleHooks(const uint8_t* rom, const HleHook* hooks[ROM_SIZE]);
+
+// Runs every hook from random states and compares it with interpreting the routine
+bool verifyHleHooks(int trials);
+
+#endif // HLE_H
@@ -0,0 +1,54 @@
+#ifndef LOCKFREEQUEUE_H
+#define LOCKFREEQUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+
+// Bounded single producer, single consumer queue. All storage is allocated
+// up front so pushing and popping never touches the heap.
+template <typename T, size_t CAPACITY>
+class LockFreeQueue
+{
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    LockFreeQueue() : head(0), tail(0) {}
+
+    bool push(const T& item)
+    {
+        size_t currentTail = tail.load(std::memory_order_relaxed);
+        if (currentTail - head.load(std::memory_order_acquire) == CAPACITY)
+            return false; // Full, the item is dropped
+
+        items[currentTail & (CAPACITY - 1)] = item;
+        tail.store(currentTail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        size_t currentHead = head.load(std::memory_order_relaxed);
+        if (currentHead == tail.load(std::memory_order_acquire))
+            return false; // Empty
+
+        item = items[currentHead & (CAPACITY - 1)];
+        head.store(currentHead + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    T items[CAPACITY];
+
+    // Keep the indices on separate cache lines so producer and consumer don't fight over them
+    char padding1[64];
+    std::atomic<size_t> head;
+    char padding2[64];
+    std::atomic<size_t> tail;
+};
+
+#endif // LOCKFREEQUEUE_H
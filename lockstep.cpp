@@ -0,0 +1,292 @@
+#include "lockstep.h"
+#include "disassembler.h"
+#include "hash.h"
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <QAtomicInt>
+#include <QDebug>
+
+// Instructions of the interpreter kept for the report, it shows a few before the step that
+// diverged and the last ones of that step
+const int HISTORY_LENGTH = 256;
+const int CONTEXT_LINES = 8;
+const int STEP_LINES = 16;
+
+// Every so often a coin is inserted and a game started, so the sessions keep playing
+const uint64_t CREDIT_PERIOD_FRAMES = 4096;
+
+const Engines NO_ENGINES = { false, false, false, false };
+
+bool parseEngines(const QString& list, Engines& engines)
+{
+    engines.nativeCore = engines.flagLiveness = engines.fusion = engines.hle = list == "all";
+    if (list == "all" || list == "none")
+        return true;
+
+    for (const QString& name : list.split(','))
+    {
+        if (name == "native")
+            engines.nativeCore = true;
+        else if (name == "liveness")
+            engines.flagLiveness = true;
+        else if (name == "fusion")
+            engines.fusion = true;
+        else if (name == "hle")
+            engines.hle = true;
+        else
+        {
+            qWarning("Unknown engine %s, expected native, liveness, fusion or hle.", qPrintable(name));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool setEngines(Machine& machine, const Engines& engines)
+{
+    bool nativeCore = machine.setNativeCore(engines.nativeCore);
+    machine.setFlagLiveness(engines.flagLiveness);
+    machine.setFusion(engines.fusion);
+    machine.setHle(engines.hle);
+    return nativeCore || !engines.nativeCore;
+}
+
+static QString engineNames(const Engines& engines)
+{
+    QStringList names;
+    if (engines.nativeCore)
+        names << "native";
+    if (engines.flagLiveness)
+        names << "liveness";
+    if (engines.fusion)
+        names << "fusion";
+    if (engines.hle)
+        names << "hle";
+    return names.isEmpty() ? QString("none") : names.join(",");
+}
+
+struct LockstepSession
+{
+    uint64_t seed;
+    uint64_t frames;
+    uint64_t framesPlayed;
+    bool passed;
+};
+
+// The instructions the interpreter ran last, and where the step being compared started
+struct LockstepTrace
+{
+    uint16_t pcs[HISTORY_LENGTH];
+    uint64_t instructions;
+    uint64_t stepStart; // Index of the first instruction of the step
+    uint16_t stepPC;
+};
+
+// Random controls for both players, held for a few frames at a time like a person would
+static void randomInputs(uint64_t seed, uint64_t frame, uint8_t& input1, uint8_t& input2)
+{
+    uint64_t key[] = { seed, frame / 8 };
+    uint64_t value = hashBytes(reinterpret_cast<const uint8_t*>(key), sizeof(key));
+
+    input1 = PORT1_INIT | (value & (P1_SHOOT | P1_LEFT | P1_RIGHT));
+    input2 = PORT2_INIT | ((value >> 8) & (P2_SHOOT | P2_LEFT | P2_RIGHT));
+
+    uint64_t phase = frame % CREDIT_PERIOD_FRAMES;
+    if (phase >= 30 && phase < 40)
+        input1 |= COIN;
+    if (phase >= 200 && phase < 205)
+        input1 |= P1_START;
+}
+
+// The flags may only differ between interrupts while dead flags are skipped
+static bool sameMachines(const Machine& a, const Machine& b, bool compareFlags)
+{
+    const CPU& x = a.cpu;
+    const CPU& y = b.cpu;
+    return a.cycles == b.cycles && x.memoryHash == y.memoryHash
+        && x.registers.PC == y.registers.PC && x.registers.SP == y.registers.SP
+        && x.registers.BC == y.registers.BC && x.registers.DE == y.registers.DE
+        && x.registers.HL == y.registers.HL && x.registers.A == y.registers.A
+        && (!compareFlags || x.conditionBits.getRegister() == y.conditionBits.getRegister())
+        && x.interruptsEnabled == y.interruptsEnabled && x.shiftRegister == y.shiftRegister
+        && x.output2 == y.output2 && x.output3 == y.output3 && x.output4 == y.output4
+        && x.output5 == y.output5 && x.output6 == y.output6;
+}
+
+// Runs one step on the machine and as many instructions on the interpreter as it takes to
+// catch up. Returns false as soon as they differ.
+static bool stepBoth(Machine& machine, Machine& reference, bool compareFlags, LockstepTrace& trace, bool& frameDone)
+{
+    trace.stepStart = trace.instructions;
+    trace.stepPC = machine.cpu.registers.PC;
+    frameDone = machine.step();
+
+    bool referenceDone = false;
+    while (reference.cycles < machine.cycles)
+    {
+        trace.pcs[trace.instructions++ % HISTORY_LENGTH] = reference.cpu.registers.PC;
+        referenceDone = reference.step() || referenceDone;
+    }
+    return frameDone == referenceDone && sameMachines(machine, reference, compareFlags);
+}
+
+static bool stepFrame(Machine& machine, Machine& reference, bool compareFlags, LockstepTrace& trace)
+{
+    bool frameDone = false;
+    while (!frameDone)
+    {
+        if (!stepBoth(machine, reference, compareFlags, trace, frameDone))
+            return false;
+    }
+    return machine.stateHash() == reference.stateHash();
+}
+
+static void printMachine(const char* name, const Machine& machine)
+{
+    const CPU& cpu = machine.cpu;
+    qWarning("%-12s PC=%04X SP=%04X A=%02X BC=%04X DE=%04X HL=%04X flags=%02X IE=%d cycles=%llu", name,
+             cpu.registers.PC, cpu.registers.SP, cpu.registers.A, cpu.registers.BC, cpu.registers.DE,
+             cpu.registers.HL, cpu.conditionBits.getRegister(), cpu.interruptsEnabled,
+             (unsigned long long) machine.cycles);
+}
+
+static void reportDivergence(const LockstepSession& session, const Engines& engines, const Machine& machine,
+                             const Machine& reference, const LockstepTrace& trace)
+{
+    qWarning("Session with seed %llu diverged in frame %llu with engines %s, in the step from %04X.",
+             (unsigned long long) session.seed, (unsigned long long) reference.frame,
+             qPrintable(engineNames(engines)), trace.stepPC);
+
+    // The instructions of that step are marked
+    uint64_t stepLength = trace.instructions - trace.stepStart;
+    uint64_t shownFromStep = qMin<uint64_t>(stepLength, STEP_LINES);
+    uint64_t contextStart = trace.stepStart - qMin<uint64_t>(trace.stepStart, CONTEXT_LINES);
+    if (trace.instructions - contextStart > HISTORY_LENGTH)
+        contextStart = trace.stepStart;
+    for (uint64_t i = contextStart; i < trace.stepStart; ++i)
+        qWarning("  %s", qPrintable(disassemble(reference.cpu, trace.pcs[i % HISTORY_LENGTH])));
+    if (shownFromStep < stepLength)
+        qWarning("> ... %llu instructions", (unsigned long long) (stepLength - shownFromStep));
+    for (uint64_t i = trace.instructions - shownFromStep; i < trace.instructions; ++i)
+        qWarning("> %s", qPrintable(disassemble(reference.cpu, trace.pcs[i % HISTORY_LENGTH])));
+
+    printMachine("Engines:", machine);
+    printMachine("Interpreter:", reference);
+
+    for (int i = 0; i < RAM_SIZE; ++i)
+    {
+        if (machine.ram()[i] != reference.ram()[i])
+        {
+            qWarning("RAM differs first at %04X, %02X instead of %02X.", RAM_START + i, machine.ram()[i],
+                     reference.ram()[i]);
+            break;
+        }
+    }
+}
+
+static void runSession(LockstepSession& session, const Engines& engines, bool everyStep, QAtomicInt& diverged)
+{
+    Machine machine;
+    Machine reference;
+    machine.loadRom();
+    reference.loadRom();
+    setEngines(machine, engines);
+    setEngines(reference, NO_ENGINES);
+
+    bool compareFlags = !engines.flagLiveness;
+    LockstepTrace trace;
+    trace.instructions = 0;
+    MachineSnapshot frameStart;
+
+    for (; session.framesPlayed < session.frames; ++session.framesPlayed)
+    {
+        // One divergence is enough, the report of the first one would scroll away
+        if (diverged.loadAcquire())
+            return;
+
+        randomInputs(session.seed, machine.frame, machine.cpu.input1, machine.cpu.input2);
+        reference.cpu.input1 = machine.cpu.input1;
+        reference.cpu.input2 = machine.cpu.input2;
+
+        bool matched;
+        if (everyStep)
+            matched = stepFrame(machine, reference, compareFlags, trace);
+        else
+        {
+            machine.saveSnapshot(frameStart);
+            machine.runFrame();
+            reference.runFrame();
+            matched = machine.cycles == reference.cycles && machine.stateHash() == reference.stateHash();
+
+            // Both started the frame in this state, go through it again to see where they part
+            if (!matched)
+            {
+                machine.loadSnapshot(frameStart);
+                reference.loadSnapshot(frameStart);
+                stepFrame(machine, reference, compareFlags, trace);
+            }
+        }
+
+        if (!matched)
+        {
+            session.passed = false;
+            if (diverged.testAndSetOrdered(0, 1))
+                reportDivergence(session, engines, machine, reference, trace);
+            return;
+        }
+    }
+}
+
+bool runLockstep(const Engines& engines, uint64_t frames, bool everyStep, uint64_t seed, int threads)
+{
+    Engines available = engines;
+    Machine probe;
+    probe.loadRom();
+    if (!setEngines(probe, engines))
+    {
+        qWarning("This build has no native core, comparing without it.");
+        available.nativeCore = false;
+    }
+
+    if (threads > 0)
+        QThreadPool::globalInstance()->setMaxThreadCount(threads);
+    int sessionCount = QThreadPool::globalInstance()->maxThreadCount();
+
+    // Each session plays its own games, together they play the frames asked for
+    QVector<LockstepSession> sessions(sessionCount);
+    for (int i = 0; i < sessions.size(); ++i)
+    {
+        sessions[i].seed = seed + i;
+        sessions[i].frames = frames / sessionCount + ((uint64_t) i < frames % sessionCount);
+        sessions[i].framesPlayed = 0;
+        sessions[i].passed = true;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QAtomicInt diverged(0);
+    QtConcurrent::blockingMap(sessions, [&](LockstepSession& session) {
+        runSession(session, available, everyStep, diverged);
+    });
+
+    bool passed = true;
+    uint64_t framesPlayed = 0;
+    for (int i = 0; i < sessions.size(); ++i)
+    {
+        passed = passed && sessions[i].passed;
+        framesPlayed += sessions[i].framesPlayed;
+    }
+
+    double seconds = timer.nsecsElapsed() / 1e9;
+    if (passed)
+        qDebug("%llu frames with engines %s matched the interpreter %s in %d sessions in %.2f s, %.0f frames per second.",
+               (unsigned long long) framesPlayed, qPrintable(engineNames(available)),
+               everyStep ? "after every step" : "after every frame", sessionCount, seconds, framesPlayed / seconds);
+    else
+        qWarning("Engines %s diverged from the interpreter, the sessions stopped after %llu matching frames in %.2f s.",
+                 qPrintable(engineNames(available)), (unsigned long long) framesPlayed, seconds);
+    return passed;
+}
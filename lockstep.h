@@ -0,0 +1,30 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdint.h>
+#include <QString>
+#include "machine.h"
+
+// The faster ways a Machine can run the ROM. Each of them has to give exactly the results
+// of plain interpretation.
+struct Engines
+{
+    bool nativeCore;
+    bool flagLiveness;
+    bool fusion;
+    bool hle;
+};
+
+// A comma separated list of native, liveness, fusion and hle, or all or none
+bool parseEngines(const QString& list, Engines& engines);
+
+// Returns false if the native core was asked for but this build has none
+bool setEngines(Machine& machine, const Engines& engines);
+
+// Plays random games on a machine with the given engines and on a plain interpreter side by
+// side, one session per thread, and compares them after every frame. With everyStep they are
+// also compared after every step, otherwise a frame that ends differently is replayed step by
+// step to find where. The first divergence is reported with the instructions that led to it.
+bool runLockstep(const Engines& engines, uint64_t frames, bool everyStep, uint64_t seed, int threads);
+
+#endif // LOCKSTEP_H
@@ -0,0 +1,280 @@
+#include "machine.h"
+#include "hash.h"
+#include "nativecore.h"
+#include <QFile>
+#include <QDebug>
+#include <new>
+
+Machine::Machine() : frame(0), cycles(0), interruptsDelivered(0), interruptsRetried(0), cyclesTillEvent(CYCLES_PER_INTERRUPT), vblank(true), nativeBlockTable(0), deadFlags(0), fusedSequences(0), hleHooks(0)
+{
+}
+
+void* Machine::operator new(size_t size)
+{
+    void* memory = qMallocAligned(size, alignof(Machine));
+    if (!memory)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void Machine::operator delete(void* memory)
+{
+    qFreeAligned(memory);
+}
+
+// The ROM is mapped once per process and shared read-only by every machine, together with
+// what is known about it statically
+struct SharedRom
+{
+    QFile file;
+    QByteArray copy;
+    const uint8_t* data;
+    uint8_t deadFlags[MEMORY_SIZE];
+    const FusedSequence* fusedSequences[ROM_SIZE];
+    const HleHook* hleHooks[ROM_SIZE];
+
+    SharedRom() : file(ROM_FILE_PATH), data(0)
+    {
+        if (!file.open(QIODevice::ReadOnly))
+            qFatal("Could not open rom file.");
+        Q_ASSERT(file.size() == ROM_SIZE);
+
+        data = file.map(0, ROM_SIZE);
+        if (!data)
+        {
+            // Compressed resources can't be mapped, keep one copy instead
+            copy = file.readAll();
+            data = reinterpret_cast<const uint8_t*>(copy.constData());
+        }
+
+        analyzeFlagLiveness(data, deadFlags);
+        findFusedSequences(data, fusedSequences);
+        installHleHooks(data, hleHooks);
+    }
+};
+
+// Initialized once, thread safe
+static const SharedRom& sharedRom()
+{
+    static const SharedRom rom;
+    return rom;
+}
+
+void Machine::loadRom()
+{
+    cpu.setRom(sharedRom().data);
+    setNativeCore(true);
+    setFlagLiveness(true);
+    setFusion(true);
+    setHle(true);
+}
+
+// Runs until the end of screen interrupt has been delivered
+void Machine::runFrame()
+{
+#ifdef WATCHPOINTS
+    // Breakpoints are checked once PC got there, so resuming from one runs its instruction
+    Watchpoints& watched = cpu.memoryPolicy.watchpoints;
+    bool frameDone = false;
+    while (!frameDone && !watched.hasHit())
+    {
+        frameDone = step();
+        watched.execute(cpu.registers.PC);
+    }
+#else
+    while (!step())
+        ;
+#endif
+}
+
+Watchpoints* Machine::watchpoints()
+{
+#ifdef WATCHPOINTS
+    return &cpu.memoryPolicy.watchpoints;
+#else
+    return 0;
+#endif
+}
+
+const Watchpoints* Machine::watchpoints() const
+{
+#ifdef WATCHPOINTS
+    return &cpu.memoryPolicy.watchpoints;
+#else
+    return 0;
+#endif
+}
+
+bool Machine::setNativeCore(bool enabled)
+{
+    nativeBlockTable = enabled ? nativeBlocks(cpu.readPages[0]) : 0;
+    return nativeBlockTable != 0;
+}
+
+bool Machine::nativeCore() const
+{
+    return nativeBlockTable != 0;
+}
+
+void Machine::setFlagLiveness(bool enabled)
+{
+    deadFlags = enabled ? sharedRom().deadFlags : 0;
+    cpu.deadFlags = NO_DEAD_FLAGS;
+}
+
+bool Machine::flagLiveness() const
+{
+    return deadFlags != 0;
+}
+
+void Machine::setFusion(bool enabled)
+{
+    fusedSequences = enabled ? sharedRom().fusedSequences : 0;
+}
+
+bool Machine::fusion() const
+{
+    return fusedSequences != 0;
+}
+
+void Machine::setHle(bool enabled)
+{
+    hleHooks = enabled ? sharedRom().hleHooks : 0;
+}
+
+bool Machine::hle() const
+{
+    return hleHooks != 0;
+}
+
+// Runs a whole block if there is one at PC and the next interrupt isn't due before its end,
+// otherwise interprets
+int Machine::runNative()
+{
+    uint16_t pc = cpu.registers.PC;
+    if (pc < ROM_SIZE)
+    {
+        const NativeBlock* block = nativeBlockTable[pc];
+        if (block && block->cyclesBeforeLast < cyclesTillEvent)
+        {
+            selectDeadFlags(block->cyclesBeforeLast + MAX_INSTRUCTION_CYCLES);
+            return block->run(cpu);
+        }
+    }
+    return interpret();
+}
+
+uint8_t* Machine::ram()
+{
+    return cpu.ram;
+}
+
+const uint8_t* Machine::ram() const
+{
+    return cpu.ram;
+}
+
+const uint8_t* Machine::videoRam() const
+{
+    return cpu.ram + VIDEO_RAM_START - RAM_START;
+}
+
+uint64_t Machine::videoHash() const
+{
+    return hashBytes(videoRam(), VIDEO_RAM_SIZE);
+}
+
+void Machine::saveState(MachineState& state) const
+{
+    state.registers = cpu.registers;
+    state.flags = cpu.conditionBits.getRegister();
+    state.interruptsEnabled = cpu.interruptsEnabled;
+
+    state.inputs[0] = cpu.input0;
+    state.inputs[1] = cpu.input1;
+    state.inputs[2] = cpu.input2;
+    state.inputs[3] = cpu.input3;
+
+    state.outputs[0] = cpu.output2;
+    state.outputs[1] = cpu.output3;
+    state.outputs[2] = cpu.output4;
+    state.outputs[3] = cpu.output5;
+    state.outputs[4] = cpu.output6;
+    state.shiftRegister = cpu.shiftRegister;
+
+    state.frame = frame;
+    state.cycles = cycles;
+    state.cyclesTillEvent = cyclesTillEvent;
+    state.vblank = vblank;
+}
+
+void Machine::loadState(const MachineState& state)
+{
+    cpu.registers = state.registers;
+    cpu.conditionBits = FlagRegister(state.flags);
+    cpu.interruptsEnabled = state.interruptsEnabled;
+
+    cpu.input0 = state.inputs[0];
+    cpu.input1 = state.inputs[1];
+    cpu.input2 = state.inputs[2];
+    cpu.input3 = state.inputs[3];
+
+    cpu.output2 = state.outputs[0];
+    cpu.output3 = state.outputs[1];
+    cpu.output4 = state.outputs[2];
+    cpu.output5 = state.outputs[3];
+    cpu.output6 = state.outputs[4];
+    cpu.shiftRegister = state.shiftRegister;
+
+    frame = state.frame;
+    cycles = state.cycles;
+    cyclesTillEvent = state.cyclesTillEvent;
+    vblank = state.vblank;
+
+    // RAM is restored before the state, by the caller or by loadSnapshot()
+    cpu.rehashMemory();
+}
+
+void Machine::saveSnapshot(MachineSnapshot& snapshot) const
+{
+    saveState(snapshot.state);
+    memcpy(snapshot.ram, ram(), RAM_SIZE);
+}
+
+void Machine::loadSnapshot(const MachineSnapshot& snapshot)
+{
+    memcpy(ram(), snapshot.ram, RAM_SIZE);
+    loadState(snapshot.state);
+}
+
+// The frame and cycle counters are left out, they don't influence what the machine does next
+static uint64_t combineStateHash(const MachineState& state, uint64_t ramHash)
+{
+    // Field by field, the padding in the structs is undefined
+    uint8_t fields[] = {
+        state.registers.A, state.registers.B, state.registers.C, state.registers.D,
+        state.registers.E, state.registers.H, state.registers.L,
+        (uint8_t) state.registers.PC, (uint8_t) (state.registers.PC >> 8),
+        (uint8_t) state.registers.SP, (uint8_t) (state.registers.SP >> 8),
+        state.flags, state.interruptsEnabled,
+        state.inputs[0], state.inputs[1], state.inputs[2], state.inputs[3],
+        state.outputs[0], state.outputs[1], state.outputs[2], state.outputs[3], state.outputs[4],
+        (uint8_t) state.shiftRegister, (uint8_t) (state.shiftRegister >> 8),
+        state.vblank
+    };
+
+    uint64_t hash = hashBytes(fields, sizeof(fields), ramHash);
+    return hashBytes(reinterpret_cast<const uint8_t*>(&state.cyclesTillEvent), sizeof(state.cyclesTillEvent), hash);
+}
+
+uint64_t snapshotHash(const MachineSnapshot& snapshot)
+{
+    return combineStateHash(snapshot.state, memoryHash(snapshot.ram, RAM_START, RAM_SIZE));
+}
+
+uint64_t Machine::stateHash() const
+{
+    MachineState state;
+    saveState(state);
+    return combineStateHash(state, cpu.memoryHash);
+}
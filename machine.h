@@ -0,0 +1,211 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <stdint.h>
+#include "cpu.h"
+#include "flagliveness.h"
+#include "fusion.h"
+#include "hle.h"
+#include "trace.h"
+
+struct NativeBlock;
+
+#define ROM_FILE_PATH ":/roms/invaders"
+
+const int CPU_FREQ = 2000000;
+const int FRAME_RATE = 60;
+
+// The video hardware interrupts twice per frame, mid-screen and at vblank
+const int CYCLES_PER_INTERRUPT = CPU_FREQ / FRAME_RATE / 2;
+
+const int SCREEN_WIDTH_BYTES = 32;
+const int SCREEN_HEIGHT_BYTES = 28;
+
+const int SCREEN_WIDTH_PIXELS = 256;
+const int SCREEN_HEIGHT_PIXELS = 224;
+
+// Everything apart from RAM that is needed to resume the machine exactly
+struct MachineState
+{
+    CPU::dataRegisters registers;
+    uint8_t flags;
+    bool interruptsEnabled;
+
+    uint8_t inputs[4];
+    uint8_t outputs[5]; // Ports 2 to 6
+    uint16_t shiftRegister;
+
+    uint64_t frame;
+    uint64_t cycles;
+    int cyclesTillEvent;
+    bool vblank;
+};
+
+// A complete copy of the machine, cheap enough to take several times per frame
+struct MachineSnapshot
+{
+    MachineState state;
+    uint8_t ram[RAM_SIZE];
+};
+
+// Hash of everything in a snapshot, two machines with the same hash run the
+// same from there on. Matches Machine::stateHash() of the machine it was taken from.
+uint64_t snapshotHash(const MachineSnapshot&);
+
+// The arcade board on its own, without any window, sound or timing. Everything
+// runs on the calling thread as fast as the host allows.
+class Machine
+{
+public:
+    Machine();
+
+    // The CPU is aligned to a cache line, which plain new only honours from C++17 on
+    static void* operator new(size_t size);
+    static void operator delete(void* memory);
+
+    CPU cpu;
+
+    uint64_t frame; // Number of completed frames
+    uint64_t cycles;
+
+    // Only counted for the metrics. They aren't part of the state, so whoever throws frames away
+    // by loading a snapshot has to put them back, see Emulator::runAhead().
+    uint64_t interruptsDelivered;
+    uint64_t interruptsRetried; // While interrupts were disabled
+
+    void loadRom();
+    void runFrame();
+
+    // Null unless the CPU was built with CONFIG+=watchpoints. While one has been hit runFrame()
+    // returns right after the instruction, see watchpoints.h.
+    Watchpoints* watchpoints();
+    const Watchpoints* watchpoints() const;
+
+    // Runs one instruction or native block and delivers the interrupt if one is due. Returns
+    // true once the frame is complete.
+    bool step();
+
+    // Runs the blocks of the ROM that were compiled ahead of time instead of interpreting
+    // them, with exactly the same results. On by default after loadRom(), returns false if
+    // the build has none for this ROM.
+    bool setNativeCore(bool enabled);
+    bool nativeCore() const;
+
+    // Skips computing flags the ROM overwrites before reading them, see flagliveness.h. On by
+    // default after loadRom(), the state at interrupts and frame ends is the same either way.
+    void setFlagLiveness(bool enabled);
+    bool flagLiveness() const;
+
+    // Runs common instruction sequences of the ROM as one superinstruction, see fusion.h.
+    // On by default after loadRom(), can be turned off to compare against plain interpretation.
+    void setFusion(bool enabled);
+    bool fusion() const;
+
+    // Runs the ROM's memory copy and clear loops natively, see hle.h. On by default after
+    // loadRom(), with exactly the same results.
+    void setHle(bool enabled);
+    bool hle() const;
+
+    uint8_t* ram();
+    const uint8_t* ram() const;
+    const uint8_t* videoRam() const;
+    uint64_t videoHash() const;
+
+    // Costs the same no matter how much RAM changed, the RAM part is kept up to date on every write
+    uint64_t stateHash() const;
+
+    void saveState(MachineState&) const;
+    void loadState(const MachineState&);
+
+    void saveSnapshot(MachineSnapshot&) const;
+    void loadSnapshot(const MachineSnapshot&);
+
+private:
+    int cyclesTillEvent;
+    bool vblank;
+
+    const NativeBlock* const* nativeBlockTable;
+    const uint8_t* deadFlags; // Null while flag liveness is off
+    const FusedSequence* const* fusedSequences; // Null while fusion is off
+    const HleHook* const* hleHooks; // Null while HLE is off
+
+    int runNative();
+    int interpret();
+    int runHook();
+    void selectDeadFlags(int cyclesAhead);
+};
+
+// The interrupt handler pushes the flags, so the dead ones may only be skipped if every
+// instruction that overwrites them runs before the next interrupt can be taken
+inline void Machine::selectDeadFlags(int cyclesAhead)
+{
+    bool safe = deadFlags && cyclesAhead + FLAG_LIVENESS_WINDOW_CYCLES < cyclesTillEvent;
+    cpu.deadFlags = safe ? deadFlags : NO_DEAD_FLAGS;
+}
+
+// One instruction, or a fused sequence if one starts at PC and ends before the next interrupt
+// is due, so interrupts still arrive between the same instructions
+inline int Machine::interpret()
+{
+    uint16_t pc = cpu.registers.PC;
+    if (fusedSequences && pc < ROM_SIZE)
+    {
+        const FusedSequence* sequence = fusedSequences[pc];
+        int cyclesBeforeLast = sequence ? (sequence->length - 1) * MAX_INSTRUCTION_CYCLES : 0;
+        if (sequence && cyclesBeforeLast < cyclesTillEvent)
+        {
+            selectDeadFlags(cyclesBeforeLast + MAX_INSTRUCTION_CYCLES);
+            return sequence->run(cpu);
+        }
+    }
+
+    selectDeadFlags(0);
+    return cpu.runNextInstruction();
+}
+
+// Returns 0 if there is no hook at PC or it couldn't run before the next interrupt
+inline int Machine::runHook()
+{
+    uint16_t pc = cpu.registers.PC;
+    const HleHook* hook = hleHooks && pc < ROM_SIZE ? hleHooks[pc] : 0;
+    return hook ? hook->run(cpu, *hook, cyclesTillEvent) : 0;
+}
+
+// Inline so runFrame() keeps the whole loop in one function
+inline bool Machine::step()
+{
+    int instructionCycles = runHook();
+    if (!instructionCycles)
+        instructionCycles = nativeBlockTable ? runNative() : interpret();
+    cycles += instructionCycles;
+    cyclesTillEvent -= instructionCycles;
+
+    if (cyclesTillEvent <= 0)
+    {
+        // Interrupts may be disabled, in that case try again after the next instruction
+        bool interruptSuccess;
+        if (vblank)
+            interruptSuccess = cpu.generateInterrupt(RST_1_OPCODE);
+        else
+            interruptSuccess = cpu.generateInterrupt(RST_2_OPCODE);
+
+        if (interruptSuccess)
+        {
+            traceInstant("Interrupt", vblank ? 1 : 2); // The RST number
+            ++interruptsDelivered;
+            vblank = !vblank;
+            cyclesTillEvent = CYCLES_PER_INTERRUPT;
+
+            if (vblank)
+            {
+                ++frame;
+                return true;
+            }
+        }
+        else
+            ++interruptsRetried;
+    }
+    return false;
+}
+
+#endif // MACHINE_H
@@ -1,17 +1,75 @@
-#include <QApplication>
 #include <QDebug>
+
+#include "options.h"
+#include "trace.h"
+
+#ifdef HEADLESS
+#include <QCoreApplication>
+#include "emulator.h"
+#include "capture.h"
+#include "cputest.h"
+#include "hle.h"
+#include "lockstep.h"
+#include "movie.h"
+#include "netplay.h"
+#else
+#include <QApplication>
 #include <QLabel>
 #include <QPushButton>
 #include <QHBoxLayout>
-
 #include "gui.h"
+#endif
 
 int main(int argc, char** argv)
 {
+#ifdef HEADLESS
+    QCoreApplication app(argc, argv);
+    Options options = parseOptions(app);
+
+    if (!options.replayFile.isEmpty())
+        return replayMovie(options.replayFile, options.replayFrom, options.watchList) ? 0 : 1;
+    if (!options.verifyFile.isEmpty())
+        return verifyMovie(options.verifyFile, options.threads) ? 0 : 1;
+    if (options.lockstepFrames > 0)
+    {
+        Engines engines;
+        if (!parseEngines(options.lockstepEngines, engines))
+            return 1;
+        return runLockstep(engines, options.lockstepFrames, options.lockstepEveryStep, options.lockstepSeed, options.threads) ? 0 : 1;
+    }
+    if (options.verifyHleTrials > 0)
+        return verifyHleHooks(options.verifyHleTrials) ? 0 : 1;
+    if (!options.cpuTestFiles.isEmpty())
+        return runCpuTests(options.cpuTestFiles) ? 0 : 1;
+    if (!options.convertCaptureFile.isEmpty())
+        return convertCapture(options.convertCaptureFile, options.convertOutputFile) ? 0 : 1;
+    if (options.netplayTestFrames > 0)
+        return runNetplayLoopback(options.netplayTestFrames, options.netplayDelay, options.netplayLoss) ? 0 : 1;
+
+    if (!options.traceFile.isEmpty())
+        startTracing();
+
+    Emulator emu(options);
+    QObject::connect(&emu, SIGNAL(finished()), &app, SLOT(quit()));
+    emu.start();
+
+    int result = app.exec();
+    if (!options.traceFile.isEmpty())
+        writeTrace(options.traceFile);
+    return result;
+#else
     QApplication app(argc, argv);
+    Options options = parseOptions(app);
+
+    if (!options.traceFile.isEmpty())
+        startTracing();
 
-    GUI window;
+    GUI window(options);
     window.show();
 
-    return app.exec();
+    int result = app.exec();
+    if (!options.traceFile.isEmpty())
+        writeTrace(options.traceFile);
+    return result;
+#endif
 }
@@ -0,0 +1,214 @@
+#include "metrics.h"
+#include <QSaveFile>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QDebug>
+
+const qint64 HISTOGRAM_FIRST_BOUND_NSECS = 1000;
+const qint64 MHZ_INTERVAL_NSECS = 1000000000LL;
+
+const int METRICS_POLL_MSECS = 100;
+const int METRICS_FILE_INTERVAL_MSECS = 1000;
+
+// A scraper that doesn't finish its request within this is dropped
+const int HTTP_TIMEOUT_MSECS = 1000;
+const int HTTP_MAX_REQUEST = 8192;
+
+static const char* const STAGE_NAMES[NUM_FRAME_STAGES] =
+{
+    "emulation",
+    "vram_to_screen",
+    "transform",
+    "queued_signal",
+    "from_image"
+};
+
+Histogram::Histogram() : sum(0)
+{
+    for (std::atomic<uint64_t>& bucket : buckets)
+        bucket.store(0);
+}
+
+void Histogram::record(qint64 nsecs)
+{
+    int bucket = 0;
+    while (bucket < HISTOGRAM_BUCKETS - 1 && nsecs > HISTOGRAM_FIRST_BOUND_NSECS << bucket)
+        ++bucket;
+
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(nsecs, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::bucketCount(int bucket) const
+{
+    return buckets[bucket].load(std::memory_order_relaxed);
+}
+
+qint64 Histogram::sumNsecs() const
+{
+    return sum.load(std::memory_order_relaxed);
+}
+
+FrameMetrics::FrameMetrics()
+    : frameCount(0), cycleCount(0), mhz(0), delivered(0), retried(0), screensEmitted(0), emitTime(0), dropped(0),
+      screensShown(0), mhzCycles(0), mhzStart(0)
+{
+    clock.start();
+}
+
+void FrameMetrics::frameEmulated(uint64_t cyclesRun, uint64_t interruptsDelivered, uint64_t interruptsRetried)
+{
+    frameCount.fetch_add(1, std::memory_order_relaxed);
+    uint64_t cycles = cycleCount.fetch_add(cyclesRun, std::memory_order_relaxed) + cyclesRun;
+    delivered.store(interruptsDelivered, std::memory_order_relaxed);
+    retried.store(interruptsRetried, std::memory_order_relaxed);
+
+    qint64 time = now();
+    if (time - mhzStart >= MHZ_INTERVAL_NSECS)
+    {
+        mhz.store((cycles - mhzCycles) * 1000.0 / (time - mhzStart), std::memory_order_relaxed);
+        mhzCycles = cycles;
+        mhzStart = time;
+    }
+}
+
+void FrameMetrics::screenEmitted()
+{
+    emitTime.store(now(), std::memory_order_relaxed);
+    screensEmitted.fetch_add(1, std::memory_order_release);
+}
+
+void FrameMetrics::screenShown()
+{
+    uint64_t emitted = screensEmitted.load(std::memory_order_acquire);
+    qint64 shownTime = now();
+
+    // The other signals that piled up meanwhile show the same screen again
+    if (emitted <= screensShown)
+        return;
+
+    record(STAGE_QUEUED_SIGNAL, shownTime - emitTime.load(std::memory_order_relaxed));
+    dropped.fetch_add(emitted - screensShown - 1, std::memory_order_relaxed);
+    screensShown = emitted;
+}
+
+static void appendMetric(QByteArray& text, const char* name, const char* type, const char* help, const QByteArray& value)
+{
+    text += QByteArray("# HELP ") + name + " " + help + "\n";
+    text += QByteArray("# TYPE ") + name + " " + type + "\n";
+    text += QByteArray(name) + " " + value + "\n";
+}
+
+QByteArray FrameMetrics::toPrometheus() const
+{
+    QByteArray text;
+    const char* histogram = "invaders_frame_stage_seconds";
+    text += QByteArray("# HELP ") + histogram + " Time spent in each stage of a frame.\n";
+    text += QByteArray("# TYPE ") + histogram + " histogram\n";
+    for (int i = 0; i < NUM_FRAME_STAGES; ++i)
+    {
+        const Histogram& durations = stages[i];
+        QByteArray label = QByteArray("stage=\"") + STAGE_NAMES[i] + "\"";
+
+        // Buckets are cumulative in the format
+        uint64_t count = 0;
+        for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket)
+        {
+            count += durations.bucketCount(bucket);
+            QByteArray bound = bucket < HISTOGRAM_BUCKETS - 1
+                ? QByteArray::number((HISTOGRAM_FIRST_BOUND_NSECS << bucket) / 1e9, 'g', 6) : QByteArray("+Inf");
+            text += QByteArray(histogram) + "_bucket{" + label + ",le=\"" + bound + "\"} " + QByteArray::number(quint64(count)) + "\n";
+        }
+        text += QByteArray(histogram) + "_sum{" + label + "} " + QByteArray::number(durations.sumNsecs() / 1e9, 'g', 9) + "\n";
+        text += QByteArray(histogram) + "_count{" + label + "} " + QByteArray::number(quint64(count)) + "\n";
+    }
+
+    appendMetric(text, "invaders_frames_total", "counter", "Frames emulated.", QByteArray::number(quint64(frames())));
+    appendMetric(text, "invaders_frames_dropped_total", "counter",
+                 "Screens replaced before the GUI thread could show them.", QByteArray::number(quint64(framesDropped())));
+    appendMetric(text, "invaders_emulated_cycles_total", "counter", "8080 cycles emulated.", QByteArray::number(quint64(cycles())));
+    appendMetric(text, "invaders_emulated_mhz", "gauge", "Emulated clock rate over the last second.",
+                 QByteArray::number(emulatedMhz(), 'f', 3));
+    appendMetric(text, "invaders_interrupts_delivered_total", "counter", "Video interrupts taken by the CPU.",
+                 QByteArray::number(quint64(interruptsDelivered())));
+    appendMetric(text, "invaders_interrupts_retried_total", "counter",
+                 "Instructions after which a due interrupt had to wait because interrupts were disabled.",
+                 QByteArray::number(quint64(interruptsRetried())));
+    return text;
+}
+
+MetricsExporter::MetricsExporter(const FrameMetrics& metrics, quint16 port, const QString& fileName)
+    : metrics(metrics), port(port), fileName(fileName)
+{
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    requestInterruption();
+    wait();
+    if (!fileName.isEmpty())
+        writeFile();
+}
+
+void MetricsExporter::run()
+{
+    QTcpServer server;
+    if (port && !server.listen(QHostAddress::LocalHost, port))
+        qWarning("Could not serve metrics on port %d: %s", port, qPrintable(server.errorString()));
+
+    QElapsedTimer fileTimer;
+    fileTimer.start();
+
+    while (!isInterruptionRequested())
+    {
+        if (!fileName.isEmpty() && fileTimer.elapsed() >= METRICS_FILE_INTERVAL_MSECS)
+        {
+            writeFile();
+            fileTimer.restart();
+        }
+
+        if (!server.isListening())
+            QThread::msleep(METRICS_POLL_MSECS);
+        else if (server.waitForNewConnection(METRICS_POLL_MSECS))
+        {
+            QTcpSocket* socket = server.nextPendingConnection();
+            serve(*socket);
+            delete socket;
+        }
+    }
+}
+
+// Just enough HTTP for a scraper or curl, one request per connection
+void MetricsExporter::serve(QTcpSocket& socket)
+{
+    QByteArray request;
+    while (!request.contains("\r\n\r\n") && request.size() < HTTP_MAX_REQUEST)
+    {
+        if (!socket.waitForReadyRead(HTTP_TIMEOUT_MSECS))
+            return;
+        request += socket.readAll();
+    }
+
+    QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+    bool found = requestLine.size() == 3 && requestLine[0] == "GET" && requestLine[1] == "/metrics";
+
+    QByteArray body = found ? metrics.toPrometheus() : QByteArray("Not found, the metrics are at /metrics.\n");
+    QByteArray response = found ? "HTTP/1.0 200 OK\r\n" : "HTTP/1.0 404 Not Found\r\n";
+    response += "Content-Type: text/plain; version=0.0.4\r\n";
+    response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    response += "Connection: close\r\n\r\n";
+    socket.write(response + body);
+    socket.waitForBytesWritten(HTTP_TIMEOUT_MSECS);
+    socket.disconnectFromHost();
+}
+
+// Replaced in one step, a reader never sees half of it
+void MetricsExporter::writeFile()
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(metrics.toPrometheus()) < 0 || !file.commit())
+    {
+        qWarning("Could not write the metrics to %s, giving up on the file.", qPrintable(fileName));
+        fileName.clear();
+    }
+}
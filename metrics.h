@@ -0,0 +1,115 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <QThread>
+#include <atomic>
+
+class QTcpSocket;
+
+// Where the time of a frame goes, from the emulation thread to the screen
+enum FrameStage
+{
+    STAGE_EMULATION,      // Running the frame, and the run-ahead frames
+    STAGE_VRAM_TO_SCREEN, // Drawing video RAM into the image
+    STAGE_TRANSFORM,      // QImage::transformed() rotating and scaling it
+    STAGE_QUEUED_SIGNAL,  // From emitting screenUpdated() until the GUI thread gets to it
+    STAGE_FROM_IMAGE,     // QPixmap::fromImage() in GUI::showScreen()
+    NUM_FRAME_STAGES
+};
+
+// Bucket i counts durations up to 1 µs << i, the last one everything slower
+const int HISTOGRAM_BUCKETS = 18;
+
+// Durations of one stage. Only one thread records them, others may read at any time.
+class Histogram
+{
+public:
+    Histogram();
+
+    void record(qint64 nsecs);
+
+    uint64_t bucketCount(int bucket) const;
+    qint64 sumNsecs() const;
+
+private:
+    std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+    std::atomic<qint64> sum;
+};
+
+// Timings and counters of the running emulator. The emulation thread and the GUI thread
+// each write their own parts, the exporter reads all of them.
+class FrameMetrics
+{
+public:
+    FrameMetrics();
+
+    // One clock for all threads, so times taken on different ones can be compared
+    qint64 now() const { return clock.nsecsElapsed(); }
+
+    void record(FrameStage stage, qint64 nsecs) { stages[stage].record(nsecs); }
+    const Histogram& stage(FrameStage stage) const { return stages[stage]; }
+
+    // Called by the emulation thread after every frame with the machine's counters
+    void frameEmulated(uint64_t cyclesRun, uint64_t interruptsDelivered, uint64_t interruptsRetried);
+
+    // The screen of a frame was handed to the GUI thread, which may already have fallen behind
+    void screenEmitted();
+
+    // Called by the GUI thread when it shows the screen. Screens emitted since the last call
+    // that were replaced before it got to them are counted as dropped.
+    void screenShown();
+
+    uint64_t frames() const { return frameCount.load(std::memory_order_relaxed); }
+    uint64_t cycles() const { return cycleCount.load(std::memory_order_relaxed); }
+    double emulatedMhz() const { return mhz.load(std::memory_order_relaxed); }
+    uint64_t interruptsDelivered() const { return delivered.load(std::memory_order_relaxed); }
+    uint64_t interruptsRetried() const { return retried.load(std::memory_order_relaxed); }
+    uint64_t framesDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+    // Prometheus text exposition format
+    QByteArray toPrometheus() const;
+
+private:
+    QElapsedTimer clock;
+    Histogram stages[NUM_FRAME_STAGES];
+
+    std::atomic<uint64_t> frameCount;
+    std::atomic<uint64_t> cycleCount;
+    std::atomic<double> mhz; // Over the last second
+    std::atomic<uint64_t> delivered;
+    std::atomic<uint64_t> retried;
+
+    std::atomic<uint64_t> screensEmitted;
+    std::atomic<qint64> emitTime;
+    std::atomic<uint64_t> dropped;
+    uint64_t screensShown; // Only used by the GUI thread
+
+    // Only used by the emulation thread
+    uint64_t mhzCycles;
+    qint64 mhzStart;
+};
+
+// Serves the metrics at http://localhost:port/metrics and rewrites a file with them every
+// second, so they can be scraped or picked up by node_exporter's textfile collector. Either
+// can be left out with a port of 0 or an empty file name.
+class MetricsExporter : public QThread
+{
+public:
+    MetricsExporter(const FrameMetrics& metrics, quint16 port, const QString& fileName);
+    ~MetricsExporter(); // Writes the file a last time
+
+private:
+    const FrameMetrics& metrics;
+    quint16 port;
+    QString fileName;
+
+    void run();
+    void serve(QTcpSocket& socket);
+    void writeFile();
+};
+
+#endif // METRICS_H
@@ -0,0 +1,468 @@
+#include "movie.h"
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <QDebug>
+
+static void writeSnapshot(QDataStream& stream, const MachineSnapshot& snapshot)
+{
+    const MachineState& state = snapshot.state;
+    stream << state.registers.A << state.registers.B << state.registers.C << state.registers.D
+           << state.registers.E << state.registers.H << state.registers.L
+           << state.registers.PC << state.registers.SP
+           << state.flags << state.interruptsEnabled;
+    for (int i = 0; i < 4; ++i)
+        stream << state.inputs[i];
+    for (int i = 0; i < 5; ++i)
+        stream << state.outputs[i];
+    stream << state.shiftRegister << (quint64) state.frame << (quint64) state.cycles
+           << (qint32) state.cyclesTillEvent << state.vblank;
+    stream.writeRawData(reinterpret_cast<const char*>(snapshot.ram), RAM_SIZE);
+}
+
+static bool readSnapshot(QDataStream& stream, MachineSnapshot& snapshot)
+{
+    MachineState& state = snapshot.state;
+    quint64 frame, cycles;
+    qint32 cyclesTillEvent;
+    stream >> state.registers.A >> state.registers.B >> state.registers.C >> state.registers.D
+           >> state.registers.E >> state.registers.H >> state.registers.L
+           >> state.registers.PC >> state.registers.SP
+           >> state.flags >> state.interruptsEnabled;
+    for (int i = 0; i < 4; ++i)
+        stream >> state.inputs[i];
+    for (int i = 0; i < 5; ++i)
+        stream >> state.outputs[i];
+    stream >> state.shiftRegister >> frame >> cycles >> cyclesTillEvent >> state.vblank;
+    stream.readRawData(reinterpret_cast<char*>(snapshot.ram), RAM_SIZE);
+
+    state.frame = frame;
+    state.cycles = cycles;
+    state.cyclesTillEvent = cyclesTillEvent;
+    return stream.status() == QDataStream::Ok;
+}
+
+MovieRecorder::MovieRecorder() : hasInputs(false), lastInput1(0), lastInput2(0)
+{
+}
+
+bool MovieRecorder::open(const QString& fileName)
+{
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning("Could not open movie %s for writing.", qPrintable(fileName));
+        return false;
+    }
+
+    stream.setDevice(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << MOVIE_MAGIC << MOVIE_VERSION;
+
+    index.clear();
+    hasInputs = false;
+    return true;
+}
+
+void MovieRecorder::close()
+{
+    if (!file.isOpen())
+        return;
+
+    qint64 indexOffset = file.pos();
+    stream << MOVIE_INDEX_RECORD << (quint32) index.size();
+    for (int i = 0; i < index.size(); ++i)
+        stream << (quint64) index[i].frame << (quint64) index[i].offset;
+    stream << (quint64) indexOffset << MOVIE_INDEX_MAGIC;
+
+    file.close();
+}
+
+void MovieRecorder::recordKeyframe(const Machine& machine)
+{
+    if (!file.isOpen() || machine.frame % MOVIE_KEYFRAME_INTERVAL != 0)
+        return;
+
+    MovieKeyframe keyframe;
+    keyframe.frame = machine.frame;
+    keyframe.offset = file.pos();
+    index.append(keyframe);
+
+    MachineSnapshot snapshot;
+    machine.saveSnapshot(snapshot);
+    stream << MOVIE_KEYFRAME_RECORD;
+    writeSnapshot(stream, snapshot);
+}
+
+void MovieRecorder::recordInputs(uint64_t frame, uint8_t input1, uint8_t input2)
+{
+    if (!file.isOpen() || (hasInputs && input1 == lastInput1 && input2 == lastInput2))
+        return;
+
+    stream << MOVIE_INPUT_RECORD << (quint64) frame << (quint8) input1 << (quint8) input2;
+
+    hasInputs = true;
+    lastInput1 = input1;
+    lastInput2 = input2;
+}
+
+void MovieRecorder::recordFrame(uint64_t videoHash)
+{
+    if (file.isOpen())
+        stream << MOVIE_FRAME_RECORD << (quint64) videoHash;
+}
+
+MoviePlayer::MoviePlayer() : mapped(0), corrupt(false)
+{
+}
+
+MoviePlayer::~MoviePlayer()
+{
+    if (mapped)
+        file.unmap(mapped);
+}
+
+bool MoviePlayer::open(const QString& fileName)
+{
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning("Could not open movie %s.", qPrintable(fileName));
+        return false;
+    }
+
+    // Pages are only read when a record on them is needed, a seek touches little more than the index
+    mapped = file.map(0, file.size());
+    if (!mapped)
+    {
+        qWarning("Could not map movie %s.", qPrintable(fileName));
+        return false;
+    }
+
+    data = QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), file.size());
+    buffer.setBuffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    stream.setDevice(&buffer);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 magic;
+    quint16 version;
+    stream >> magic >> version;
+    if (magic != MOVIE_MAGIC || version < 1 || version > MOVIE_VERSION)
+    {
+        qWarning("%s is not a supported movie.", qPrintable(fileName));
+        return false;
+    }
+
+    corrupt = false;
+    readIndex();
+    return true;
+}
+
+// Version 1 movies and recordings that were cut short have no index, they can only be played from the start
+void MoviePlayer::readIndex()
+{
+    index.clear();
+
+    const int trailerSize = sizeof(quint64) + sizeof(quint32);
+    if (data.size() < trailerSize)
+        return;
+
+    qint64 start = buffer.pos();
+    buffer.seek(data.size() - trailerSize);
+
+    quint64 indexOffset;
+    quint32 magic;
+    stream >> indexOffset >> magic;
+    if (magic == MOVIE_INDEX_MAGIC && indexOffset < (quint64) data.size())
+    {
+        buffer.seek(indexOffset);
+
+        quint8 tag;
+        quint32 count;
+        stream >> tag >> count;
+        for (quint32 i = 0; i < count && tag == MOVIE_INDEX_RECORD && stream.status() == QDataStream::Ok; ++i)
+        {
+            quint64 frame, offset;
+            stream >> frame >> offset;
+
+            MovieKeyframe keyframe;
+            keyframe.frame = frame;
+            keyframe.offset = offset;
+            index.append(keyframe);
+        }
+
+        if (stream.status() != QDataStream::Ok)
+            index.clear();
+    }
+
+    stream.resetStatus();
+    buffer.seek(start);
+}
+
+bool MoviePlayer::readFrame(uint64_t frame, uint8_t& input1, uint8_t& input2, uint64_t& videoHash)
+{
+    while (!stream.atEnd())
+    {
+        quint8 tag;
+        stream >> tag;
+
+        if (tag == MOVIE_FRAME_RECORD)
+        {
+            quint64 hash;
+            stream >> hash;
+            videoHash = hash;
+            return stream.status() == QDataStream::Ok;
+        }
+
+        if (tag == MOVIE_INDEX_RECORD)
+            return false;
+
+        if (tag == MOVIE_KEYFRAME_RECORD)
+        {
+            // Playing on from a keyframe gives the same machine, there is nothing to apply
+            MachineSnapshot snapshot;
+            if (!readSnapshot(stream, snapshot) || snapshot.state.frame != frame)
+            {
+                corrupt = true;
+                return false;
+            }
+            continue;
+        }
+
+        quint64 inputFrame;
+        quint8 recordedInput1, recordedInput2;
+        stream >> inputFrame >> recordedInput1 >> recordedInput2;
+        if (tag != MOVIE_INPUT_RECORD || inputFrame != frame || stream.status() != QDataStream::Ok)
+        {
+            corrupt = true;
+            return false;
+        }
+
+        input1 = recordedInput1;
+        input2 = recordedInput2;
+    }
+
+    return false;
+}
+
+bool MoviePlayer::isCorrupt() const
+{
+    return corrupt;
+}
+
+bool MoviePlayer::seek(Machine& machine, uint64_t frame)
+{
+    int keyframe = index.size() - 1;
+    while (keyframe >= 0 && index[keyframe].frame > frame)
+        --keyframe;
+    if (keyframe < 0)
+    {
+        qWarning("Movie has no keyframe before frame %llu.", (unsigned long long) frame);
+        return false;
+    }
+
+    MachineSnapshot snapshot;
+    if (!readKeyframe(keyframe, snapshot))
+        return false;
+    machine.loadSnapshot(snapshot);
+
+    // The inputs in effect are part of the snapshot, later input records change them
+    uint8_t input1 = machine.cpu.input1;
+    uint8_t input2 = machine.cpu.input2;
+    uint64_t videoHash;
+    while (machine.frame < frame)
+    {
+        if (!readFrame(machine.frame, input1, input2, videoHash))
+            return false;
+
+        machine.cpu.input1 = input1;
+        machine.cpu.input2 = input2;
+        machine.runFrame();
+    }
+    return true;
+}
+
+const QVector<MovieKeyframe>& MoviePlayer::keyframes() const
+{
+    return index;
+}
+
+// Leaves the player right after the keyframe record
+bool MoviePlayer::readKeyframe(int keyframe, MachineSnapshot& snapshot)
+{
+    buffer.seek(index[keyframe].offset);
+
+    quint8 tag;
+    stream >> tag;
+    if (tag != MOVIE_KEYFRAME_RECORD || !readSnapshot(stream, snapshot) || snapshot.state.frame != index[keyframe].frame)
+    {
+        corrupt = true;
+        return false;
+    }
+    return true;
+}
+
+bool replayMovie(const QString& fileName, uint64_t startFrame, const WatchList& watchList)
+{
+    MoviePlayer player;
+    if (!player.open(fileName))
+        return false;
+
+    Machine machine;
+    machine.loadRom();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (startFrame > 0)
+    {
+        if (!player.seek(machine, startFrame))
+            return false;
+        qDebug("Seeked to frame %llu in %.2f ms.", (unsigned long long) startFrame, timer.nsecsElapsed() / 1e6);
+        timer.restart();
+    }
+
+    if (!watchList.isEmpty() && !setWatchpoints(machine, watchList))
+        return false;
+
+    uint8_t input1 = machine.cpu.input1;
+    uint8_t input2 = machine.cpu.input2;
+    uint64_t expectedHash;
+    while (player.readFrame(machine.frame, input1, input2, expectedHash))
+    {
+        machine.cpu.input1 = input1;
+        machine.cpu.input2 = input2;
+        if (!runFrameWatched(machine))
+        {
+            qWarning("Replay stopped at frame %llu.", (unsigned long long) machine.frame);
+            return false;
+        }
+
+        if (machine.videoHash() != expectedHash)
+        {
+            qWarning("Replay diverged on frame %llu.", (unsigned long long) machine.frame - 1);
+            return false;
+        }
+    }
+
+    if (player.isCorrupt())
+    {
+        qWarning("Movie is corrupt after frame %llu.", (unsigned long long) machine.frame);
+        return false;
+    }
+
+    uint64_t frames = machine.frame - startFrame;
+    double seconds = timer.nsecsElapsed() / 1e9;
+    qDebug("Replayed %llu frames (%.1f s of gameplay) in %.2f s, %.0f frames per second.",
+           (unsigned long long) frames, frames / (double) FRAME_RATE, seconds, frames / seconds);
+    return true;
+}
+
+struct MovieSegment
+{
+    int keyframe;
+    bool passed;
+    uint64_t frames;
+};
+
+static void verifySegment(const QString& fileName, MovieSegment& segment)
+{
+    segment.passed = false;
+    segment.frames = 0;
+
+    // Every worker maps the file itself, the pages are shared anyway
+    MoviePlayer player;
+    if (!player.open(fileName))
+        return;
+
+    const QVector<MovieKeyframe>& keyframes = player.keyframes();
+    bool last = segment.keyframe == keyframes.size() - 1;
+    uint64_t endFrame = last ? UINT64_MAX : keyframes[segment.keyframe + 1].frame;
+
+    Machine machine;
+    machine.loadRom();
+
+    MachineSnapshot snapshot;
+    if (!player.readKeyframe(segment.keyframe, snapshot))
+        return;
+    machine.loadSnapshot(snapshot);
+
+    uint8_t input1 = machine.cpu.input1;
+    uint8_t input2 = machine.cpu.input2;
+    uint64_t expectedHash;
+    while (machine.frame < endFrame && player.readFrame(machine.frame, input1, input2, expectedHash))
+    {
+        machine.cpu.input1 = input1;
+        machine.cpu.input2 = input2;
+        machine.runFrame();
+        ++segment.frames;
+
+        if (machine.videoHash() != expectedHash)
+        {
+            qWarning("Replay diverged on frame %llu.", (unsigned long long) machine.frame - 1);
+            return;
+        }
+    }
+
+    if (player.isCorrupt())
+    {
+        qWarning("Movie is corrupt after frame %llu.", (unsigned long long) machine.frame);
+        return;
+    }
+
+    if (last)
+    {
+        segment.passed = true;
+        return;
+    }
+
+    if (machine.frame != endFrame || !player.readKeyframe(segment.keyframe + 1, snapshot))
+    {
+        qWarning("Movie ends before the keyframe at frame %llu.", (unsigned long long) endFrame);
+        return;
+    }
+
+    MachineSnapshot reached;
+    machine.saveSnapshot(reached);
+    segment.passed = snapshotHash(reached) == snapshotHash(snapshot);
+    if (!segment.passed)
+        qWarning("State differs from the keyframe at frame %llu.", (unsigned long long) endFrame);
+}
+
+bool verifyMovie(const QString& fileName, int threads)
+{
+    MoviePlayer player;
+    if (!player.open(fileName))
+        return false;
+
+    // Without keyframes there is nothing to split at
+    if (player.keyframes().isEmpty())
+        return replayMovie(fileName);
+
+    QVector<MovieSegment> segments(player.keyframes().size());
+    for (int i = 0; i < segments.size(); ++i)
+        segments[i].keyframe = i;
+
+    if (threads > 0)
+        QThreadPool::globalInstance()->setMaxThreadCount(threads);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QtConcurrent::blockingMap(segments, [&fileName](MovieSegment& segment) { verifySegment(fileName, segment); });
+
+    bool passed = true;
+    uint64_t frames = 0;
+    for (int i = 0; i < segments.size(); ++i)
+    {
+        passed = passed && segments[i].passed;
+        frames += segments[i].frames;
+    }
+
+    double seconds = timer.nsecsElapsed() / 1e9;
+    qDebug("Verified %llu frames in %d segments on %d threads in %.2f s, %.0f frames per second.",
+           (unsigned long long) frames, segments.size(), QThreadPool::globalInstance()->maxThreadCount(),
+           seconds, frames / seconds);
+    return passed;
+}
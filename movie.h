@@ -0,0 +1,104 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <stdint.h>
+#include <QBuffer>
+#include <QFile>
+#include <QDataStream>
+#include <QString>
+#include <QVector>
+#include "machine.h"
+#include "watchpoints.h"
+
+// A movie is a header followed by a stream of tagged records. An input record
+// is written whenever the input ports change and holds the frame number it
+// takes effect on. A frame record follows every emulated frame and holds the
+// hash of video RAM at the end of it, so a replay can detect divergence.
+//
+// Since version 2 a keyframe record with the complete machine is written at
+// the start of every MOVIE_KEYFRAME_INTERVAL frames. The movie ends with an
+// index of the keyframes and a trailer pointing at it, so a player can jump
+// to any frame after emulating at most one interval.
+const quint32 MOVIE_MAGIC = 0x564d4953; // "SIMV"
+const quint32 MOVIE_INDEX_MAGIC = 0x584d4953; // "SIMX"
+const quint16 MOVIE_VERSION = 2;
+
+const quint8 MOVIE_INPUT_RECORD = 'I';
+const quint8 MOVIE_FRAME_RECORD = 'F';
+const quint8 MOVIE_KEYFRAME_RECORD = 'K';
+const quint8 MOVIE_INDEX_RECORD = 'X';
+
+const int MOVIE_KEYFRAME_INTERVAL = 10 * FRAME_RATE;
+
+struct MovieKeyframe
+{
+    uint64_t frame;
+    qint64 offset; // Of the keyframe record in the file
+};
+
+class MovieRecorder
+{
+public:
+    MovieRecorder();
+
+    bool open(const QString& fileName);
+    void close();
+
+    // Has to be called at the start of every frame, before the new inputs are latched
+    void recordKeyframe(const Machine& machine);
+    void recordInputs(uint64_t frame, uint8_t input1, uint8_t input2);
+    void recordFrame(uint64_t videoHash);
+
+private:
+    QFile file;
+    QDataStream stream;
+    QVector<MovieKeyframe> index;
+
+    bool hasInputs;
+    uint8_t lastInput1;
+    uint8_t lastInput2;
+};
+
+// Reads a movie from a memory mapping of the file
+class MoviePlayer
+{
+public:
+    MoviePlayer();
+    ~MoviePlayer();
+
+    bool open(const QString& fileName);
+
+    // Returns false at the end of the movie or if it is corrupt. The input
+    // arguments are only changed if the inputs change on this frame.
+    bool readFrame(uint64_t frame, uint8_t& input1, uint8_t& input2, uint64_t& videoHash);
+    bool isCorrupt() const;
+
+    // Restores the machine from the last keyframe before the given frame and
+    // emulates up to it, readFrame() then continues from there
+    bool seek(Machine& machine, uint64_t frame);
+    const QVector<MovieKeyframe>& keyframes() const;
+    bool readKeyframe(int keyframe, MachineSnapshot& snapshot);
+
+private:
+    QFile file;
+    uchar* mapped;
+    QByteArray data;
+    QBuffer buffer;
+    QDataStream stream;
+    QVector<MovieKeyframe> index;
+    bool corrupt;
+
+    void readIndex();
+};
+
+// Replays a movie on a headless machine as fast as possible and verifies the
+// video RAM of every frame. Returns true if the replay matched the recording. The
+// watchpoints are set once the start frame is reached.
+bool replayMovie(const QString& fileName, uint64_t startFrame = 0, const WatchList& watchList = WatchList());
+
+// Same check, but every stretch between two keyframes is replayed on its own
+// thread, starting from the first keyframe. At the end of a stretch the state
+// has to match the next keyframe exactly.
+bool verifyMovie(const QString& fileName, int threads);
+
+#endif // MOVIE_H
@@ -0,0 +1,34 @@
+#include "nativecore.h"
+#include "hash.h"
+
+#ifdef NATIVE_CORE
+// Generated from invaders.rom during the build
+extern const uint64_t NATIVE_ROM_HASH;
+extern const NativeBlock NATIVE_BLOCKS[];
+extern const int NATIVE_BLOCK_COUNT;
+#else
+static const uint64_t NATIVE_ROM_HASH = 0;
+static const NativeBlock* const NATIVE_BLOCKS = 0;
+static const int NATIVE_BLOCK_COUNT = 0;
+#endif
+
+struct NativeBlockTable
+{
+    const NativeBlock* blocks[ROM_SIZE];
+
+    NativeBlockTable() : blocks()
+    {
+        for (int i = 0; i < NATIVE_BLOCK_COUNT; ++i)
+            blocks[NATIVE_BLOCKS[i].address] = &NATIVE_BLOCKS[i];
+    }
+};
+
+const NativeBlock* const* nativeBlocks(const uint8_t* rom)
+{
+    if (NATIVE_BLOCK_COUNT == 0 || hashBytes(rom, ROM_SIZE) != NATIVE_ROM_HASH)
+        return 0;
+
+    // Initialized once, thread safe
+    static const NativeBlockTable table;
+    return table.blocks;
+}
@@ -0,0 +1,24 @@
+#ifndef NATIVECORE_H
+#define NATIVECORE_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+// A basic block of invaders.rom compiled to C++ ahead of time by tools/recompiler.cpp
+struct NativeBlock
+{
+    uint16_t address;
+
+    // Upper bound of the cycles spent before the last instruction. The block may only run if
+    // no interrupt comes due before then, so interrupts arrive between the same instructions
+    // as with the interpreter.
+    uint16_t cyclesBeforeLast;
+
+    int (*run)(CPU& cpu);
+};
+
+// Blocks by start address, null where there is none. Returns null if the build has no
+// native core (qmake CONFIG+=native) or the ROM isn't the one that was compiled.
+const NativeBlock* const* nativeBlocks(const uint8_t* rom);
+
+#endif // NATIVECORE_H
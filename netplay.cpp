@@ -0,0 +1,339 @@
+#include "netplay.h"
+#include "hash.h"
+#include <QThread>
+#include <QDebug>
+#include <cstring>
+
+const quint32 NETPLAY_MAGIC = 0x504e4953; // "SINP"
+
+// Ports used by the loopback test, the second peer uses the next one
+const quint16 NETPLAY_TEST_PORT = 47800;
+
+// Little endian host assumed, like the rest of the emulator
+struct InputPacketHeader
+{
+    uint32_t magic;
+    uint32_t count;
+    uint64_t firstFrame;
+};
+
+static void applyInputs(Machine& machine, uint8_t player1, uint8_t player2)
+{
+    // Both players share the coin slot, player two's start button is on port 1 as well
+    uint8_t input1 = (player1 & PAD_MASK) | (player2 & COIN);
+    if (player2 & P1_START)
+        input1 |= P2_START;
+    machine.cpu.input1 = input1;
+
+    // The DIP switches on port 2 are left alone
+    const uint8_t player2Controls = P2_SHOOT | P2_LEFT | P2_RIGHT;
+    machine.cpu.input2 = (machine.cpu.input2 & ~player2Controls) | (player2 & player2Controls);
+}
+
+RollbackSession::RollbackSession(Machine& machine, int localPlayer)
+    : rollbacks(0), maxRollbackFrames(0), maxRollbackNsecs(0), machine(machine), localPlayer(localPlayer),
+      nextFrame(0), confirmedRemote(0), lastRemote(0), pendingLocal(0), rollbackFrame(0), rollbackPending(false),
+      resimulating(false)
+{
+}
+
+uint64_t RollbackSession::frame() const
+{
+    return nextFrame;
+}
+
+uint64_t RollbackSession::confirmedFrame() const
+{
+    return confirmedRemote;
+}
+
+bool RollbackSession::isResimulating() const
+{
+    return resimulating;
+}
+
+void RollbackSession::setLocalInput(uint8_t pad)
+{
+    pendingLocal = pad & PAD_MASK;
+}
+
+uint8_t RollbackSession::localInput(uint64_t frame) const
+{
+    return history[frame % NETPLAY_WINDOW].local;
+}
+
+void RollbackSession::addRemoteInput(uint64_t frame, uint8_t pad)
+{
+    if (frame != confirmedRemote)
+        return;
+
+    pad &= PAD_MASK;
+    FrameRecord& entry = record(frame);
+
+    // Frames that already ran were predicted, go back if the prediction was wrong
+    if (frame < nextFrame && entry.remote != pad && (!rollbackPending || frame < rollbackFrame))
+    {
+        rollbackFrame = frame;
+        rollbackPending = true;
+    }
+
+    entry.remote = pad;
+    lastRemote = pad;
+    ++confirmedRemote;
+}
+
+bool RollbackSession::advance()
+{
+    synchronize();
+
+    if (nextFrame >= confirmedRemote + NETPLAY_MAX_PREDICTION)
+        return false;
+
+    record(nextFrame).local = pendingLocal;
+    simulate(nextFrame);
+    ++nextFrame;
+    return true;
+}
+
+void RollbackSession::synchronize()
+{
+    if (!rollbackPending)
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // The frames played again were counted in the metrics the first time already
+    uint64_t interruptsDelivered = machine.interruptsDelivered;
+    uint64_t interruptsRetried = machine.interruptsRetried;
+    machine.loadSnapshot(record(rollbackFrame).snapshot);
+
+    resimulating = true;
+    for (uint64_t frame = rollbackFrame; frame < nextFrame; ++frame)
+        simulate(frame);
+    resimulating = false;
+    machine.interruptsDelivered = interruptsDelivered;
+    machine.interruptsRetried = interruptsRetried;
+
+    ++rollbacks;
+    maxRollbackFrames = qMax<int>(maxRollbackFrames, nextFrame - rollbackFrame);
+    maxRollbackNsecs = qMax(maxRollbackNsecs, timer.nsecsElapsed());
+    rollbackPending = false;
+}
+
+RollbackSession::FrameRecord& RollbackSession::record(uint64_t frame)
+{
+    return history[frame % NETPLAY_WINDOW];
+}
+
+void RollbackSession::simulate(uint64_t frame)
+{
+    FrameRecord& entry = record(frame);
+    if (frame >= confirmedRemote)
+        entry.remote = lastRemote;
+
+    machine.saveSnapshot(entry.snapshot);
+
+    if (localPlayer == 1)
+        applyInputs(machine, entry.local, entry.remote);
+    else
+        applyInputs(machine, entry.remote, entry.local);
+
+    machine.runFrame();
+}
+
+NetplayLink::NetplayLink(int delayMsecs, int lossPercent)
+    : peerPort(0), delayMsecs(delayMsecs), lossPercent(lossPercent), randomState(0x9e3779b9)
+{
+    clock.start();
+}
+
+bool NetplayLink::open(quint16 localPort, const QHostAddress& peerAddress, quint16 peerPort)
+{
+    this->peerAddress = peerAddress;
+    this->peerPort = peerPort;
+
+    if (!socket.bind(QHostAddress::Any, localPort))
+    {
+        qWarning("Could not bind netplay socket to port %d: %s", localPort, qPrintable(socket.errorString()));
+        return false;
+    }
+    return true;
+}
+
+void NetplayLink::sendInputs(const RollbackSession& session)
+{
+    uint64_t last = session.frame();
+    uint64_t first = last > (uint64_t) NETPLAY_WINDOW ? last - NETPLAY_WINDOW : 0;
+
+    InputPacketHeader header;
+    header.magic = NETPLAY_MAGIC;
+    header.count = last - first;
+    header.firstFrame = first;
+
+    QByteArray packet(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (uint64_t frame = first; frame < last; ++frame)
+        packet.append(session.localInput(frame));
+
+    if (lossPercent > 0 && (int) (random() % 100) < lossPercent)
+        return;
+
+    DelayedPacket delayedPacket;
+    delayedPacket.sendTime = clock.elapsed() + delayMsecs;
+    delayedPacket.data = packet;
+    delayed.enqueue(delayedPacket);
+
+    flushDelayed();
+}
+
+void NetplayLink::receiveInputs(RollbackSession& session)
+{
+    flushDelayed();
+
+    while (socket.hasPendingDatagrams())
+    {
+        QByteArray packet;
+        packet.resize(socket.pendingDatagramSize());
+        socket.readDatagram(packet.data(), packet.size());
+
+        InputPacketHeader header;
+        if (packet.size() < (int) sizeof(header))
+            continue;
+        memcpy(&header, packet.constData(), sizeof(header));
+        if (header.magic != NETPLAY_MAGIC || header.count > (uint32_t) NETPLAY_WINDOW
+            || packet.size() != (int) (sizeof(header) + header.count))
+            continue;
+
+        const uint8_t* pads = reinterpret_cast<const uint8_t*>(packet.constData()) + sizeof(header);
+        for (uint32_t i = 0; i < header.count; ++i)
+            session.addRemoteInput(header.firstFrame + i, pads[i]);
+    }
+}
+
+void NetplayLink::flushDelayed()
+{
+    qint64 now = clock.elapsed();
+    while (!delayed.isEmpty() && delayed.head().sendTime <= now)
+    {
+        socket.writeDatagram(delayed.dequeue().data, peerAddress, peerPort);
+    }
+}
+
+// xorshift32, the loss pattern only needs to look random
+uint32_t NetplayLink::random()
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+// Inserts a coin and starts a two player game, then mashes buttons
+static uint8_t scriptedInput(int player, uint64_t frame)
+{
+    if (player == 1 && frame >= 30 && frame < 40)
+        return COIN;
+    if (player == 1 && frame >= 200 && frame < 205)
+        return P1_START;
+    if (player == 2 && frame >= 400 && frame < 405)
+        return P1_START;
+
+    // Each player holds a new combination every 8 frames
+    uint64_t seed = (frame / 8) * 2 + player;
+    return hashBytes(reinterpret_cast<const uint8_t*>(&seed), sizeof(seed)) & (P1_SHOOT | P1_LEFT | P1_RIGHT);
+}
+
+bool runNetplayLoopback(int frames, int delayMsecs, int lossPercent)
+{
+    Machine machines[2];
+    RollbackSession first(machines[0], 1);
+    RollbackSession second(machines[1], 2);
+    RollbackSession* sessions[2] = { &first, &second };
+    NetplayLink firstLink(delayMsecs, lossPercent);
+    NetplayLink secondLink(delayMsecs, lossPercent);
+    NetplayLink* links[2] = { &firstLink, &secondLink };
+
+    for (int peer = 0; peer < 2; ++peer)
+    {
+        machines[peer].loadRom();
+        if (!links[peer]->open(NETPLAY_TEST_PORT + peer, QHostAddress::LocalHost, NETPLAY_TEST_PORT + 1 - peer))
+            return false;
+    }
+
+    qDebug("Running %d frames over loopback with %d ms latency and %d%% packet loss.", frames, delayMsecs, lossPercent);
+
+    QElapsedTimer clock;
+    clock.start();
+
+    // Both peers run at 60 frames per second, otherwise the latency would be meaningless
+    int tick = 0;
+    while (sessions[0]->frame() < (uint64_t) frames || sessions[1]->frame() < (uint64_t) frames)
+    {
+        for (int peer = 0; peer < 2; ++peer)
+        {
+            RollbackSession& session = *sessions[peer];
+            links[peer]->receiveInputs(session);
+            if (session.frame() < (uint64_t) frames)
+            {
+                session.setLocalInput(scriptedInput(peer + 1, session.frame()));
+                session.advance();
+            }
+            links[peer]->sendInputs(session);
+        }
+
+        ++tick;
+        qint64 timeLeft = tick * 1000000000LL / FRAME_RATE - clock.nsecsElapsed();
+        if (timeLeft > 0)
+            QThread::usleep(timeLeft / 1000);
+    }
+
+    // Wait for the inputs of the last frames and correct the predictions
+    QElapsedTimer timeout;
+    timeout.start();
+    while (sessions[0]->confirmedFrame() < (uint64_t) frames || sessions[1]->confirmedFrame() < (uint64_t) frames)
+    {
+        if (timeout.elapsed() > 5000)
+        {
+            qWarning("Timed out waiting for the last inputs.");
+            return false;
+        }
+
+        for (int peer = 0; peer < 2; ++peer)
+        {
+            links[peer]->receiveInputs(*sessions[peer]);
+            links[peer]->sendInputs(*sessions[peer]);
+        }
+        QThread::msleep(1);
+    }
+
+    for (int peer = 0; peer < 2; ++peer)
+    {
+        sessions[peer]->synchronize();
+        qDebug("Peer %d: %d rollbacks, longest %d frames in %.3f ms.", peer + 1, sessions[peer]->rollbacks,
+               sessions[peer]->maxRollbackFrames, sessions[peer]->maxRollbackNsecs / 1e6);
+    }
+
+    // Measure a worst case rollback on its own, outside of the paced loop
+    const int benchmarkFrames = 8;
+    const int benchmarkRuns = 100;
+    MachineSnapshot snapshot;
+    machines[0].saveSnapshot(snapshot);
+    QElapsedTimer timer;
+    timer.start();
+    for (int run = 0; run < benchmarkRuns; ++run)
+    {
+        machines[0].loadSnapshot(snapshot);
+        for (int i = 0; i < benchmarkFrames; ++i)
+            machines[0].runFrame();
+    }
+    qDebug("Restoring and simulating %d frames takes %.3f ms.", benchmarkFrames, timer.nsecsElapsed() / 1e6 / benchmarkRuns);
+    machines[0].loadSnapshot(snapshot);
+
+    bool same = machines[0].stateHash() == machines[1].stateHash() && machines[0].cycles == machines[1].cycles;
+    if (!same)
+        qWarning("Peers diverged.");
+    else
+        qDebug("Both peers are in the same state after %d frames.", frames);
+
+    return same;
+}
@@ -0,0 +1,117 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include <stdint.h>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QQueue>
+#include <QUdpSocket>
+#include "machine.h"
+
+// Frames of history kept for rolling back, the snapshots of all of them are kept around
+const int NETPLAY_WINDOW = 32;
+
+// How far the local peer may run ahead of the last input it has from the remote one
+const int NETPLAY_MAX_PREDICTION = 12;
+
+// A player's controls in one byte, laid out like player one's bits on port 1
+const uint8_t PAD_MASK = COIN | P1_START | P1_SHOOT | P1_LEFT | P1_RIGHT;
+
+// Runs a machine for two players on two hosts. Inputs from the remote player
+// arrive late, so they are predicted to stay what they were last. When the
+// real input turns out to be different, the machine goes back to the snapshot
+// of that frame and simulates the frames since then again with the real input.
+class RollbackSession
+{
+public:
+    RollbackSession(Machine& machine, int localPlayer);
+
+    uint64_t frame() const;
+    uint64_t confirmedFrame() const; // Remote inputs are known for all frames before this
+    bool isResimulating() const;
+
+    // Input of the local player for the next frame
+    void setLocalInput(uint8_t pad);
+    uint8_t localInput(uint64_t frame) const;
+
+    // Inputs have to be added in frame order, others are ignored
+    void addRemoteInput(uint64_t frame, uint8_t pad);
+
+    // Rolls back if needed and runs the next frame. Returns false without
+    // running it when the remote player is too far behind.
+    bool advance();
+
+    // Only does the rollback, to catch up with inputs that came in late
+    void synchronize();
+
+    int rollbacks;
+    int maxRollbackFrames;
+    qint64 maxRollbackNsecs;
+
+private:
+    struct FrameRecord
+    {
+        uint8_t local;
+        uint8_t remote;
+        MachineSnapshot snapshot; // Machine at the start of the frame
+    };
+
+    Machine& machine;
+    int localPlayer;
+
+    FrameRecord history[NETPLAY_WINDOW];
+    uint64_t nextFrame;
+    uint64_t confirmedRemote;
+    uint8_t lastRemote;
+    uint8_t pendingLocal;
+
+    // Earliest frame that ran with a wrong prediction
+    uint64_t rollbackFrame;
+    bool rollbackPending;
+    bool resimulating;
+
+    FrameRecord& record(uint64_t frame);
+    void simulate(uint64_t frame);
+};
+
+// Sends the local inputs to the peer and receives its inputs over UDP. Every
+// packet repeats the last NETPLAY_WINDOW inputs so lost packets don't need to
+// be resent. Latency and packet loss can be added to outgoing packets to test
+// on a single host.
+class NetplayLink
+{
+public:
+    NetplayLink(int delayMsecs = 0, int lossPercent = 0);
+
+    bool open(quint16 localPort, const QHostAddress& peerAddress, quint16 peerPort);
+
+    void sendInputs(const RollbackSession& session);
+    void receiveInputs(RollbackSession& session);
+
+private:
+    struct DelayedPacket
+    {
+        qint64 sendTime;
+        QByteArray data;
+    };
+
+    QUdpSocket socket;
+    QHostAddress peerAddress;
+    quint16 peerPort;
+
+    int delayMsecs;
+    int lossPercent;
+    uint32_t randomState;
+
+    QElapsedTimer clock;
+    QQueue<DelayedPacket> delayed;
+
+    void flushDelayed();
+    uint32_t random();
+};
+
+// Plays two peers against each other over UDP on localhost with the given
+// latency and loss, then checks that both ended up in exactly the same state.
+bool runNetplayLoopback(int frames, int delayMsecs, int lossPercent);
+
+#endif // NETPLAY_H
@@ -0,0 +1,188 @@
+#include "observation.h"
+#include "machine.h"
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+const int SCREEN_WIDTH = SCREEN_HEIGHT_PIXELS; // The monitor is rotated, what the player sees as width is the video RAM height
+const int SCREEN_HEIGHT = SCREEN_WIDTH_PIXELS;
+const int ROW_WORDS = SCREEN_WIDTH_BYTES / 8;
+
+static inline uint64_t loadWord(const uint8_t* bytes)
+{
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word)); // Little endian, bit n of the word is pixel n of the row
+    return word;
+}
+
+static inline int popcount(uint64_t word)
+{
+    return __builtin_popcountll(word);
+}
+
+void downsampleScreen(const uint8_t* vram, uint8_t* out, int width, int height)
+{
+    // A column of the output is a range of video RAM rows, a row of the output
+    // is a range of bits within them. The bit masks only depend on the output
+    // row, so they are set up once per call.
+    const int MAX_HEIGHT = SCREEN_HEIGHT;
+    uint64_t masks[MAX_HEIGHT][ROW_WORDS];
+    int areaHeight[MAX_HEIGHT];
+
+    for (int y = 0; y < height; ++y)
+    {
+        // Screen rows count from the top, bits from the bottom of the screen
+        int firstBit = SCREEN_HEIGHT - (y + 1) * SCREEN_HEIGHT / height;
+        int lastBit = SCREEN_HEIGHT - y * SCREEN_HEIGHT / height;
+        areaHeight[y] = lastBit - firstBit;
+
+        for (int word = 0; word < ROW_WORDS; ++word)
+        {
+            int from = qBound(0, firstBit - word * 64, 64);
+            int to = qBound(0, lastBit - word * 64, 64);
+            uint64_t upper = to == 64 ? ~0ULL : (1ULL << to) - 1;
+            uint64_t lower = from == 64 ? ~0ULL : (1ULL << from) - 1;
+            masks[y][word] = upper & ~lower;
+        }
+    }
+
+    for (int x = 0; x < width; ++x)
+    {
+        int firstRow = x * SCREEN_WIDTH / width;
+        int lastRow = (x + 1) * SCREEN_WIDTH / width;
+
+        uint64_t rows[SCREEN_WIDTH][ROW_WORDS];
+        for (int row = firstRow; row < lastRow; ++row)
+            for (int word = 0; word < ROW_WORDS; ++word)
+                rows[row - firstRow][word] = loadWord(vram + row * SCREEN_WIDTH_BYTES + word * 8);
+
+        int areaWidth = lastRow - firstRow;
+        for (int y = 0; y < height; ++y)
+        {
+            int lit = 0;
+            for (int row = 0; row < areaWidth; ++row)
+                for (int word = 0; word < ROW_WORDS; ++word)
+                    lit += popcount(rows[row][word] & masks[y][word]);
+
+            out[y * width + x] = qMin(lit * 256 / (areaWidth * areaHeight[y]), 255);
+        }
+    }
+}
+
+// 2x2 blocks: counts the lit pixels of every bit pair in two neighbouring rows
+void downsampleScreenHalf(const uint8_t* vram, uint8_t* out)
+{
+    const int OUT_WIDTH = SCREEN_WIDTH / 2;
+    const int OUT_HEIGHT = SCREEN_HEIGHT / 2;
+    uint8_t column[OUT_HEIGHT];
+
+    for (int x = 0; x < OUT_WIDTH; ++x)
+    {
+        const uint8_t* row0 = vram + 2 * x * SCREEN_WIDTH_BYTES;
+        const uint8_t* row1 = row0 + SCREEN_WIDTH_BYTES;
+
+#ifdef __SSE2__
+        const __m128i evenBits = _mm_set1_epi8(0x55);
+        const __m128i evenPairs = _mm_set1_epi8(0x33);
+        const __m128i lowNibbles = _mm_set1_epi8(0x0F);
+
+        for (int half = 0; half < SCREEN_WIDTH_BYTES; half += 16)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + half));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + half));
+
+            // Lit pixels per bit pair, 0-2 in every two bit field
+            a = _mm_add_epi8(_mm_and_si128(a, evenBits), _mm_and_si128(_mm_srli_epi16(a, 1), evenBits));
+            b = _mm_add_epi8(_mm_and_si128(b, evenBits), _mm_and_si128(_mm_srli_epi16(b, 1), evenBits));
+
+            // Spread the fields out to nibbles before adding the rows, the sum needs three bits
+            __m128i pairs02 = _mm_add_epi8(_mm_and_si128(a, evenPairs), _mm_and_si128(b, evenPairs));
+            __m128i pairs13 = _mm_add_epi8(_mm_and_si128(_mm_srli_epi16(a, 2), evenPairs),
+                                           _mm_and_si128(_mm_srli_epi16(b, 2), evenPairs));
+
+            __m128i pair0 = _mm_and_si128(pairs02, lowNibbles);
+            __m128i pair1 = _mm_and_si128(pairs13, lowNibbles);
+            __m128i pair2 = _mm_and_si128(_mm_srli_epi16(pairs02, 4), lowNibbles);
+            __m128i pair3 = _mm_and_si128(_mm_srli_epi16(pairs13, 4), lowNibbles);
+
+            // Back into bit order, four counts per source byte
+            __m128i pairs01Low = _mm_unpacklo_epi8(pair0, pair1);
+            __m128i pairs01High = _mm_unpackhi_epi8(pair0, pair1);
+            __m128i pairs23Low = _mm_unpacklo_epi8(pair2, pair3);
+            __m128i pairs23High = _mm_unpackhi_epi8(pair2, pair3);
+
+            __m128i counts[4];
+            counts[0] = _mm_unpacklo_epi16(pairs01Low, pairs23Low);
+            counts[1] = _mm_unpackhi_epi16(pairs01Low, pairs23Low);
+            counts[2] = _mm_unpacklo_epi16(pairs01High, pairs23High);
+            counts[3] = _mm_unpackhi_epi16(pairs01High, pairs23High);
+
+            for (int i = 0; i < 4; ++i)
+            {
+                // 0-4 lit pixels to 0-255, doubling with saturation six times is a multiply by 64
+                __m128i shade = counts[i];
+                for (int j = 0; j < 6; ++j)
+                    shade = _mm_adds_epu8(shade, shade);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(column + half * 4 + i * 16), shade);
+            }
+        }
+#else
+        for (int byte = 0; byte < SCREEN_WIDTH_BYTES; ++byte)
+        {
+            for (int pair = 0; pair < 4; ++pair)
+            {
+                int lit = (row0[byte] >> (pair * 2) & 1) + (row0[byte] >> (pair * 2 + 1) & 1)
+                        + (row1[byte] >> (pair * 2) & 1) + (row1[byte] >> (pair * 2 + 1) & 1);
+                column[byte * 4 + pair] = lit == 4 ? 255 : lit * 64;
+            }
+        }
+#endif
+
+        // The column was built from the bottom of the screen up
+        for (int y = 0; y < OUT_HEIGHT; ++y)
+            out[y * OUT_WIDTH + x] = column[OUT_HEIGHT - 1 - y];
+    }
+}
+
+FrameStack::FrameStack(int frameSize, int depth) : frameSize(frameSize), depth(depth), newest(depth - 1)
+{
+    buffer = new uint8_t[2 * depth * frameSize]();
+    scratch = new uint8_t[frameSize];
+}
+
+FrameStack::~FrameStack()
+{
+    delete[] buffer;
+    delete[] scratch;
+}
+
+uint8_t* FrameStack::nextFrame()
+{
+    return scratch;
+}
+
+void FrameStack::push()
+{
+    newest = (newest + 1) % depth;
+    memcpy(buffer + newest * frameSize, scratch, frameSize);
+    memcpy(buffer + (newest + depth) * frameSize, scratch, frameSize);
+}
+
+void FrameStack::fill()
+{
+    for (int i = 0; i < 2 * depth; ++i)
+        memcpy(buffer + i * frameSize, scratch, frameSize);
+}
+
+const uint8_t* FrameStack::frames() const
+{
+    // The window ending at the newest frame's second copy
+    return buffer + (newest + 1) * frameSize;
+}
+
+int FrameStack::size() const
+{
+    return depth * frameSize;
+}
@@ -0,0 +1,43 @@
+#ifndef OBSERVATION_H
+#define OBSERVATION_H
+
+#include <stdint.h>
+
+// Kernels that turn the 1bpp video RAM straight into small upright greyscale
+// frames for agents. Every output pixel is the share of lit pixels in the
+// screen area it covers, scaled to 0-255.
+
+// Any size up to the full 224x256 screen
+void downsampleScreen(const uint8_t* vram, uint8_t* out, int width, int height);
+
+// 112x128, the common half size case, with an SSE2 path
+void downsampleScreenHalf(const uint8_t* vram, uint8_t* out);
+
+// The last few observations, oldest first, in one contiguous block. Every
+// frame is stored twice in a buffer of twice the stack size, which keeps the
+// newest window contiguous without moving old frames around.
+class FrameStack
+{
+public:
+    FrameStack(int frameSize, int depth);
+    ~FrameStack();
+
+    // Where the next frame should be written, call push() once it's done
+    uint8_t* nextFrame();
+    void push();
+
+    // Fills the whole stack with the frame that was just pushed
+    void fill();
+
+    const uint8_t* frames() const;
+    int size() const;
+
+private:
+    uint8_t* buffer;
+    uint8_t* scratch;
+    int frameSize;
+    int depth;
+    int newest;
+};
+
+#endif // OBSERVATION_H
@@ -0,0 +1,73 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include <stdint.h>
+
+// What the static analyses of the ROM need to know about 8080 opcodes. Plain C++ without Qt,
+// tools/recompiler.cpp uses it too.
+
+// No instruction of the interpreter takes longer
+const int MAX_INSTRUCTION_CYCLES = 18;
+
+enum InstructionKind
+{
+    INSTRUCTION_PLAIN,      // Continues with the next instruction
+    INSTRUCTION_JUMP,
+    INSTRUCTION_JUMP_IF,
+    INSTRUCTION_CALL,
+    INSTRUCTION_CALL_IF,
+    INSTRUCTION_RETURN,
+    INSTRUCTION_RETURN_IF,
+    INSTRUCTION_COMPUTED,   // PCHL and RST, the successor isn't known statically
+    INSTRUCTION_UNSUPPORTED // HLT and the undocumented opcodes
+};
+
+inline int instructionLength(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case 0x01: case 0x11: case 0x21: case 0x31:
+    case 0x22: case 0x2A: case 0x32: case 0x3A:
+    case 0xC2: case 0xC3: case 0xC4: case 0xCA: case 0xCC: case 0xCD:
+    case 0xD2: case 0xD4: case 0xDA: case 0xDC:
+    case 0xE2: case 0xE4: case 0xEA: case 0xEC:
+    case 0xF2: case 0xF4: case 0xFA: case 0xFC:
+        return 3;
+    case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x36: case 0x3E:
+    case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+    case 0xD3: case 0xDB:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+inline InstructionKind instructionKind(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case 0x08: case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+    case 0x76: case 0xCB: case 0xD9: case 0xDD: case 0xED: case 0xFD:
+        return INSTRUCTION_UNSUPPORTED;
+    case 0xC3:
+        return INSTRUCTION_JUMP;
+    case 0xCD:
+        return INSTRUCTION_CALL;
+    case 0xC9:
+        return INSTRUCTION_RETURN;
+    case 0xE9:
+        return INSTRUCTION_COMPUTED;
+    }
+
+    if ((opcode & 0xC7) == 0xC2)
+        return INSTRUCTION_JUMP_IF;
+    if ((opcode & 0xC7) == 0xC4)
+        return INSTRUCTION_CALL_IF;
+    if ((opcode & 0xC7) == 0xC0)
+        return INSTRUCTION_RETURN_IF;
+    if ((opcode & 0xC7) == 0xC7)
+        return INSTRUCTION_COMPUTED;
+    return INSTRUCTION_PLAIN;
+}
+
+#endif // OPCODES_H
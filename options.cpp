@@ -0,0 +1,160 @@
+#include "options.h"
+#include <QCommandLineParser>
+
+Options parseOptions(const QCoreApplication& app)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Space Invaders emulator");
+    parser.addHelpOption();
+
+#ifdef HEADLESS
+    const QString defaultSink = "null";
+#else
+    const QString defaultSink = "device";
+#endif
+
+    QCommandLineOption audioOption("audio", "Where sound goes: device, null or wav.", "sink", defaultSink);
+    QCommandLineOption audioFileOption("audio-file", "File written by the wav sink.", "file", "invaders.wav");
+    QCommandLineOption audioLatencyOption("audio-latency", "Measure the time from a port write until the sound is heard.");
+    QCommandLineOption framesOption("frames", "Stop after this many frames.", "count", "0");
+    QCommandLineOption unthrottledOption("unthrottled", "Run as fast as possible instead of 60 frames per second.");
+    QCommandLineOption interpretOption("interpret", "Interpret the whole ROM even if this build has a native core.");
+    QCommandLineOption noFusionOption("no-fusion", "Run every instruction on its own instead of fusing common sequences.");
+    QCommandLineOption noHleOption("no-hle", "Interpret the ROM's memory copy and clear loops instead of running them natively.");
+    QCommandLineOption breakOption("break", "Pause before the instruction at this hex address runs, can be given several times.", "address");
+    QCommandLineOption watchReadOption("watch-read", "Pause after a read from this hex address or range like 2000-20FF.", "range");
+    QCommandLineOption watchWriteOption("watch-write", "Pause after a write to this hex address or range like 2000-20FF.", "range");
+    QCommandLineOption watchPortOption("watch-port", "Pause after IN or OUT on this hex port or range of ports.", "port");
+    QCommandLineOption gdbOption("gdb", "Let GDB attach over its remote protocol on this localhost TCP port.", "port", "0");
+    QCommandLineOption recordOption("record", "Record the inputs to a movie.", "file");
+    QCommandLineOption sharedMemoryOption("shm", "Publish every frame to a POSIX shared memory object.", "name");
+    QCommandLineOption metricsPortOption("metrics-port", "Serve Prometheus metrics at http://localhost:port/metrics.", "port", "0");
+    QCommandLineOption metricsFileOption("metrics-file", "Rewrite this file with Prometheus metrics every second.", "file");
+    QCommandLineOption traceOption("trace", "Trace all threads and write Chrome trace JSON on exit, or when F9 is pressed.", "file");
+    QCommandLineOption rewindOption("rewind", "Keep this many seconds of history, hold backspace to rewind.", "seconds", "0");
+    QCommandLineOption runAheadOption("run-ahead", "Show the screen this many frames ahead to hide input lag.", "frames", "0");
+    QCommandLineOption replayFromOption("replay-from", "Start the replay at this frame, using the keyframe before it.", "frame", "0");
+    QCommandLineOption verifyOption("verify", "Verify a movie on all cores, one stretch between keyframes per task.", "file");
+    QCommandLineOption threadsOption("threads", "Threads used by --verify and --lockstep.", "count", "0");
+    QCommandLineOption lockstepOption("lockstep", "Play random games with the faster engines and the interpreter side by side and compare them.", "frames");
+    QCommandLineOption enginesOption("engines", "Engines compared by --lockstep: all, none or some of native,liveness,fusion,hle.", "list", "all");
+    QCommandLineOption everyStepOption("every-step", "Make --lockstep compare after every step instead of every frame.");
+    QCommandLineOption seedOption("seed", "Seed of the random inputs of --lockstep.", "number", "1");
+    QCommandLineOption verifyHleOption("verify-hle", "Compare the native memory loops with the interpreter from random states.", "trials");
+    QCommandLineOption cpuTestOption("cpu-test", "Run a CP/M test program for the 8080 like cpudiag or 8080EXM, can be given several times.", "file");
+    QCommandLineOption netplayPeerOption("netplay-peer", "Play against another emulator at this address.", "host:port");
+    QCommandLineOption netplayPortOption("netplay-port", "Local UDP port for netplay.", "port", "47800");
+    QCommandLineOption netplayPlayerOption("netplay-player", "Which player this side controls, 1 or 2.", "player", "1");
+    QCommandLineOption netplayDelayOption("netplay-delay", "Add latency to outgoing netplay packets.", "msecs", "0");
+    QCommandLineOption netplayLossOption("netplay-loss", "Drop this percentage of outgoing netplay packets.", "percent", "0");
+    QCommandLineOption netplayTestOption("netplay-test", "Play two peers against each other over localhost and compare them.", "frames");
+    QCommandLineOption captureOption("capture", "Record the screen to a compressed capture file.", "file");
+    QCommandLineOption convertCaptureOption("convert-capture", "Convert a capture file to the file given by --output.", "file");
+    QCommandLineOption outputOption("output", "Y4M video or PNG sequence written by --convert-capture.", "file", "capture.y4m");
+    QCommandLineOption replayOption("replay", "Replay a movie as fast as possible and verify every frame.", "file");
+
+    parser.addOption(audioOption);
+    parser.addOption(audioFileOption);
+    parser.addOption(audioLatencyOption);
+    parser.addOption(framesOption);
+    parser.addOption(unthrottledOption);
+    parser.addOption(interpretOption);
+    parser.addOption(noFusionOption);
+    parser.addOption(noHleOption);
+    parser.addOption(breakOption);
+    parser.addOption(watchReadOption);
+    parser.addOption(watchWriteOption);
+    parser.addOption(watchPortOption);
+    parser.addOption(gdbOption);
+    parser.addOption(recordOption);
+    parser.addOption(sharedMemoryOption);
+    parser.addOption(metricsPortOption);
+    parser.addOption(metricsFileOption);
+    parser.addOption(traceOption);
+    parser.addOption(rewindOption);
+    parser.addOption(runAheadOption);
+    parser.addOption(netplayPeerOption);
+    parser.addOption(netplayPortOption);
+    parser.addOption(netplayPlayerOption);
+    parser.addOption(netplayDelayOption);
+    parser.addOption(netplayLossOption);
+    parser.addOption(captureOption);
+#ifdef HEADLESS
+    parser.addOption(replayOption);
+    parser.addOption(replayFromOption);
+    parser.addOption(verifyOption);
+    parser.addOption(threadsOption);
+    parser.addOption(lockstepOption);
+    parser.addOption(enginesOption);
+    parser.addOption(everyStepOption);
+    parser.addOption(seedOption);
+    parser.addOption(verifyHleOption);
+    parser.addOption(cpuTestOption);
+    parser.addOption(netplayTestOption);
+    parser.addOption(convertCaptureOption);
+    parser.addOption(outputOption);
+#endif
+
+    parser.process(app);
+
+    Options options;
+    options.audioSink = parser.value(audioOption);
+    options.audioFile = parser.value(audioFileOption);
+    options.audioLatency = parser.isSet(audioLatencyOption);
+    options.frames = parser.value(framesOption).toInt();
+    options.unthrottled = parser.isSet(unthrottledOption);
+    options.interpret = parser.isSet(interpretOption);
+    options.noFusion = parser.isSet(noFusionOption);
+    options.noHle = parser.isSet(noHleOption);
+    options.watchList.breakpoints = parser.values(breakOption);
+    options.watchList.reads = parser.values(watchReadOption);
+    options.watchList.writes = parser.values(watchWriteOption);
+    options.watchList.ports = parser.values(watchPortOption);
+    options.gdbPort = parser.value(gdbOption).toUInt();
+    options.recordFile = parser.value(recordOption);
+    options.sharedMemoryName = parser.value(sharedMemoryOption);
+    options.metricsPort = parser.value(metricsPortOption).toUInt();
+    options.metricsFile = parser.value(metricsFileOption);
+    options.traceFile = parser.value(traceOption);
+    options.rewindSeconds = parser.value(rewindOption).toInt();
+    options.runAheadFrames = qBound(0, parser.value(runAheadOption).toInt(), MAX_RUN_AHEAD_FRAMES);
+
+    QString peer = parser.value(netplayPeerOption);
+    int separator = peer.lastIndexOf(':');
+    options.netplayPeerAddress = peer.left(separator);
+    options.netplayPeerPort = separator < 0 ? 0 : peer.mid(separator + 1).toUInt();
+    if (!peer.isEmpty() && options.netplayPeerPort == 0)
+        qWarning("Netplay peer has to be given as host:port.");
+    options.netplayLocalPort = parser.value(netplayPortOption).toUInt();
+    options.netplayPlayer = parser.value(netplayPlayerOption).toInt() == 2 ? 2 : 1;
+    options.netplayDelay = parser.value(netplayDelayOption).toInt();
+    options.netplayLoss = qBound(0, parser.value(netplayLossOption).toInt(), 100);
+    options.captureFile = parser.value(captureOption);
+
+    // Only registered in headless builds, the parser complains about the others
+#ifdef HEADLESS
+    options.replayFile = parser.value(replayOption);
+    options.replayFrom = parser.value(replayFromOption).toULongLong();
+    options.verifyFile = parser.value(verifyOption);
+    options.threads = parser.value(threadsOption).toInt();
+    options.lockstepFrames = parser.value(lockstepOption).toULongLong();
+    options.lockstepEngines = parser.value(enginesOption);
+    options.lockstepEveryStep = parser.isSet(everyStepOption);
+    options.lockstepSeed = parser.value(seedOption).toULongLong();
+    options.verifyHleTrials = parser.value(verifyHleOption).toInt();
+    options.cpuTestFiles = parser.values(cpuTestOption);
+    options.netplayTestFrames = parser.value(netplayTestOption).toInt();
+    options.convertCaptureFile = parser.value(convertCaptureOption);
+    options.convertOutputFile = parser.value(outputOption);
+#else
+    options.replayFrom = 0;
+    options.threads = 0;
+    options.lockstepFrames = 0;
+    options.lockstepEveryStep = false;
+    options.lockstepSeed = 0;
+    options.verifyHleTrials = 0;
+    options.netplayTestFrames = 0;
+#endif
+
+    return options;
+}
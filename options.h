@@ -0,0 +1,67 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <QCoreApplication>
+#include <QString>
+#include <QStringList>
+#include "watchpoints.h"
+
+const int MAX_RUN_AHEAD_FRAMES = 4;
+
+struct Options
+{
+    QString audioSink; // "device", "null" or "wav"
+    QString audioFile;
+    bool audioLatency;
+
+    int frames; // Number of frames to run before stopping, 0 runs forever
+    bool unthrottled;
+    bool interpret; // Ignore the native core of CONFIG+=native builds
+    bool noFusion;
+    bool noHle;
+
+    QString recordFile;
+    QString replayFile;
+    quint64 replayFrom;
+    QString verifyFile;
+    int threads; // 0 uses one per core
+    QStringList cpuTestFiles;
+    quint64 lockstepFrames;
+    QString lockstepEngines;
+    bool lockstepEveryStep;
+    quint64 lockstepSeed;
+    int verifyHleTrials;
+
+    // Only in builds with CONFIG+=watchpoints
+    WatchList watchList;
+
+    quint16 gdbPort; // 0 disables the GDB stub
+
+    QString sharedMemoryName;
+
+    // Prometheus metrics, both are off by default
+    quint16 metricsPort;
+    QString metricsFile;
+
+    QString traceFile; // Tracing is off unless it is set
+
+    int rewindSeconds; // 0 disables rewinding
+    int runAheadFrames;
+
+    // Two player game against a peer, enabled when the peer address is set
+    QString netplayPeerAddress;
+    quint16 netplayPeerPort;
+    quint16 netplayLocalPort;
+    int netplayPlayer;
+    int netplayDelay; // Milliseconds of extra latency added to outgoing packets
+    int netplayLoss;  // Percent of outgoing packets dropped
+    int netplayTestFrames;
+
+    QString captureFile;
+    QString convertCaptureFile;
+    QString convertOutputFile;
+};
+
+Options parseOptions(const QCoreApplication& app);
+
+#endif // OPTIONS_H
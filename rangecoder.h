@@ -0,0 +1,127 @@
+#ifndef RANGECODER_H
+#define RANGECODER_H
+
+#include <stdint.h>
+#include <QByteArray>
+
+// Adaptive binary range coder in the style of LZMA. Every bit is coded with a
+// probability that adapts to the bits seen before in the same context.
+const int RANGE_PROB_BITS = 11;
+const uint16_t RANGE_PROB_INIT = 1 << (RANGE_PROB_BITS - 1);
+const int RANGE_ADAPT_SHIFT = 5;
+const uint32_t RANGE_TOP = 1 << 24;
+
+class RangeEncoder
+{
+public:
+    explicit RangeEncoder(QByteArray& out) : out(out), low(0), range(0xFFFFFFFF), cache(0), cacheSize(1) {}
+
+    void encodeBit(uint16_t& prob, int bit)
+    {
+        uint32_t bound = (range >> RANGE_PROB_BITS) * prob;
+        if (bit == 0)
+        {
+            range = bound;
+            prob += ((1 << RANGE_PROB_BITS) - prob) >> RANGE_ADAPT_SHIFT;
+        }
+        else
+        {
+            low += bound;
+            range -= bound;
+            prob -= prob >> RANGE_ADAPT_SHIFT;
+        }
+
+        while (range < RANGE_TOP)
+        {
+            range <<= 8;
+            shiftLow();
+        }
+    }
+
+    void flush()
+    {
+        for (int i = 0; i < 5; ++i)
+            shiftLow();
+    }
+
+private:
+    QByteArray& out;
+    uint64_t low;
+    uint32_t range;
+    uint8_t cache;
+    uint64_t cacheSize;
+
+    // Bytes are held back until it is known whether a carry will ripple into them
+    void shiftLow()
+    {
+        if ((uint32_t) low < 0xFF000000 || (low >> 32) != 0)
+        {
+            uint8_t carry = low >> 32;
+            uint8_t pending = cache;
+            do
+            {
+                out.append((char) (uint8_t) (pending + carry));
+                pending = 0xFF;
+            } while (--cacheSize != 0);
+            cache = (low >> 24) & 0xFF;
+        }
+        ++cacheSize;
+        low = (low & 0x00FFFFFF) << 8;
+    }
+};
+
+class RangeDecoder
+{
+public:
+    RangeDecoder(const uint8_t* data, int size) : data(data), size(size), position(0), code(0), range(0xFFFFFFFF)
+    {
+        for (int i = 0; i < 5; ++i)
+            code = code << 8 | nextByte();
+    }
+
+    int decodeBit(uint16_t& prob)
+    {
+        uint32_t bound = (range >> RANGE_PROB_BITS) * prob;
+        int bit;
+        if (code < bound)
+        {
+            range = bound;
+            prob += ((1 << RANGE_PROB_BITS) - prob) >> RANGE_ADAPT_SHIFT;
+            bit = 0;
+        }
+        else
+        {
+            code -= bound;
+            range -= bound;
+            prob -= prob >> RANGE_ADAPT_SHIFT;
+            bit = 1;
+        }
+
+        while (range < RANGE_TOP)
+        {
+            range <<= 8;
+            code = code << 8 | nextByte();
+        }
+        return bit;
+    }
+
+    // True if the decoder had to read past the end, the output is garbage then
+    bool isOverrun() const
+    {
+        return position > size;
+    }
+
+private:
+    const uint8_t* data;
+    int size;
+    int position;
+    uint32_t code;
+    uint32_t range;
+
+    uint8_t nextByte()
+    {
+        return position < size ? data[position++] : (++position, 0);
+    }
+};
+
+#endif // RANGECODER_H
@@ -0,0 +1,207 @@
+#include "rewind.h"
+#include <cstring>
+
+// Zero runs shorter than this are cheaper to keep inside a literal run
+const int MIN_ZERO_RUN = 4;
+
+static const uint8_t ZERO_RAM[RAM_SIZE] = {};
+
+RewindBuffer::RewindBuffer(int maxFrames, int capacityBytes, int keyframeInterval)
+    : maxFrames(qMax(maxFrames, 1)), keyframeInterval(qMax(keyframeInterval, 1)), oldest(0), next(0),
+      keyframeValid(false), framesSinceKeyframe(0)
+{
+    // Room for a few full keyframes at least, otherwise push() could never find space
+    capacity = qMax(capacityBytes, 4 * REWIND_MAX_ENCODED_SIZE);
+
+    entries = new Entry[this->maxFrames];
+    arena = new uint8_t[capacity];
+}
+
+RewindBuffer::~RewindBuffer()
+{
+    delete[] entries;
+    delete[] arena;
+}
+
+void RewindBuffer::push(const Machine& machine)
+{
+    if (size() == maxFrames)
+        dropOldest();
+
+    // Make sure a worst case encoding fits before deciding what to encode
+    // against, dropping old frames may take the current keyframe with it
+    while (findSpace(REWIND_MAX_ENCODED_SIZE) < 0)
+        dropOldest();
+
+    bool isKeyframe = !keyframeValid || framesSinceKeyframe >= keyframeInterval;
+    int encodedSize = encodeRam(machine.ram(), isKeyframe ? ZERO_RAM : keyframeRam, scratch);
+
+    int offset = findSpace(encodedSize);
+
+    uint64_t id = next++;
+    Entry& newEntry = entry(id);
+    machine.saveState(newEntry.state);
+    newEntry.offset = offset;
+    newEntry.size = encodedSize;
+    memcpy(arena + newEntry.offset, scratch, encodedSize);
+
+    if (isKeyframe)
+    {
+        newEntry.keyframe = id;
+        memcpy(keyframeRam, machine.ram(), RAM_SIZE);
+        keyframeValid = true;
+        framesSinceKeyframe = 0;
+    }
+    else
+        newEntry.keyframe = entry(id - 1).keyframe;
+
+    ++framesSinceKeyframe;
+}
+
+bool RewindBuffer::rewind(Machine& machine)
+{
+    if (size() == 0)
+        return false;
+
+    uint64_t id = --next;
+    const Entry& newest = entry(id);
+    const Entry& keyframe = entry(newest.keyframe);
+
+    // Keyframes are stored against zeroed RAM, the delta is then applied in place on top
+    memset(machine.ram(), 0, RAM_SIZE);
+    decodeRam(arena + keyframe.offset, keyframe.size, machine.ram());
+    if (newest.keyframe != id)
+        decodeRam(arena + newest.offset, newest.size, machine.ram());
+    machine.loadState(newest.state);
+
+    // Simplest to start a new keyframe with the next push
+    keyframeValid = false;
+    return true;
+}
+
+void RewindBuffer::clear()
+{
+    oldest = next = 0;
+    keyframeValid = false;
+}
+
+int RewindBuffer::size() const
+{
+    return next - oldest;
+}
+
+int RewindBuffer::memoryUsed() const
+{
+    int used = 0;
+    for (uint64_t id = oldest; id < next; ++id)
+        used += entries[id % maxFrames].size;
+    return used + size() * sizeof(Entry);
+}
+
+RewindBuffer::Entry& RewindBuffer::entry(uint64_t id)
+{
+    return entries[id % maxFrames];
+}
+
+// The arena is a ring, entries are laid out in push order. Returns where a
+// block of the given size would go, or -1 if it doesn't fit right now.
+int RewindBuffer::findSpace(int size)
+{
+    if (oldest == next)
+        return size <= capacity ? 0 : -1;
+
+    int head = entry(oldest).offset;
+    const Entry& newest = entry(next - 1);
+    int tail = newest.offset + newest.size;
+
+    if (newest.offset >= head)
+    {
+        // Used space is [head, tail), free space on both sides of it
+        if (tail + size <= capacity)
+            return tail;
+        if (size <= head)
+            return 0;
+    }
+    else if (tail + size <= head)
+    {
+        // Used space wraps around the end, the free space is in the middle
+        return tail;
+    }
+
+    return -1;
+}
+
+void RewindBuffer::dropOldest()
+{
+    // Deltas are useless without their keyframe, so a whole group goes at once
+    uint64_t keyframe = entry(oldest).keyframe;
+    while (oldest < next && entry(oldest).keyframe == keyframe)
+        ++oldest;
+
+    if (oldest == next)
+        keyframeValid = false;
+}
+
+// The output is a list of (zero run, literal count, literals) tokens over
+// ram XOR reference. Every token after the first one skips at least
+// MIN_ZERO_RUN bytes, which pays for its header, so the output is at most a
+// couple of tokens bigger than the RAM.
+int RewindBuffer::encodeRam(const uint8_t* ram, const uint8_t* reference, uint8_t* out)
+{
+    int outSize = 0;
+    int pos = 0;
+    while (pos < RAM_SIZE)
+    {
+        int zeroRun = 0;
+        while (pos < RAM_SIZE && ram[pos] == reference[pos])
+        {
+            ++zeroRun;
+            ++pos;
+        }
+
+        int literalStart = pos;
+        while (pos < RAM_SIZE)
+        {
+            if (ram[pos] != reference[pos])
+            {
+                ++pos;
+                continue;
+            }
+
+            int run = 0;
+            while (run < MIN_ZERO_RUN && pos + run < RAM_SIZE && ram[pos + run] == reference[pos + run])
+                ++run;
+            if (run == MIN_ZERO_RUN || pos + run == RAM_SIZE)
+                break;
+            pos += run;
+        }
+
+        uint16_t literalCount = pos - literalStart;
+        uint16_t zeroCount = zeroRun;
+        memcpy(out + outSize, &zeroCount, 2);
+        memcpy(out + outSize + 2, &literalCount, 2);
+        outSize += 4;
+
+        for (int i = literalStart; i < pos; ++i)
+            out[outSize++] = ram[i] ^ reference[i];
+    }
+    return outSize;
+}
+
+// XORs the encoded difference into ram, which has to hold the reference
+void RewindBuffer::decodeRam(const uint8_t* in, int size, uint8_t* ram)
+{
+    int pos = 0;
+    int inPos = 0;
+    while (inPos < size)
+    {
+        uint16_t zeroCount, literalCount;
+        memcpy(&zeroCount, in + inPos, 2);
+        memcpy(&literalCount, in + inPos + 2, 2);
+        inPos += 4;
+
+        pos += zeroCount;
+        for (int i = 0; i < literalCount; ++i)
+            ram[pos++] ^= in[inPos++];
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stdint.h>
+#include "machine.h"
+
+const int REWIND_KEYFRAME_INTERVAL = 20;
+const int REWIND_BYTES_PER_SECOND = 32 * 1024;
+
+// Worst case size of one encoded RAM image, see encodeRam()
+const int REWIND_MAX_ENCODED_SIZE = RAM_SIZE + 8;
+
+// Keeps the most recent frames of machine state in a fixed amount of memory.
+// Every keyframe interval the whole RAM is stored, the frames in between only
+// store how their RAM differs from that keyframe. Both are XORed against
+// their reference and run length encoded, so unchanged bytes cost nothing.
+// The oldest frames are dropped, a keyframe with all its deltas at a time,
+// when either the frame or the byte budget runs out.
+class RewindBuffer
+{
+public:
+    RewindBuffer(int maxFrames, int capacityBytes, int keyframeInterval = REWIND_KEYFRAME_INTERVAL);
+    ~RewindBuffer();
+
+    void push(const Machine& machine);
+
+    // Restores the most recently pushed state and forgets it
+    bool rewind(Machine& machine);
+
+    void clear();
+    int size() const;
+    int memoryUsed() const;
+
+private:
+    struct Entry
+    {
+        MachineState state;
+        uint64_t keyframe; // Id of the entry this one is a delta against, its own id for keyframes
+        int offset;        // Where the encoded RAM is in the arena
+        int size;
+    };
+
+    Entry* entries;
+    int maxFrames;
+    int keyframeInterval;
+
+    // Entries are numbered by push order, the live ones are [oldest, next)
+    uint64_t oldest;
+    uint64_t next;
+
+    uint8_t* arena;
+    int capacity;
+
+    uint8_t keyframeRam[RAM_SIZE];
+    uint8_t scratch[REWIND_MAX_ENCODED_SIZE];
+    bool keyframeValid;
+    int framesSinceKeyframe;
+
+    Entry& entry(uint64_t id);
+    int findSpace(int size);
+    void dropOldest();
+
+    static int encodeRam(const uint8_t* ram, const uint8_t* reference, uint8_t* out);
+    static void decodeRam(const uint8_t* in, int size, uint8_t* ram);
+};
+
+#endif // REWIND_H
@@ -0,0 +1,282 @@
+#include "sound.h"
+#include "trace.h"
+#include <QFile>
+#include <QDebug>
+#include <cstring>
+
+SoundSystem::SoundSystem(AudioSink* sink, bool measureLatency)
+    : sink(sink), measureLatency(measureLatency), lastPort3(0), lastPort5(0), muted(false), droppedCommands(0),
+      latencyCount(0), latencyMin(0), latencyMax(0), latencySum(0)
+{
+    clock.start();
+    loadSamples();
+
+    for (int i = 0; i < NUM_SOUND_EFFECTS; ++i)
+    {
+        voices[i].samples = samples[i].constData();
+        voices[i].length = samples[i].size();
+        voices[i].position = 0;
+        voices[i].looping = i == UFO_SOUND; // The UFO keeps humming for as long as the bit is set
+        voices[i].playing = false;
+        voices[i].triggerTime = 0;
+        voices[i].latencyPending = false;
+    }
+}
+
+SoundSystem::~SoundSystem()
+{
+    requestInterruption();
+    wait();
+    delete sink;
+
+    uint64_t dropped = droppedCommands.load();
+    if (dropped)
+        qWarning("%llu sounds were dropped because the sound thread fell behind.", (unsigned long long) dropped);
+}
+
+void SoundSystem::loadSamples()
+{
+    samples[UFO_SOUND] = decodeWav(UFO_SFX);
+    samples[SHOT_SOUND] = decodeWav(PLAYER_SHOOTING_SFX);
+    samples[PLAYER_DIES_SOUND] = decodeWav(PLAYER_DIES_SFX);
+    samples[INVADER_DIES_SOUND] = decodeWav(INVADER_DIES_SFX);
+    samples[FLEET_1_SOUND] = decodeWav(INVADER_1_SFX);
+    samples[FLEET_2_SOUND] = decodeWav(INVADER_2_SFX);
+    samples[FLEET_3_SOUND] = decodeWav(INVADER_3_SFX);
+    samples[FLEET_4_SOUND] = decodeWav(INVADER_4_SFX);
+    samples[UFO_DIES_SOUND] = decodeWav(UFO_DIES_SFX);
+}
+
+// Decodes an uncompressed 8 or 16-bit WAV file into signed 16-bit mono PCM at the mixer rate
+QVector<int16_t> SoundSystem::decodeWav(const QString& fileName)
+{
+    QVector<int16_t> pcm;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning("Could not open sound file %s.", qPrintable(fileName));
+        return pcm;
+    }
+
+    QByteArray data = file.readAll();
+    if (data.size() < 12 || !data.startsWith("RIFF") || data.mid(8, 4) != "WAVE")
+    {
+        qWarning("%s is not a WAV file.", qPrintable(fileName));
+        return pcm;
+    }
+
+    uint16_t channels = 0;
+    uint32_t rate = 0;
+    uint16_t bitsPerSample = 0;
+    const uint8_t* pcmData = 0;
+    uint32_t pcmSize = 0;
+
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.constData());
+    int offset = 12;
+    while (offset + 8 <= data.size())
+    {
+        uint32_t chunkSize = bytes[offset + 4] | bytes[offset + 5] << 8 | bytes[offset + 6] << 16 | bytes[offset + 7] << 24;
+        const uint8_t* chunk = bytes + offset + 8;
+        chunkSize = qMin<uint32_t>(chunkSize, data.size() - offset - 8);
+
+        if (memcmp(bytes + offset, "fmt ", 4) == 0 && chunkSize >= 16)
+        {
+            channels = chunk[2] | chunk[3] << 8;
+            rate = chunk[4] | chunk[5] << 8 | chunk[6] << 16 | chunk[7] << 24;
+            bitsPerSample = chunk[14] | chunk[15] << 8;
+        }
+        else if (memcmp(bytes + offset, "data", 4) == 0)
+        {
+            pcmData = chunk;
+            pcmSize = chunkSize;
+        }
+
+        offset += 8 + chunkSize + (chunkSize & 1); // Chunks are word aligned
+    }
+
+    if (!pcmData || channels == 0 || rate == 0 || (bitsPerSample != 8 && bitsPerSample != 16))
+    {
+        qWarning("Unsupported WAV format in %s.", qPrintable(fileName));
+        return pcm;
+    }
+
+    int frameSize = channels * bitsPerSample / 8;
+    int frames = pcmSize / frameSize;
+    int outputFrames = (int64_t) frames * MIXER_SAMPLE_RATE / rate;
+    pcm.resize(outputFrames);
+
+    for (int i = 0; i < outputFrames; ++i)
+    {
+        // Nearest neighbour resampling is plenty for 8-bit arcade samples
+        const uint8_t* frame = pcmData + ((int64_t) i * rate / MIXER_SAMPLE_RATE) * frameSize;
+
+        int32_t sum = 0;
+        for (int channel = 0; channel < channels; ++channel)
+        {
+            if (bitsPerSample == 8)
+                sum += (frame[channel] - 0x80) << 8;
+            else
+                sum += (int16_t) (frame[channel * 2] | frame[channel * 2 + 1] << 8);
+        }
+        pcm[i] = sum / channels;
+    }
+
+    return pcm;
+}
+
+void SoundSystem::port3Written(uint8_t value)
+{
+    uint8_t risingEdges = value & ~lastPort3;
+    uint8_t fallingEdges = ~value & lastPort3;
+    lastPort3 = value;
+
+    // Looping sounds have to be stopped even if the amplifier was just turned off
+    if (fallingEdges & PORT3_UFO) trigger(UFO_SOUND, SoundCommand::STOP);
+
+    if (!(value & PORT3_AMP_ENABLE))
+        return;
+
+    if (risingEdges & PORT3_UFO) trigger(UFO_SOUND, SoundCommand::PLAY);
+    if (risingEdges & PORT3_SHOT) trigger(SHOT_SOUND, SoundCommand::PLAY);
+    if (risingEdges & PORT3_PLAYER_DIES) trigger(PLAYER_DIES_SOUND, SoundCommand::PLAY);
+    if (risingEdges & PORT3_INVADER_DIES) trigger(INVADER_DIES_SOUND, SoundCommand::PLAY);
+}
+
+void SoundSystem::port5Written(uint8_t value)
+{
+    uint8_t risingEdges = value & ~lastPort5;
+    lastPort5 = value;
+
+    if (!(lastPort3 & PORT3_AMP_ENABLE))
+        return;
+
+    if (risingEdges & PORT5_FLEET_1) trigger(FLEET_1_SOUND, SoundCommand::PLAY);
+    if (risingEdges & PORT5_FLEET_2) trigger(FLEET_2_SOUND, SoundCommand::PLAY);
+    if (risingEdges & PORT5_FLEET_3) trigger(FLEET_3_SOUND, SoundCommand::PLAY);
+    if (risingEdges & PORT5_FLEET_4) trigger(FLEET_4_SOUND, SoundCommand::PLAY);
+    if (risingEdges & PORT5_UFO_DIES) trigger(UFO_DIES_SOUND, SoundCommand::PLAY);
+}
+
+// Runs on the emulation thread, so it must neither allocate nor block
+void SoundSystem::trigger(SoundEffect effect, SoundCommand::Action action)
+{
+    if (muted.load(std::memory_order_relaxed))
+        return;
+
+    SoundCommand command;
+    command.effect = effect;
+    command.action = action;
+    command.timestamp = measureLatency ? clock.nsecsElapsed() : 0;
+
+    if (!commands.push(command))
+        droppedCommands.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SoundSystem::handleCommands()
+{
+    SoundCommand command;
+    while (commands.pop(command))
+    {
+        Voice& voice = voices[command.effect];
+        if (command.action == SoundCommand::STOP)
+        {
+            voice.playing = false;
+            continue;
+        }
+
+        // Retriggering an effect restarts it, the hardware can't play it twice either
+        voice.playing = voice.length > 0;
+        voice.position = 0;
+        voice.triggerTime = command.timestamp;
+        voice.latencyPending = measureLatency;
+    }
+}
+
+void SoundSystem::mixBlock()
+{
+    memset(mixBuffer, 0, sizeof(mixBuffer));
+
+    for (int i = 0; i < NUM_SOUND_EFFECTS; ++i)
+    {
+        Voice& voice = voices[i];
+        int frame = 0;
+        while (voice.playing && frame < MIXER_BLOCK_SIZE)
+        {
+            int count = qMin(MIXER_BLOCK_SIZE - frame, voice.length - voice.position);
+            const int16_t* source = voice.samples + voice.position;
+            for (int j = 0; j < count; ++j)
+                mixBuffer[frame + j] += source[j];
+
+            frame += count;
+            voice.position += count;
+            if (voice.position == voice.length)
+            {
+                voice.position = 0;
+                voice.playing = voice.looping;
+            }
+        }
+    }
+
+    for (int i = 0; i < MIXER_BLOCK_SIZE; ++i)
+        outputBuffer[i] = qBound(-32768, mixBuffer[i], 32767);
+}
+
+void SoundSystem::recordLatency()
+{
+    qint64 now = clock.nsecsElapsed() + sink->bufferedNsecs();
+
+    for (int i = 0; i < NUM_SOUND_EFFECTS; ++i)
+    {
+        Voice& voice = voices[i];
+        if (!voice.latencyPending)
+            continue;
+
+        qint64 latency = now - voice.triggerTime;
+        if (latencyCount == 0 || latency < latencyMin) latencyMin = latency;
+        if (latencyCount == 0 || latency > latencyMax) latencyMax = latency;
+        latencySum += latency;
+        ++latencyCount;
+
+        voice.latencyPending = false;
+    }
+}
+
+void SoundSystem::printLatencyReport()
+{
+    if (!measureLatency)
+        return;
+
+    if (latencyCount == 0)
+    {
+        qDebug() << "Audio latency: no sounds were triggered";
+        return;
+    }
+
+    qDebug("Audio latency over %d triggers: min %.2f ms, avg %.2f ms, max %.2f ms",
+           latencyCount, latencyMin / 1e6, latencySum / 1e6 / latencyCount, latencyMax / 1e6);
+}
+
+void SoundSystem::run()
+{
+    if (!sink->open(MIXER_SAMPLE_RATE))
+    {
+        muted.store(true);
+        return;
+    }
+    setTraceThreadName("Sound");
+
+    while (!isInterruptionRequested())
+    {
+        traceBegin("Mix");
+        handleCommands();
+        mixBlock();
+        traceEnd("Mix");
+        sink->write(outputBuffer, MIXER_BLOCK_SIZE);
+
+        if (measureLatency)
+            recordLatency();
+    }
+
+    sink->close();
+}
@@ -0,0 +1,129 @@
+#ifndef SOUND_H
+#define SOUND_H
+
+#include <stdint.h>
+#include <QThread>
+#include <QVector>
+#include <QElapsedTimer>
+#include <atomic>
+#include "audiosink.h"
+#include "lockfreequeue.h"
+
+// Sound files
+#define INVADER_1_SFX ":sfx/fastinvader1"
+#define INVADER_2_SFX ":sfx/fastinvader2"
+#define INVADER_3_SFX ":sfx/fastinvader3"
+#define INVADER_4_SFX ":sfx/fastinvader4"
+#define INVADER_DIES_SFX ":sfx/invaderkilled"
+
+#define PLAYER_SHOOTING_SFX ":sfx/shoot"
+#define PLAYER_DIES_SFX ":sfx/explosion"
+
+#define UFO_SFX ":sfx/ufo_highpitch"
+#define UFO_DIES_SFX ":sfx/ufo_lowpitch"
+
+const int MIXER_SAMPLE_RATE = 44100;
+const int MIXER_BLOCK_SIZE = 256; // ~6 ms per block
+
+// Bits in the sound ports, see the hardware specification linked in the README
+const uint8_t PORT3_UFO = 1;
+const uint8_t PORT3_SHOT = 1 << 1;
+const uint8_t PORT3_PLAYER_DIES = 1 << 2;
+const uint8_t PORT3_INVADER_DIES = 1 << 3;
+const uint8_t PORT3_AMP_ENABLE = 1 << 5;
+
+const uint8_t PORT5_FLEET_1 = 1;
+const uint8_t PORT5_FLEET_2 = 1 << 1;
+const uint8_t PORT5_FLEET_3 = 1 << 2;
+const uint8_t PORT5_FLEET_4 = 1 << 3;
+const uint8_t PORT5_UFO_DIES = 1 << 4;
+
+enum SoundEffect
+{
+    UFO_SOUND,
+    SHOT_SOUND,
+    PLAYER_DIES_SOUND,
+    INVADER_DIES_SOUND,
+    FLEET_1_SOUND,
+    FLEET_2_SOUND,
+    FLEET_3_SOUND,
+    FLEET_4_SOUND,
+    UFO_DIES_SOUND,
+    NUM_SOUND_EFFECTS
+};
+
+struct SoundCommand
+{
+    enum Action { PLAY, STOP };
+
+    uint8_t effect;
+    uint8_t action;
+    qint64 timestamp; // Nanoseconds on the sound system clock when the port was written
+};
+
+// Turns writes on the sound ports into sample playback. The port handlers run
+// on the emulation thread and only push small commands onto a lock-free queue,
+// the samples are mixed on a separate high priority thread.
+class SoundSystem : public QThread
+{
+Q_OBJECT
+public:
+    SoundSystem(AudioSink* sink, bool measureLatency);
+    ~SoundSystem();
+
+    void port3Written(uint8_t value);
+    void port5Written(uint8_t value);
+
+    void printLatencyReport();
+
+private:
+    struct Voice
+    {
+        const int16_t* samples;
+        int length;
+        int position;
+        bool looping;
+        bool playing;
+        qint64 triggerTime;
+        bool latencyPending;
+    };
+
+    AudioSink* sink;
+    bool measureLatency;
+    QElapsedTimer clock;
+
+    uint8_t lastPort3;
+    uint8_t lastPort5;
+
+    QVector<int16_t> samples[NUM_SOUND_EFFECTS];
+    Voice voices[NUM_SOUND_EFFECTS];
+
+    LockFreeQueue<SoundCommand, 64> commands;
+
+    // Set when the sink couldn't be opened, nothing drains the queue then
+    std::atomic<bool> muted;
+
+    // Commands the queue had no room for, reported once when the sound system goes away
+    std::atomic<uint64_t> droppedCommands;
+
+    int32_t mixBuffer[MIXER_BLOCK_SIZE];
+    int16_t outputBuffer[MIXER_BLOCK_SIZE];
+
+    int latencyCount;
+    qint64 latencyMin;
+    qint64 latencyMax;
+    qint64 latencySum;
+
+    void loadSamples();
+    QVector<int16_t> decodeWav(const QString& fileName);
+
+    void trigger(SoundEffect, SoundCommand::Action);
+    void handleCommands();
+    void mixBlock();
+    void recordLatency();
+
+protected:
+    void run();
+};
+
+#endif // SOUND_H
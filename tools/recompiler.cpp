@@ -0,0 +1,428 @@
+// Compiles invaders.rom to C++ ahead of time for the native core, see nativecore.h.
+//
+//     recompiler invaders.rom invaders_native.cpp
+//
+// The control flow graph is recovered from the reset and interrupt vectors by following
+// jumps, calls and RSTs. Every basic block becomes a function. Loads, stores, moves and
+// control flow are emitted inline with their operands and cycle counts folded in as
+// constants, everything else is handed to the interpreter's decode() so the flags behave
+// exactly the same. Code only reachable through PCHL or a manipulated return address
+// isn't found and stays with the interpreter.
+//
+// Plain C++ without Qt, so it can be built and run on the build host before the emulator.
+
+#include <stdint.h>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "../hash.h"
+#include "../opcodes.h"
+
+const int ROM_SIZE = 0x2000;
+
+// The interrupts jump to RST 1 and RST 2
+const uint16_t ENTRY_POINTS[] = { 0x0000, 0x0008, 0x0010 };
+
+const int MAX_BLOCK_INSTRUCTIONS = 64;
+
+const char* const REGISTER_NAMES[] = { "B", "C", "D", "E", "H", "L", "M", "A" };
+const char* const PAIR_NAMES[] = { "BC", "DE", "HL", "SP" };
+
+// Bits 3 to 5 of the conditional jumps, calls and returns
+const char* const CONDITIONS[] = {
+    "!cpu.conditionBits.testBits(ZERO_BIT)",
+    "cpu.conditionBits.testBits(ZERO_BIT)",
+    "!cpu.conditionBits.testBits(CARRY_BIT)",
+    "cpu.conditionBits.testBits(CARRY_BIT)",
+    "!cpu.conditionBits.testBits(PARITY_BIT)",
+    "cpu.conditionBits.testBits(PARITY_BIT)",
+    "!cpu.conditionBits.testBits(SIGN_BIT)",
+    "cpu.conditionBits.testBits(SIGN_BIT)"
+};
+
+struct Instruction
+{
+    uint16_t address;
+    uint8_t opcode;
+    int length;
+    InstructionKind kind;
+    uint16_t operand; // Immediate byte or word
+};
+
+static const uint8_t* rom;
+
+static bool decodeInstruction(uint16_t address, Instruction& instruction)
+{
+    if (address >= ROM_SIZE)
+        return false;
+
+    instruction.address = address;
+    instruction.opcode = rom[address];
+    instruction.length = instructionLength(instruction.opcode);
+    instruction.kind = instructionKind(instruction.opcode);
+    instruction.operand = 0;
+
+    if (instruction.kind == INSTRUCTION_UNSUPPORTED || address + instruction.length > ROM_SIZE)
+        return false;
+
+    if (instruction.length == 2)
+        instruction.operand = rom[address + 1];
+    else if (instruction.length == 3)
+        instruction.operand = rom[address + 1] | (rom[address + 2] << 8);
+    return true;
+}
+
+static bool endsBlock(InstructionKind kind)
+{
+    return kind != INSTRUCTION_PLAIN;
+}
+
+// Follows the control flow from the entry points, returns the start of every basic block
+static std::set<uint16_t> findLeaders()
+{
+    std::set<uint16_t> leaders;
+    std::vector<uint16_t> work(ENTRY_POINTS, ENTRY_POINTS + sizeof(ENTRY_POINTS) / sizeof(ENTRY_POINTS[0]));
+
+    while (!work.empty())
+    {
+        uint16_t address = work.back();
+        work.pop_back();
+        if (address >= ROM_SIZE || !leaders.insert(address).second)
+            continue;
+
+        Instruction instruction;
+        while (decodeInstruction(address, instruction))
+        {
+            uint16_t next = address + instruction.length;
+            switch (instruction.kind)
+            {
+            case INSTRUCTION_JUMP:
+                work.push_back(instruction.operand);
+                break;
+            case INSTRUCTION_JUMP_IF:
+            case INSTRUCTION_CALL:
+            case INSTRUCTION_CALL_IF:
+                work.push_back(instruction.operand);
+                work.push_back(next);
+                break;
+            case INSTRUCTION_RETURN_IF:
+                work.push_back(next);
+                break;
+            case INSTRUCTION_COMPUTED:
+                if (instruction.opcode != 0xE9)
+                    work.push_back(instruction.opcode & 0x38);
+                break;
+            default:
+                break;
+            }
+
+            if (endsBlock(instruction.kind))
+                break;
+            address = next;
+        }
+    }
+
+    return leaders;
+}
+
+static std::string format(const char* pattern, ...)
+{
+    char buffer[256];
+    va_list arguments;
+    va_start(arguments, pattern);
+    vsnprintf(buffer, sizeof(buffer), pattern, arguments);
+    va_end(arguments);
+    return buffer;
+}
+
+// C++ for an instruction that is emitted inline, empty if it is left to the interpreter
+static std::string inlineCode(const Instruction& instruction, int& cycles)
+{
+    uint8_t opcode = instruction.opcode;
+    uint16_t operand = instruction.operand;
+    int destination = (opcode >> 3) & 7;
+    int source = opcode & 7;
+    int pair = (opcode >> 4) & 3;
+
+    if (opcode >= 0x40 && opcode < 0x80 && opcode != 0x76)
+    {
+        if (destination == 6)
+        {
+            cycles = 7;
+            return format("cpu.writeMemory(r.HL, r.%s);", REGISTER_NAMES[source]);
+        }
+        if (source == 6)
+        {
+            cycles = 7;
+            return format("r.%s = cpu.readMemory(r.HL);", REGISTER_NAMES[destination]);
+        }
+        cycles = 5;
+        return format("r.%s = r.%s;", REGISTER_NAMES[destination], REGISTER_NAMES[source]);
+    }
+
+    // The interpreter decodes 0x1E as MVI C, that one is left to it
+    if ((opcode & 0xC7) == 0x06 && opcode != 0x1E)
+    {
+        if (destination == 6)
+        {
+            cycles = 10;
+            return format("cpu.writeMemory(r.HL, 0x%02x);", operand);
+        }
+        cycles = 7;
+        return format("r.%s = 0x%02x;", REGISTER_NAMES[destination], operand);
+    }
+
+    switch (opcode)
+    {
+    case 0x00:
+        cycles = 4;
+        return "// NOP";
+    case 0x01: case 0x11: case 0x21: case 0x31:
+        cycles = 10;
+        return format("r.%s = 0x%04x;", PAIR_NAMES[pair], operand);
+    case 0x03: case 0x13: case 0x23: case 0x33:
+        cycles = 5;
+        return format("++r.%s;", PAIR_NAMES[pair]);
+    case 0x0B: case 0x1B: case 0x2B: case 0x3B:
+        cycles = 5;
+        return format("--r.%s;", PAIR_NAMES[pair]);
+    case 0x02: case 0x12:
+        cycles = 7;
+        return format("cpu.writeMemory(r.%s, r.A);", PAIR_NAMES[pair]);
+    case 0x0A: case 0x1A:
+        cycles = 7;
+        return format("r.A = cpu.readMemory(r.%s);", PAIR_NAMES[pair]);
+    case 0x22:
+        cycles = 16;
+        return format("cpu.writeMemory(0x%04x, r.L); cpu.writeMemory(0x%04x, r.H);", operand, (operand + 1) & 0xFFFF);
+    case 0x2A:
+        cycles = 16;
+        return format("r.L = cpu.readMemory(0x%04x); r.H = cpu.readMemory(0x%04x);", operand, (operand + 1) & 0xFFFF);
+    case 0x32:
+        cycles = 13;
+        return format("cpu.writeMemory(0x%04x, r.A);", operand);
+    case 0x3A:
+        cycles = 13;
+        return format("r.A = cpu.readMemory(0x%04x);", operand);
+    case 0xC1: case 0xD1: case 0xE1:
+        cycles = 10;
+        return format("r.%s = cpu.pop();", PAIR_NAMES[pair]);
+    case 0xC5: case 0xD5: case 0xE5:
+        cycles = 11;
+        return format("cpu.push(r.%s);", PAIR_NAMES[pair]);
+    case 0xEB:
+        cycles = 5;
+        return "{ uint16_t de = r.DE; r.DE = r.HL; r.HL = de; }";
+    case 0xF3:
+        cycles = 4;
+        return "cpu.interruptsEnabled = false;";
+    case 0xFB:
+        cycles = 4;
+        return "cpu.interruptsEnabled = true;";
+    case 0xF9:
+        cycles = 5;
+        return "r.SP = r.HL;";
+    }
+
+    return std::string();
+}
+
+static std::string trace(uint8_t opcode, const std::string& cycles)
+{
+    return format("cpu.tracePolicy.instruction(cpu, 0x%02x, %s);", opcode, cycles.c_str());
+}
+
+struct Block
+{
+    uint16_t address;
+    int cyclesBeforeLast;
+    int instructions;
+    std::string code;
+};
+
+static Block compileBlock(uint16_t address, const std::set<uint16_t>& leaders)
+{
+    Block block;
+    block.address = address;
+    block.cyclesBeforeLast = 0;
+    block.instructions = 0;
+
+    std::string body;
+    int constantCycles = 0;
+    int previousCycles = 0;
+    bool dynamicCycles = false;
+    bool returned = false;
+
+    Instruction instruction;
+    while (!returned && block.instructions < MAX_BLOCK_INSTRUCTIONS && decodeInstruction(address, instruction))
+    {
+        if (block.instructions > 0 && leaders.count(address))
+            break;
+
+        block.cyclesBeforeLast += previousCycles;
+        ++block.instructions;
+
+        uint8_t opcode = instruction.opcode;
+        uint16_t next = address + instruction.length;
+        const char* condition = CONDITIONS[(opcode >> 3) & 7];
+        std::string total = format("cycles + %d", constantCycles);
+        body += format("    // %04x\n", address);
+
+        switch (instruction.kind)
+        {
+        case INSTRUCTION_PLAIN:
+        {
+            int cycles = 0;
+            std::string inlined = inlineCode(instruction, cycles);
+            if (!inlined.empty())
+            {
+                body += "    " + inlined + "\n";
+                body += "    " + trace(opcode, format("%d", cycles)) + "\n";
+                constantCycles += cycles;
+                previousCycles = cycles;
+            }
+            else
+            {
+                body += format("    r.PC = 0x%04x;\n", address);
+                body += format("    instructionCycles = cpu.decode(0x%02x);\n", opcode);
+                body += "    " + trace(opcode, "instructionCycles") + "\n";
+                body += "    cycles += instructionCycles;\n";
+                dynamicCycles = true;
+                previousCycles = MAX_INSTRUCTION_CYCLES;
+            }
+            address = next;
+            break;
+        }
+        case INSTRUCTION_JUMP:
+            body += "    " + trace(opcode, "10") + "\n";
+            body += format("    r.PC = 0x%04x;\n", instruction.operand);
+            body += format("    return %s + 10;\n", total.c_str());
+            returned = true;
+            break;
+        case INSTRUCTION_JUMP_IF:
+            body += "    " + trace(opcode, "10") + "\n";
+            body += format("    r.PC = %s ? 0x%04x : 0x%04x;\n", condition, instruction.operand, next);
+            body += format("    return %s + 10;\n", total.c_str());
+            returned = true;
+            break;
+        case INSTRUCTION_CALL:
+            body += format("    cpu.push(0x%04x);\n", next);
+            body += "    " + trace(opcode, "17") + "\n";
+            body += format("    r.PC = 0x%04x;\n", instruction.operand);
+            body += format("    return %s + 17;\n", total.c_str());
+            returned = true;
+            break;
+        case INSTRUCTION_CALL_IF:
+            body += format("    if (%s)\n    {\n", condition);
+            body += format("        cpu.push(0x%04x);\n", next);
+            body += "        " + trace(opcode, "17") + "\n";
+            body += format("        r.PC = 0x%04x;\n", instruction.operand);
+            body += format("        return %s + 17;\n    }\n", total.c_str());
+            body += "    " + trace(opcode, "11") + "\n";
+            body += format("    r.PC = 0x%04x;\n", next);
+            body += format("    return %s + 11;\n", total.c_str());
+            returned = true;
+            break;
+        case INSTRUCTION_RETURN:
+            body += "    " + trace(opcode, "10") + "\n";
+            body += "    r.PC = cpu.pop();\n";
+            body += format("    return %s + 10;\n", total.c_str());
+            returned = true;
+            break;
+        case INSTRUCTION_RETURN_IF:
+            body += format("    if (%s)\n    {\n", condition);
+            body += "        " + trace(opcode, "11") + "\n";
+            body += "        r.PC = cpu.pop();\n";
+            body += format("        return %s + 11;\n    }\n", total.c_str());
+            body += "    " + trace(opcode, "5") + "\n";
+            body += format("    r.PC = 0x%04x;\n", next);
+            body += format("    return %s + 5;\n", total.c_str());
+            returned = true;
+            break;
+        case INSTRUCTION_COMPUTED:
+        case INSTRUCTION_UNSUPPORTED:
+            body += format("    r.PC = 0x%04x;\n", address);
+            body += format("    instructionCycles = cpu.decode(0x%02x);\n", opcode);
+            body += "    " + trace(opcode, "instructionCycles") + "\n";
+            body += format("    return %s + instructionCycles;\n", total.c_str());
+            dynamicCycles = true;
+            returned = true;
+            break;
+        }
+    }
+
+    // Ran into another block, an instruction that isn't compiled or the length limit
+    if (!returned)
+    {
+        body += format("    r.PC = 0x%04x;\n", address);
+        body += format("    return cycles + %d;\n", constantCycles);
+    }
+
+    block.code = format("static int block_%04x(CPU& cpu)\n{\n", block.address);
+    block.code += "    CPU::dataRegisters& r = cpu.registers;\n";
+    block.code += "    int cycles = 0;\n";
+    if (dynamicCycles)
+        block.code += "    int instructionCycles;\n";
+    block.code += "\n" + body + "}\n";
+    return block;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s ROM OUTPUT\n", argv[0]);
+        return 1;
+    }
+
+    static uint8_t image[ROM_SIZE];
+    FILE* romFile = fopen(argv[1], "rb");
+    if (!romFile || fread(image, 1, ROM_SIZE, romFile) != (size_t) ROM_SIZE)
+    {
+        fprintf(stderr, "Could not read %d bytes from %s.\n", ROM_SIZE, argv[1]);
+        return 1;
+    }
+    fclose(romFile);
+    rom = image;
+
+    std::set<uint16_t> leaders = findLeaders();
+    std::vector<Block> blocks;
+    int instructions = 0;
+    for (std::set<uint16_t>::const_iterator it = leaders.begin(); it != leaders.end(); ++it)
+    {
+        Block block = compileBlock(*it, leaders);
+        if (block.instructions == 0)
+            continue;
+        instructions += block.instructions;
+        blocks.push_back(block);
+    }
+
+    FILE* out = fopen(argv[2], "w");
+    if (!out)
+    {
+        fprintf(stderr, "Could not open %s.\n", argv[2]);
+        return 1;
+    }
+
+    fprintf(out, "// Generated by tools/recompiler.cpp from %s, don't edit\n\n", argv[1]);
+    fprintf(out, "#include \"nativecore.h\"\n\n");
+    fprintf(out, "// Blocks compiled inline only update PC when they exit or hand an instruction to the interpreter\n\n");
+    for (size_t i = 0; i < blocks.size(); ++i)
+        fprintf(out, "%s\n", blocks[i].code.c_str());
+
+    fprintf(out, "extern const uint64_t NATIVE_ROM_HASH = 0x%016llxULL;\n\n",
+            (unsigned long long) hashBytes(image, ROM_SIZE));
+    fprintf(out, "extern const NativeBlock NATIVE_BLOCKS[] = {\n");
+    for (size_t i = 0; i < blocks.size(); ++i)
+        fprintf(out, "    { 0x%04x, %d, block_%04x },\n", blocks[i].address, blocks[i].cyclesBeforeLast, blocks[i].address);
+    fprintf(out, "};\n\n");
+    fprintf(out, "extern const int NATIVE_BLOCK_COUNT = %d;\n", (int) blocks.size());
+    fclose(out);
+
+    printf("Compiled %d instructions in %d blocks.\n", instructions, (int) blocks.size());
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include "trace.h"
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QDebug>
+
+std::atomic<bool> tracingEnabled(false);
+
+static QElapsedTimer traceClock;
+
+// Buffers are never freed, their threads may still add events after the trace was written
+static QMutex buffersMutex;
+static QList<TraceBuffer*> buffers;
+
+static thread_local TraceBuffer* threadBuffer = 0;
+
+TraceBuffer::TraceBuffer(const QString& threadName, int threadId)
+    : threadName(threadName), threadId(threadId), written(0)
+{
+}
+
+void TraceBuffer::add(char phase, const char* name, int64_t value)
+{
+    uint64_t index = written.load(std::memory_order_relaxed);
+    TraceEvent& event = events[index % TRACE_BUFFER_EVENTS];
+
+    // The slot is about to be overwritten, a reader that copied it meanwhile will see the new count
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name = name;
+    event.timestamp = traceClock.nsecsElapsed();
+    event.value = value;
+    event.phase = phase;
+
+    written.store(index + 1, std::memory_order_release);
+}
+
+QVector<TraceEvent> TraceBuffer::latestEvents() const
+{
+    uint64_t end = written.load(std::memory_order_acquire);
+    uint64_t start = end > TRACE_BUFFER_EVENTS ? end - TRACE_BUFFER_EVENTS : 0;
+
+    QVector<TraceEvent> copy;
+    copy.reserve(end - start);
+    for (uint64_t index = start; index < end; ++index)
+        copy.append(events[index % TRACE_BUFFER_EVENTS]);
+
+    // The slot of the event being added right now belongs to the oldest one copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = written.load(std::memory_order_relaxed);
+    uint64_t overwritten = after + 1 > start + TRACE_BUFFER_EVENTS ? after + 1 - start - TRACE_BUFFER_EVENTS : 0;
+    return copy.mid(qMin<uint64_t>(overwritten, copy.size()));
+}
+
+void startTracing()
+{
+    traceClock.start();
+    tracingEnabled.store(true);
+}
+
+static TraceBuffer* currentBuffer(const char* name)
+{
+    if (!threadBuffer)
+    {
+        QMutexLocker locker(&buffersMutex);
+        int id = buffers.size() + 1;
+        threadBuffer = new TraceBuffer(name ? QString(name) : QString("Thread %1").arg(id), id);
+        buffers.append(threadBuffer);
+    }
+    return threadBuffer;
+}
+
+void setTraceThreadName(const char* name)
+{
+    if (tracingEnabled.load(std::memory_order_relaxed))
+        currentBuffer(name);
+}
+
+void addTraceEvent(char phase, const char* name, int64_t value)
+{
+    currentBuffer(0)->add(phase, name, value);
+}
+
+bool writeTrace(const QString& fileName)
+{
+    QList<TraceBuffer*> threads;
+    {
+        QMutexLocker locker(&buffersMutex);
+        threads = buffers;
+    }
+
+    QList<QByteArray> lines;
+    int eventCount = 0;
+    for (const TraceBuffer* buffer : threads)
+    {
+        QByteArray thread = ",\"pid\":1,\"tid\":" + QByteArray::number(buffer->threadId);
+        lines.append("{\"name\":\"thread_name\",\"ph\":\"M\"" + thread + ",\"args\":{\"name\":\""
+                     + buffer->threadName.toUtf8() + "\"}}");
+
+        for (const TraceEvent& event : buffer->latestEvents())
+        {
+            // Timestamps are in microseconds in the format
+            QByteArray line = QByteArray("{\"name\":\"") + event.name + "\",\"ph\":\"" + event.phase + "\"" + thread
+                + ",\"ts\":" + QByteArray::number(event.timestamp / 1000.0, 'f', 3);
+            if (event.phase == 'i')
+                line += ",\"s\":\"t\"";
+            if (event.value)
+                line += ",\"args\":{\"value\":" + QByteArray::number(qint64(event.value)) + "}";
+            lines.append(line + "}");
+            ++eventCount;
+        }
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning("Could not open %s.", qPrintable(fileName));
+        return false;
+    }
+    QByteArray json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (int i = 0; i < lines.size(); ++i)
+        json += lines[i] + (i + 1 < lines.size() ? ",\n" : "\n");
+    json += "]}\n";
+    if (file.write(json) < 0 || !file.commit())
+    {
+        qWarning("Could not write the trace to %s.", qPrintable(fileName));
+        return false;
+    }
+
+    qDebug("Wrote %d trace events of %d threads to %s.", eventCount, threads.size(), qPrintable(fileName));
+    return true;
+}
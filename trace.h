@@ -0,0 +1,82 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+// Events kept per thread, the oldest are overwritten. About two minutes of the emulation thread.
+const int TRACE_BUFFER_EVENTS = 1 << 16;
+
+struct TraceEvent
+{
+    const char* name; // Has to stay valid until the trace is written, string literals do
+    qint64 timestamp; // Nanoseconds since startTracing()
+    int64_t value;
+    char phase;       // 'B' begins a span, 'E' ends it, 'i' is an instant, like in the trace format
+};
+
+// Events of one thread. Only that thread adds them, so adding is two stores and no locks.
+// Any thread can copy the latest ones at any time, like a FrameSubscriber it throws away
+// what the owner overwrote while it was copying.
+class TraceBuffer
+{
+public:
+    TraceBuffer(const QString& threadName, int threadId);
+
+    const QString threadName;
+    const int threadId;
+
+    void add(char phase, const char* name, int64_t value);
+    QVector<TraceEvent> latestEvents() const;
+
+private:
+    std::atomic<uint64_t> written;
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+};
+
+// Tracing is off until startTracing() and every trace call is a single check until then
+extern std::atomic<bool> tracingEnabled;
+
+void startTracing();
+
+// Names the calling thread in the trace, has to come before its first event to count
+void setTraceThreadName(const char* name);
+
+void addTraceEvent(char phase, const char* name, int64_t value);
+
+// Writes the latest events of all threads as Chrome's trace event JSON, which
+// chrome://tracing and the Perfetto UI open. Can be called from any thread while they run.
+bool writeTrace(const QString& fileName);
+
+inline void traceBegin(const char* name)
+{
+    if (tracingEnabled.load(std::memory_order_relaxed))
+        addTraceEvent('B', name, 0);
+}
+
+inline void traceEnd(const char* name)
+{
+    if (tracingEnabled.load(std::memory_order_relaxed))
+        addTraceEvent('E', name, 0);
+}
+
+inline void traceInstant(const char* name, int64_t value = 0)
+{
+    if (tracingEnabled.load(std::memory_order_relaxed))
+        addTraceEvent('i', name, value);
+}
+
+// A span from here to the end of the scope
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name) : name(name) { traceBegin(name); }
+    ~TraceScope() { traceEnd(name); }
+
+private:
+    const char* name;
+};
+
+#endif // TRACE_H
@@ -0,0 +1,226 @@
+#include "watchpoints.h"
+#include "machine.h"
+#include "disassembler.h"
+#include "opcodes.h"
+#include <QTextStream>
+#include <QDebug>
+
+// Shown around the hit in the dump
+const int DUMP_INSTRUCTIONS = 6;
+const int DUMP_STACK_WORDS = 4;
+const int DUMP_MEMORY_BYTES = 16;
+
+Watchpoints::Watchpoints() : readPages(0), writePages(0), executePages(0), portsWatched(false), hit(false)
+{
+}
+
+void Watchpoints::add(int kinds, uint16_t first, uint16_t last)
+{
+    if (first > last)
+        qSwap(first, last);
+
+    if (kinds & (WATCH_PORT_IN | WATCH_PORT_OUT))
+    {
+        Watchpoint watchpoint = { kinds, first, last };
+        watchpoints.append(watchpoint);
+        portsWatched = true;
+        return;
+    }
+
+    // Split where the range wraps around the mirrored address space
+    if (last - first >= MEMORY_SIZE)
+    {
+        first = 0;
+        last = ADDRESS_MASK;
+    }
+    first &= ADDRESS_MASK;
+    last &= ADDRESS_MASK;
+    if (first > last)
+    {
+        add(kinds, first, ADDRESS_MASK);
+        first = 0;
+    }
+
+    Watchpoint watchpoint = { kinds, first, last };
+    watchpoints.append(watchpoint);
+    for (int page = first >> 8; page <= last >> 8; ++page)
+    {
+        uint64_t bit = watchPageBit(page << 8);
+        if (kinds & WATCH_READ)
+            readPages |= bit;
+        if (kinds & WATCH_WRITE)
+            writePages |= bit;
+        if (kinds & WATCH_EXECUTE)
+            executePages |= bit;
+    }
+}
+
+bool Watchpoints::add(int kinds, const QString& range)
+{
+    QStringList ends = range.split('-');
+    bool firstOk = false;
+    bool lastOk = false;
+    uint first = ends[0].toUInt(&firstOk, 16);
+    uint last = ends.size() == 2 ? ends[1].toUInt(&lastOk, 16) : first;
+
+    uint limit = kinds & (WATCH_PORT_IN | WATCH_PORT_OUT) ? 0xFF : 0xFFFF;
+    if (!firstOk || (ends.size() == 2 && !lastOk) || ends.size() > 2 || first > limit || last > limit)
+    {
+        qWarning("Can't watch %s, expected a hex address or a range like 2400-3FFF.", qPrintable(range));
+        return false;
+    }
+
+    add(kinds, first, last);
+    return true;
+}
+
+void Watchpoints::clear()
+{
+    watchpoints.clear();
+    readPages = writePages = executePages = 0;
+    portsWatched = false;
+    hit = false;
+}
+
+bool Watchpoints::isEmpty() const
+{
+    return watchpoints.isEmpty();
+}
+
+void Watchpoints::check(WatchKind kind, uint16_t address, uint8_t value, uint16_t pc)
+{
+    uint16_t key = kind & (WATCH_PORT_IN | WATCH_PORT_OUT) ? address : address & ADDRESS_MASK;
+    for (const Watchpoint& watchpoint : watchpoints)
+    {
+        if ((watchpoint.kinds & kind) && key >= watchpoint.first && key <= watchpoint.last)
+        {
+            // The first access of an instruction is the one reported
+            if (!hit)
+            {
+                WatchHit watchHit = { kind, address, value, pc };
+                lastWatchHit = watchHit;
+                hit = true;
+            }
+            return;
+        }
+    }
+}
+
+bool WatchList::isEmpty() const
+{
+    return breakpoints.isEmpty() && reads.isEmpty() && writes.isEmpty() && ports.isEmpty();
+}
+
+bool setWatchpoints(Machine& machine, const WatchList& list)
+{
+    Watchpoints* watchpoints = machine.watchpoints();
+    if (!watchpoints)
+    {
+        qWarning("This build has no watchpoints, build it with CONFIG+=watchpoints.");
+        return false;
+    }
+
+    bool valid = true;
+    for (const QString& range : list.breakpoints)
+        valid = watchpoints->add(WATCH_EXECUTE, range) && valid;
+    for (const QString& range : list.reads)
+        valid = watchpoints->add(WATCH_READ, range) && valid;
+    for (const QString& range : list.writes)
+        valid = watchpoints->add(WATCH_WRITE, range) && valid;
+    for (const QString& range : list.ports)
+        valid = watchpoints->add(WATCH_PORT_IN | WATCH_PORT_OUT, range) && valid;
+
+    // The dump shows the flags, so they have to be computed after every instruction
+    machine.setNativeCore(false);
+    machine.setFlagLiveness(false);
+    machine.setFusion(false);
+    machine.setHle(false);
+    return valid;
+}
+
+static const char* watchKindName(WatchKind kind)
+{
+    switch (kind)
+    {
+    case WATCH_READ:
+        return "Read of";
+    case WATCH_WRITE:
+        return "Write to";
+    case WATCH_EXECUTE:
+        return "Breakpoint at";
+    case WATCH_PORT_IN:
+        return "Input from port";
+    default:
+        return "Output to port";
+    }
+}
+
+void printWatchHit(const Machine& machine)
+{
+    const CPU& cpu = machine.cpu;
+    const WatchHit& hit = machine.watchpoints()->lastHit();
+
+    if (hit.kind == WATCH_EXECUTE)
+        qWarning("Breakpoint at %04X in frame %llu after %llu cycles.", hit.address,
+                 (unsigned long long) machine.frame, (unsigned long long) machine.cycles);
+    else if (hit.kind == WATCH_PORT_IN || hit.kind == WATCH_PORT_OUT)
+        qWarning("%s %02X, value %02X, by the instruction at %04X in frame %llu after %llu cycles.",
+                 watchKindName(hit.kind), hit.address, hit.value, hit.pc, (unsigned long long) machine.frame,
+                 (unsigned long long) machine.cycles);
+    else
+        qWarning("%s %04X, value %02X, by the instruction at %04X in frame %llu after %llu cycles.",
+                 watchKindName(hit.kind), hit.address, hit.value, hit.pc, (unsigned long long) machine.frame,
+                 (unsigned long long) machine.cycles);
+
+    qWarning("PC=%04X SP=%04X A=%02X BC=%04X DE=%04X HL=%04X flags=%02X IE=%d shift=%04X",
+             cpu.registers.PC, cpu.registers.SP, cpu.registers.A, cpu.registers.BC, cpu.registers.DE,
+             cpu.registers.HL, cpu.conditionBits.getRegister(), cpu.interruptsEnabled, cpu.shiftRegister);
+
+    // From the instruction that made the access on, the next one to run is marked
+    uint16_t address = hit.kind == WATCH_EXECUTE ? cpu.registers.PC : hit.pc;
+    for (int i = 0; i < DUMP_INSTRUCTIONS; ++i)
+    {
+        qWarning("%s %s", address == cpu.registers.PC ? ">" : " ", qPrintable(disassemble(cpu, address)));
+        address += instructionLength(cpu.readByte(address));
+    }
+
+    QString stack;
+    for (int i = 0; i < DUMP_STACK_WORDS; ++i)
+    {
+        uint16_t word = cpu.readByte(cpu.registers.SP + 2 * i) | (cpu.readByte(cpu.registers.SP + 2 * i + 1) << 8);
+        stack += QString(" %1").arg(word, 4, 16, QChar('0'));
+    }
+    qWarning("Stack:%s", qPrintable(stack.toUpper()));
+
+    if (hit.kind == WATCH_READ || hit.kind == WATCH_WRITE)
+    {
+        uint16_t start = hit.address & ~(DUMP_MEMORY_BYTES - 1);
+        QString bytes;
+        for (int i = 0; i < DUMP_MEMORY_BYTES; ++i)
+            bytes += QString(" %1").arg(cpu.readByte(start + i), 2, 16, QChar('0'));
+        qWarning("%04X:%s", start, qPrintable(bytes.toUpper()));
+    }
+}
+
+bool runFrameWatched(Machine& machine)
+{
+    uint64_t frame = machine.frame;
+    machine.runFrame();
+
+    Watchpoints* watchpoints = machine.watchpoints();
+    while (watchpoints && watchpoints->hasHit())
+    {
+        printWatchHit(machine);
+        watchpoints->clearHit();
+
+        qWarning("Paused, press return to continue.");
+        QTextStream input(stdin);
+        if (input.readLine().isNull())
+            return false;
+
+        // The hit may have been on the last instruction of the frame
+        if (machine.frame == frame)
+            machine.runFrame();
+    }
+    return true;
+}
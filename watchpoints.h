@@ -0,0 +1,136 @@
+#ifndef WATCHPOINTS_H
+#define WATCHPOINTS_H
+
+#include <stdint.h>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class Machine;
+
+enum WatchKind
+{
+    WATCH_READ = 1,     // Opcode fetches included
+    WATCH_WRITE = 2,
+    WATCH_EXECUTE = 4,  // Hits once PC gets there, before the instruction runs
+    WATCH_PORT_IN = 8,
+    WATCH_PORT_OUT = 16
+};
+
+struct Watchpoint
+{
+    int kinds;
+    uint16_t first; // Addresses or port numbers, inclusive
+    uint16_t last;
+};
+
+struct WatchHit
+{
+    WatchKind kind;
+    uint16_t address;
+    uint8_t value;
+    uint16_t pc; // Of the instruction that made the access
+};
+
+// Breakpoints and watchpoints on the memory bus of a CPU built with CONFIG+=watchpoints, see
+// WatchedMemory. Every access first tests the bit of its 256 byte page, only pages with a
+// watch look further. A hit is kept until it is cleared, the machine stops after the
+// instruction that caused it.
+class Watchpoints
+{
+public:
+    Watchpoints();
+
+    // Addresses are mirrored like on the board, a watch sees every alias
+    void add(int kinds, uint16_t first, uint16_t last);
+
+    // A hex address or port, or a range like 2400-3FFF. Returns false if it can't be parsed.
+    bool add(int kinds, const QString& range);
+
+    void clear();
+    bool isEmpty() const;
+
+    bool hasHit() const { return hit; }
+    const WatchHit& lastHit() const { return lastWatchHit; }
+    void clearHit() { hit = false; }
+
+    void read(uint16_t address, uint8_t value, uint16_t pc);
+    void write(uint16_t address, uint8_t value, uint16_t pc);
+    void execute(uint16_t pc);
+    void portIn(uint8_t port, uint8_t value, uint16_t pc);
+    void portOut(uint8_t port, uint8_t value, uint16_t pc);
+
+private:
+    QVector<Watchpoint> watchpoints;
+
+    // One bit per 256 byte page of the 16 KB address space
+    uint64_t readPages;
+    uint64_t writePages;
+    uint64_t executePages;
+    bool portsWatched;
+
+    bool hit;
+    WatchHit lastWatchHit;
+
+    void check(WatchKind kind, uint16_t address, uint8_t value, uint16_t pc);
+};
+
+// Watchpoints as given on the command line, as hex addresses or ranges
+struct WatchList
+{
+    QStringList breakpoints;
+    QStringList reads;
+    QStringList writes;
+    QStringList ports;
+
+    bool isEmpty() const;
+};
+
+// Adds the watchpoints to the machine and runs it one instruction per step, so a hit stops
+// right after the instruction that caused it. Returns false if one can't be parsed or the
+// build has no watchpoints.
+bool setWatchpoints(Machine& machine, const WatchList& list);
+
+// Registers, the instructions around PC, the top of the stack and the memory around the hit
+void printWatchHit(const Machine& machine);
+
+// Runs a whole frame like Machine::runFrame(), but pauses at every hit: prints the state and
+// waits for return on the standard input. Returns false once the input is closed.
+bool runFrameWatched(Machine& machine);
+
+inline uint64_t watchPageBit(uint16_t address)
+{
+    return 1ULL << ((address >> 8) & 0x3F);
+}
+
+inline void Watchpoints::read(uint16_t address, uint8_t value, uint16_t pc)
+{
+    if (readPages & watchPageBit(address))
+        check(WATCH_READ, address, value, pc);
+}
+
+inline void Watchpoints::write(uint16_t address, uint8_t value, uint16_t pc)
+{
+    if (writePages & watchPageBit(address))
+        check(WATCH_WRITE, address, value, pc);
+}
+
+inline void Watchpoints::execute(uint16_t pc)
+{
+    if (executePages & watchPageBit(pc))
+        check(WATCH_EXECUTE, pc, 0, pc);
+}
+
+inline void Watchpoints::portIn(uint8_t port, uint8_t value, uint16_t pc)
+{
+    if (portsWatched)
+        check(WATCH_PORT_IN, port, value, pc);
+}
+
+inline void Watchpoints::portOut(uint8_t port, uint8_t value, uint16_t pc)
+{
+    if (portsWatched)
+        check(WATCH_PORT_OUT, port, value, pc);
+}
+
+#endif // WATCHPOINTS_H